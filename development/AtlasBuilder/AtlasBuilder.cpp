@@ -0,0 +1,514 @@
+/**
+ Atlas Builder:
+
+ Headless, incremental spritesheet builder for asset pipelines.
+
+ Every subdirectory of the input directory is one sheet. Its images (found
+ recursively; ids are the file names without extension, as in the
+ SpriteSheetGenerator sample) are packed with ImagePacker and written to the
+ output directory as:
+   <sheet>.json          JSON description
+   <sheet>.atlas         binary description (AtlasFormat.h)
+   <sheet>.png           first page; further pages are <sheet>-<page>.png
+   <sheet>.ktx ...       reduced-format pages, when --format isn't rgba8888
+   <sheet>.stamp.json    what the outputs were built from
+
+ A sheet is only rebuilt when the hash of its packing options and the
+ contents of its input files differs from the one in its stamp, or when
+ one of its outputs has gone missing. Files whose size and modification
+ time match the stamp reuse their recorded hash, so an unchanged tree costs
+ one stat per image. Sheets build in parallel on the shared ThreadPool.
+
+ Ids must be unique within a sheet: a/walk.png and b/walk.png would both be
+ "walk", so a sheet with such a pair fails to build and names both files.
+
+ Outputs are written to temporary files and renamed into place; the stamp
+ goes last, so an interrupted build is redone on the next run instead of
+ leaving a half-written sheet that looks current.
+
+ Usage: AtlasBuilder <input dir> <output dir> [options]
+   --width <px>          page width for MaxRects packing (default 1024)
+   --max-page <w> <h>    limit page size; extra images spill onto more pages
+   --padding <px>        space around each image (default 1)
+   --best <ms>           search packing configurations for up to ms per sheet
+   --rotate              allow images to be stored turned 90 degrees
+   --trim                trim images to their non-transparent area
+   --outline <n>         outline vertex budget for tight sprite meshes
+   --format <name>       rgba8888 (default), rgba4444, rgb565, indexed, bc1, bc3
+   --force               rebuild every sheet
+*/
+
+#include "pockets/ImagePacker.h"
+#include "pockets/ImageWriter.h"
+#include "pockets/PixelFormat.h"
+#include "pockets/ThreadPool.h"
+#include "cinder/DataSource.h"
+#include "cinder/Utilities.h"
+#include <algorithm>
+#include <cctype>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iomanip>
+#include <iostream>
+#include <map>
+#include <mutex>
+#include <set>
+#include <sstream>
+
+using namespace std;
+using namespace cinder;
+using namespace pockets;
+
+namespace
+{
+  //! change whenever the outputs for the same inputs would change
+  const string cBuilderVersion = "1";
+
+  struct Options
+  {
+    int         width = 1024;
+    Vec2i       max_page = Vec2i::zero();
+    int         padding = 1;
+    double      best_ms = 0.0;
+    bool        rotate = false;
+    bool        trim = false;
+    int         outline = 0;
+    PixelFormat format = eRGBA8888;
+    bool        force = false;
+    //! everything that affects the outputs, for the sheet hash
+    string      describe() const
+    {
+      stringstream ss;
+      ss << "v" << cBuilderVersion << " w" << width << " m" << max_page.x << "x" << max_page.y << " p" << padding;
+      ss << " b" << best_ms << " r" << rotate << " t" << trim << " o" << outline << " f" << format;
+      return ss.str();
+    }
+  };
+
+  //! an input image and the hash of its contents
+  struct SourceFile
+  {
+    fs::path    path;
+    string      relative;
+    uintmax_t   size = 0;
+    time_t      time = 0;
+    uint64_t    hash = 0;
+  };
+
+  //! what a sheet's outputs were last built from
+  struct Stamp
+  {
+    uint64_t                  key = 0;
+    map<string, SourceFile>   files;
+    vector<string>            outputs;
+  };
+
+  enum Status { eUpToDate, eBuilt, eFailed };
+
+  struct SheetResult
+  {
+    Status  status = eFailed;
+    string  message;
+  };
+
+  //! FNV-1a, continuing from \a hash
+  uint64_t hashBytes( const void *data, size_t size, uint64_t hash=14695981039346656037ULL )
+  {
+    const uint8_t *bytes = static_cast<const uint8_t*>( data );
+    for( size_t i = 0; i < size; ++i )
+    {
+      hash = ( hash ^ bytes[i] ) * 1099511628211ULL;
+    }
+    return hash;
+  }
+
+  //! strings are hashed with their terminator so adjacent fields can't run together
+  uint64_t hashString( const string &str, uint64_t hash )
+  {
+    return hashBytes( str.c_str(), str.size() + 1, hash );
+  }
+
+  uint64_t hashFile( const fs::path &path )
+  {
+    ifstream file( path.string(), ios::binary );
+    vector<char> chunk( 1 << 16 );
+    uint64_t hash = hashBytes( nullptr, 0 );
+    while( file )
+    {
+      file.read( chunk.data(), chunk.size() );
+      hash = hashBytes( chunk.data(), static_cast<size_t>( file.gcount() ), hash );
+    }
+    if( file.bad() )
+    {
+      throw runtime_error( "unable to read " + path.string() );
+    }
+    return hash;
+  }
+
+  string toHex( uint64_t value )
+  {
+    stringstream ss;
+    ss << hex << setw( 16 ) << setfill( '0' ) << value;
+    return ss.str();
+  }
+
+  uint64_t fromHex( const string &str )
+  {
+    return strtoull( str.c_str(), nullptr, 16 );
+  }
+
+  //! extensions are matched regardless of case, so WALK.PNG is found along with walk.png
+  string lowercase( string str )
+  {
+    transform( str.begin(), str.end(), str.begin(), []( unsigned char c ){ return static_cast<char>( tolower( c ) ); } );
+    return str;
+  }
+
+  void findImages( const fs::path &dir, const string &prefix, vector<SourceFile> *files )
+  {
+    static const set<string> extensions = { ".png", ".jpg", ".gif", ".tiff", ".tif", ".tga" };
+    for( auto iter = fs::directory_iterator( dir ); iter != fs::directory_iterator(); ++iter )
+    {
+      const fs::path &path = iter->path();
+      const string relative = prefix + path.filename().string();
+      if( fs::is_directory( path ) )
+      {
+        findImages( path, relative + "/", files );
+      }
+      else if( fs::is_regular_file( path ) && extensions.count( lowercase( path.extension().string() ) ) )
+      {
+        SourceFile file;
+        file.path = path;
+        file.relative = relative;
+        files->push_back( file );
+      }
+    }
+  }
+
+  Stamp readStamp( const fs::path &path )
+  {
+    Stamp stamp;
+    if( !fs::exists( path ) )
+    {
+      return stamp;
+    }
+    try
+    {
+      JsonTree tree( loadFile( path ) );
+      stamp.key = fromHex( tree["key"].getValue() );
+      for( const JsonTree &child : tree["files"] )
+      {
+        SourceFile file;
+        file.relative = child["path"].getValue();
+        file.size = strtoull( child["size"].getValue().c_str(), nullptr, 10 );
+        file.time = static_cast<time_t>( strtoll( child["time"].getValue().c_str(), nullptr, 10 ) );
+        file.hash = fromHex( child["hash"].getValue() );
+        stamp.files[file.relative] = file;
+      }
+      for( const JsonTree &child : tree["outputs"] )
+      {
+        stamp.outputs.push_back( child.getValue() );
+      }
+    }
+    catch( std::exception & )
+    { // an unreadable stamp just means a rebuild
+      stamp = Stamp();
+    }
+    return stamp;
+  }
+
+  JsonTree stampJson( uint64_t key, const Options &options, const vector<SourceFile> &files, const vector<string> &outputs )
+  {
+    JsonTree tree;
+    tree.pushBack( JsonTree( "key", toHex( key ) ) );
+    tree.pushBack( JsonTree( "options", options.describe() ) );
+    JsonTree file_array = JsonTree::makeArray( "files" );
+    for( const SourceFile &file : files )
+    {
+      JsonTree entry;
+      entry.pushBack( JsonTree( "path", file.relative ) );
+      entry.pushBack( JsonTree( "size", toString( file.size ) ) );
+      entry.pushBack( JsonTree( "time", toString( static_cast<int64_t>( file.time ) ) ) );
+      entry.pushBack( JsonTree( "hash", toHex( file.hash ) ) );
+      file_array.pushBack( entry );
+    }
+    tree.pushBack( file_array );
+    JsonTree output_array = JsonTree::makeArray( "outputs" );
+    for( const string &output : outputs )
+    {
+      output_array.pushBack( JsonTree( "", output ) );
+    }
+    tree.pushBack( output_array );
+    return tree;
+  }
+
+  Buffer toBuffer( const string &str )
+  {
+    Buffer buffer( str.size() );
+    memcpy( buffer.getData(), str.data(), str.size() );
+    return buffer;
+  }
+
+  //! writes \a data next to \a path and renames it into place, so readers never see a partial file
+  void writeAtomically( const fs::path &path, const Buffer &data )
+  {
+    const fs::path temporary = path.string() + ".tmp";
+    {
+      ofstream file( temporary.string(), ios::binary | ios::trunc );
+      file.write( static_cast<const char*>( data.getData() ), data.getDataSize() );
+      if( !file )
+      {
+        throw runtime_error( "unable to write " + temporary.string() );
+      }
+    }
+    fs::rename( temporary, path );
+  }
+
+  SheetResult buildSheet( const fs::path &sheet_dir, const fs::path &output_dir, const Options &options )
+  {
+    SheetResult result;
+    const string name = sheet_dir.filename().string();
+    const fs::path stamp_path = output_dir / ( name + ".stamp.json" );
+    try
+    {
+      vector<SourceFile> files;
+      findImages( sheet_dir, "", &files );
+      // directory order is unspecified; sort so the hash and the packing are repeatable
+      sort( files.begin(), files.end(), []( const SourceFile &lhs, const SourceFile &rhs ){ return lhs.relative < rhs.relative; } );
+      // ids are file stems, so e.g. a/walk.png and b/walk.png would overwrite each other in the atlas
+      map<string, string> claimed;
+      for( const SourceFile &file : files )
+      {
+        auto claim = claimed.insert( make_pair( file.path.stem().string(), file.relative ) );
+        if( !claim.second )
+        {
+          throw runtime_error( "sprite id \"" + claim.first->first + "\" is used by both " + claim.first->second + " and " + file.relative );
+        }
+      }
+
+      const Stamp previous = readStamp( stamp_path );
+      uint64_t key = hashString( options.describe(), hashBytes( nullptr, 0 ) );
+      for( SourceFile &file : files )
+      {
+        file.size = fs::file_size( file.path );
+        file.time = fs::last_write_time( file.path );
+        auto known = previous.files.find( file.relative );
+        if( known != previous.files.end() && known->second.size == file.size && known->second.time == file.time )
+        {
+          file.hash = known->second.hash;
+        }
+        else
+        {
+          file.hash = hashFile( file.path );
+        }
+        key = hashString( file.relative, key );
+        key = hashBytes( &file.hash, sizeof( file.hash ), key );
+      }
+
+      bool outputs_present = !previous.outputs.empty();
+      for( const string &output : previous.outputs )
+      {
+        outputs_present = outputs_present && fs::exists( output_dir / output );
+      }
+      if( !options.force && previous.key == key && outputs_present )
+      {
+        result.status = eUpToDate;
+        return result;
+      }
+      if( files.empty() )
+      {
+        throw runtime_error( "no images" );
+      }
+
+      const auto start = chrono::steady_clock::now();
+      ImagePacker packer;
+      packer.setMaxPageSize( options.max_page.x, options.max_page.y );
+      packer.setAllowRotation( options.rotate );
+      packer.setOutlineVertices( options.outline );
+      vector<ImagePacker::ImageFile> image_files;
+      for( const SourceFile &file : files )
+      {
+        image_files.push_back( make_pair( file.path.stem().string(), file.path ) );
+      }
+      auto images = packer.addImages( image_files, options.trim );
+      if( images.size() != files.size() )
+      { // the packer has reported which ones; don't stamp a sheet that is missing sprites
+        throw runtime_error( toString( files.size() - images.size() ) + " images failed to load" );
+      }
+      for( auto &image : images )
+      {
+        image->setRegistrationPoint( image->getSize() / 2 );
+      }
+      const Vec2i padding( options.padding, options.padding );
+      if( options.best_ms > 0.0 )
+      {
+        packer.packBest( options.best_ms, padding );
+      }
+      else
+      {
+        packer.calculatePositionsMaxRects( padding, options.width );
+      }
+
+      vector<pair<string, Buffer>> outputs;
+      outputs.push_back( make_pair( name + ".json", toBuffer( packer.surfaceDescription().serialize() ) ) );
+      outputs.push_back( make_pair( name + ".atlas", packer.binaryDescription() ) );
+      for( size_t page = 0; page < packer.getPageCount(); ++page )
+      {
+        const string page_name = page == 0 ? name : name + "-" + toString( page );
+        outputs.push_back( make_pair( page_name + ".png", encodePng( packer.packedSurface( page, false ) ) ) );
+        if( options.format != eRGBA8888 )
+        {
+          outputs.push_back( make_pair( page_name + ".ktx", writeKtx( packer.packedTexture( page, options.format, false ) ) ) );
+        }
+      }
+
+      vector<string> output_names;
+      for( const auto &output : outputs )
+      {
+        writeAtomically( output_dir / output.first, output.second );
+        output_names.push_back( output.first );
+      }
+      for( const string &stale : previous.outputs )
+      { // e.g. pages the sheet no longer needs
+        if( find( output_names.begin(), output_names.end(), stale ) == output_names.end() )
+        {
+          fs::remove( output_dir / stale );
+        }
+      }
+      writeAtomically( stamp_path, toBuffer( stampJson( key, options, files, output_names ).serialize() ) );
+
+      const double ms = chrono::duration<double, milli>( chrono::steady_clock::now() - start ).count();
+      result.status = eBuilt;
+      result.message = toString( images.size() ) + " images, " + toString( packer.getPageCount() ) + " pages, " + toString( static_cast<int>( ms ) ) + " ms";
+    }
+    catch( std::exception &exc )
+    {
+      result.status = eFailed;
+      result.message = exc.what();
+    }
+    return result;
+  }
+
+  bool parseFormat( const string &name, PixelFormat *format )
+  {
+    const vector<string> names = { "rgba8888", "rgba4444", "rgb565", "indexed", "bc1", "bc3" };
+    auto iter = find( names.begin(), names.end(), name );
+    if( iter == names.end() )
+    {
+      return false;
+    }
+    *format = static_cast<PixelFormat>( iter - names.begin() );
+    return true;
+  }
+
+  int usage()
+  {
+    cout << "Usage: AtlasBuilder <input dir> <output dir> [--width px] [--max-page w h] [--padding px] [--best ms]" << endl;
+    cout << "                    [--rotate] [--trim] [--outline n] [--format name] [--force]" << endl;
+    return 2;
+  }
+} // anon::
+
+int main( int argc, char **argv )
+{
+  Options options;
+  vector<string> positional;
+  for( int i = 1; i < argc; ++i )
+  {
+    const bool has_value = i + 1 < argc;
+    if( strcmp( argv[i], "--width" ) == 0 && has_value )
+    {
+      options.width = atoi( argv[++i] );
+    }
+    else if( strcmp( argv[i], "--max-page" ) == 0 && i + 2 < argc )
+    {
+      options.max_page.x = atoi( argv[++i] );
+      options.max_page.y = atoi( argv[++i] );
+    }
+    else if( strcmp( argv[i], "--padding" ) == 0 && has_value )
+    {
+      options.padding = atoi( argv[++i] );
+    }
+    else if( strcmp( argv[i], "--best" ) == 0 && has_value )
+    {
+      options.best_ms = atof( argv[++i] );
+    }
+    else if( strcmp( argv[i], "--outline" ) == 0 && has_value )
+    {
+      options.outline = max( atoi( argv[++i] ), 0 );
+    }
+    else if( strcmp( argv[i], "--format" ) == 0 && has_value )
+    {
+      if( !parseFormat( argv[++i], &options.format ) )
+      {
+        cout << "Unknown format: " << argv[i] << endl;
+        return usage();
+      }
+    }
+    else if( strcmp( argv[i], "--rotate" ) == 0 )
+    {
+      options.rotate = true;
+    }
+    else if( strcmp( argv[i], "--trim" ) == 0 )
+    {
+      options.trim = true;
+    }
+    else if( strcmp( argv[i], "--force" ) == 0 )
+    {
+      options.force = true;
+    }
+    else if( argv[i][0] == '-' )
+    {
+      cout << "Unknown option: " << argv[i] << endl;
+      return usage();
+    }
+    else
+    {
+      positional.push_back( argv[i] );
+    }
+  }
+  if( positional.size() != 2 || !fs::is_directory( positional[0] ) )
+  {
+    return usage();
+  }
+  const fs::path input_dir = positional[0];
+  const fs::path output_dir = positional[1];
+  fs::create_directories( output_dir );
+
+  vector<fs::path> sheets;
+  for( auto iter = fs::directory_iterator( input_dir ); iter != fs::directory_iterator(); ++iter )
+  {
+    if( fs::is_directory( iter->path() ) )
+    {
+      sheets.push_back( iter->path() );
+    }
+  }
+  sort( sheets.begin(), sheets.end() );
+
+  const auto start = chrono::steady_clock::now();
+  vector<SheetResult> results( sheets.size() );
+  mutex log_mutex;
+  ThreadPool::shared().parallelFor( 0, sheets.size(), 1, [&]( size_t begin, size_t end )
+  {
+    for( size_t i = begin; i < end; ++i )
+    {
+      results[i] = buildSheet( sheets[i], output_dir, options );
+      if( results[i].status != eUpToDate )
+      {
+        lock_guard<mutex> lock( log_mutex );
+        cout << sheets[i].filename().string() << ": " << ( results[i].status == eBuilt ? "built, " : "FAILED, " ) << results[i].message << endl;
+      }
+    }
+  } );
+
+  size_t counts[3] = { 0, 0, 0 };
+  for( const SheetResult &result : results )
+  {
+    counts[result.status] += 1;
+  }
+  const double ms = chrono::duration<double, milli>( chrono::steady_clock::now() - start ).count();
+  cout << sheets.size() << " sheets: " << counts[eBuilt] << " built, " << counts[eUpToDate] << " up to date, " << counts[eFailed] << " failed in " << static_cast<int>( ms ) << " ms" << endl;
+  return counts[eFailed] > 0 ? 1 : 0;
+}
@@ -273,8 +273,8 @@ Entity PupTentApp::createPlayer()
   auto anim = mSpriteSystem->createSpriteAnimation( "jellyfish" );
   // ping-pong animation
   //  anim->looping = false;
-  //  anim->finish_fn = []( SpriteAnimationRef animation ){
-  //    animation->rate *= -1.0f;
+  //  anim->finish_fn = [this]( SpriteAnimationRef animation ){
+  //    mSpriteSystem->setRate( animation, -animation->rate );
   //  };
   loc->position = getWindowCenter();
   loc->rotation = r.nextFloat( M_PI * 2 );
@@ -0,0 +1,149 @@
+/**
+ Image Writer Benchmarks:
+
+ Compares ways of writing a packed sprite sheet to disk:
+   ci::writeImage       Cinder's PNG path, used by the samples until now
+   pockets::writePng    PNG deflated in bands of rows across the shared ThreadPool
+   pockets::writeQoi    QOI, for intermediate files
+ on synthetic sheets that look like what ImagePacker produces: soft-edged
+ sprites with gradients and a little noise, hard-edged glyphs, and transparent
+ gaps between them, at 1024, 2048 and 4096 pixels square.
+
+ Each writer runs three times per sheet; the fastest run is reported with the
+ file size. Results are printed as a table and written as CSV (default
+ image-writer-results.csv) so runs can be diffed.
+
+ Usage: ImageWriterBenchmarks [--csv path] [--out directory]
+*/
+
+#include "pockets/ImageWriter.h"
+#include "pockets/ThreadPool.h"
+#include "cinder/ImageIo.h"
+#include "cinder/Utilities.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+
+using namespace std;
+using namespace cinder;
+using namespace pockets;
+
+namespace
+{
+  //! a sheet of sprites in rows, about 70% covered, like a typical packed atlas
+  Surface makeSheet( int side )
+  {
+    Surface sheet( side, side, true, SurfaceChannelOrder::RGBA );
+    memset( sheet.getData(), 0, sheet.getRowBytes() * side );
+    mt19937 rng( 5489u );
+    uniform_int_distribution<int> sprite_side( 16, 160 );
+    uniform_int_distribution<int> noise( -3, 3 );
+    uniform_int_distribution<int> hue( 0, 255 );
+    int x = 0;
+    int y = 0;
+    int row_height = 0;
+    while( y < side )
+    {
+      const int w = sprite_side( rng );
+      const int h = sprite_side( rng );
+      if( x + w > side )
+      {
+        x = 0;
+        y += row_height + 2;
+        row_height = 0;
+        continue;
+      }
+      const bool glyph = rng() % 4 == 0;
+      const int r = hue( rng ), g = hue( rng ), b = hue( rng );
+      for( int sy = 0; sy < h && y + sy < side; ++sy )
+      {
+        uint8_t *out = sheet.getData( Vec2i( x, y + sy ) );
+        for( int sx = 0; sx < w; ++sx, out += 4 )
+        {
+          const float dx = ( sx + 0.5f ) / w * 2.0f - 1.0f;
+          const float dy = ( sy + 0.5f ) / h * 2.0f - 1.0f;
+          const float d = dx * dx + dy * dy;
+          if( glyph )
+          { // hard-edged strokes
+            const bool on = ( sx / 3 + sy / 5 ) % 3 == 0 || abs( sx - sy * w / h ) < 3;
+            out[0] = out[1] = out[2] = out[3] = on ? 255 : 0;
+          }
+          else if( d < 1.0f )
+          { // shaded disc with a soft rim
+            const float shade = 1.0f - d * 0.6f;
+            out[0] = static_cast<uint8_t>( math<int>::clamp( r * shade + noise( rng ), 0, 255 ) );
+            out[1] = static_cast<uint8_t>( math<int>::clamp( g * shade + noise( rng ), 0, 255 ) );
+            out[2] = static_cast<uint8_t>( math<int>::clamp( b * shade + noise( rng ), 0, 255 ) );
+            out[3] = static_cast<uint8_t>( math<float>::min( 1.0f, ( 1.0f - d ) * 8.0f ) * 255 );
+          }
+        }
+      }
+      x += w + 2;
+      row_height = math<int>::max( row_height, h );
+    }
+    return sheet;
+  }
+
+  struct Writer
+  {
+    string                                                  name;
+    string                                                  extension;
+    function<void ( const fs::path &, const Surface & )>    write;
+  };
+} // anon::
+
+int main( int argc, char **argv )
+{
+  string csv_path = "image-writer-results.csv";
+  fs::path out_dir = fs::temp_directory_path();
+  for( int i = 1; i < argc; ++i )
+  {
+    if( strcmp( argv[i], "--csv" ) == 0 && i + 1 < argc )
+    {
+      csv_path = argv[++i];
+    }
+    else if( strcmp( argv[i], "--out" ) == 0 && i + 1 < argc )
+    {
+      out_dir = argv[++i];
+    }
+  }
+
+  const vector<Writer> writers = {
+    { "ci::writeImage (png)", ".png", []( const fs::path &path, const Surface &surface ){ writeImage( path, surface ); } },
+    { "pockets::writePng", ".png", []( const fs::path &path, const Surface &surface ){ writePng( path, surface ); } },
+    { "pockets::writeQoi", ".qoi", []( const fs::path &path, const Surface &surface ){ writeQoi( path, surface ); } }
+  };
+
+  ofstream csv( csv_path );
+  csv << "writer,side,threads,ms,bytes,raw_mb_per_s" << endl;
+  cout << "writer\tside\ttime\tsize\tthroughput (" << ThreadPool::shared().size() << " threads)" << endl;
+  for( int side : { 1024, 2048, 4096 } )
+  {
+    const Surface sheet = makeSheet( side );
+    const double raw_mb = side * side * 4 / ( 1024.0 * 1024.0 );
+    for( const Writer &writer : writers )
+    {
+      const fs::path path = out_dir / ( "pockets-image-writer-" + toString( side ) + writer.extension );
+      double best_ms = numeric_limits<double>::max();
+      for( int run = 0; run < 3; ++run )
+      {
+        auto begin = chrono::steady_clock::now();
+        writer.write( path, sheet );
+        best_ms = math<double>::min( best_ms, chrono::duration<double, milli>( chrono::steady_clock::now() - begin ).count() );
+      }
+      const uintmax_t bytes = fs::file_size( path );
+      cout << writer.name << "\t" << side << "\t" << best_ms << " ms\t" << bytes / 1024 << " KiB\t"
+           << raw_mb / ( best_ms / 1000.0 ) << " MB/s" << endl;
+      csv << "\"" << writer.name << "\"," << side << "," << ThreadPool::shared().size() << ","
+          << best_ms << "," << bytes << "," << raw_mb / ( best_ms / 1000.0 ) << endl;
+      fs::remove( path );
+    }
+  }
+  cout << "Results written to " << csv_path << endl;
+  return 0;
+}
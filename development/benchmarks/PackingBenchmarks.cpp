@@ -0,0 +1,330 @@
+/**
+ Packing Benchmarks:
+
+ Runs every packing engine in pockets over synthetic rectangle sets that
+ mimic what we actually pack:
+   uniform      sides spread evenly between 4 and 64px
+   power-law    mostly small rects with a long tail of big ones (UI art, photos)
+   glyph        narrow rects of nearly equal height (font atlases)
+   near-square  similar-sized, roughly square tiles (thumbnails, animation frames)
+ at 100, 1k, 10k and 100k rects.
+
+ For each run it reports wall time, occupancy (rect area / sheet area) and peak
+ heap use while packing, which is tracked by replacing global operator new.
+ Results are printed as a table and written as CSV (default packing-results.csv)
+ so runs can be diffed to catch regressions.
+
+ The scanline engines grow roughly with n^2 * height and MaxRects with n * free
+ rects, so by default they stop at 1k and 10k rects respectively.
+ Pass --full to run everything at every size (expect to wait).
+
+ Usage: PackingBenchmarks [--full] [--csv path]
+*/
+
+#include "pockets/Packing.h"
+#include "pockets/ImagePacker.h"
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <new>
+#include <random>
+
+using namespace std;
+using namespace cinder;
+using namespace pockets;
+
+namespace
+{
+  // heap accounting; each block carries its size in a header ahead of the user pointer
+  const size_t      cHeaderSize = 16;
+  atomic<size_t>    sCurrentBytes( 0 );
+  atomic<size_t>    sPeakBytes( 0 );
+
+  void* trackedAlloc( size_t size )
+  {
+    void *block = malloc( size + cHeaderSize );
+    if( !block )
+    {
+      throw bad_alloc();
+    }
+    *static_cast<size_t*>( block ) = size;
+    size_t current = sCurrentBytes += size;
+    size_t peak = sPeakBytes;
+    while( current > peak && !sPeakBytes.compare_exchange_weak( peak, current ) )
+    {}
+    return static_cast<char*>( block ) + cHeaderSize;
+  }
+
+  void trackedFree( void *ptr )
+  {
+    if( ptr )
+    {
+      void *block = static_cast<char*>( ptr ) - cHeaderSize;
+      sCurrentBytes -= *static_cast<size_t*>( block );
+      free( block );
+    }
+  }
+} // anon::
+
+void* operator new( size_t size ) { return trackedAlloc( size ); }
+void* operator new[]( size_t size ) { return trackedAlloc( size ); }
+void operator delete( void *ptr ) noexcept { trackedFree( ptr ); }
+void operator delete[]( void *ptr ) noexcept { trackedFree( ptr ); }
+
+namespace
+{
+  const int cSheetWidth = 1024;
+  const int cMaxSide = 512;
+
+  struct Distribution
+  {
+    string                                name;
+    function<Vec2i ( mt19937 &rng )>      sample;
+  };
+
+  vector<Distribution> distributions()
+  {
+    return {
+      { "uniform", []( mt19937 &rng )
+        {
+          uniform_int_distribution<int> side( 4, 64 );
+          return Vec2i( side( rng ), side( rng ) );
+        } },
+      { "power-law", []( mt19937 &rng )
+        { // pareto with alpha 1.5, so half the rects are under 6px and a few hit the clamp
+          uniform_real_distribution<float> u( 0.0f, 1.0f );
+          auto side = [&](){ return math<int>::min( cMaxSide, static_cast<int>( 4.0f / pow( 1.0f - u( rng ), 1.0f / 1.5f ) ) ); };
+          return Vec2i( side(), side() );
+        } },
+      { "glyph", []( mt19937 &rng )
+        {
+          uniform_int_distribution<int> width( 6, 30 );
+          uniform_int_distribution<int> height( 26, 32 );
+          return Vec2i( width( rng ), height( rng ) );
+        } },
+      { "near-square", []( mt19937 &rng )
+        {
+          uniform_int_distribution<int> side( 48, 96 );
+          uniform_real_distribution<float> skew( 0.9f, 1.1f );
+          int s = side( rng );
+          return Vec2i( s, static_cast<int>( s * skew( rng ) ) );
+        } }
+    };
+  }
+
+  struct Result
+  {
+    double    ms = 0.0;
+    double    occupancy = 0.0;
+    size_t    peak_bytes = 0;
+    Vec2i     sheet = Vec2i::zero();
+  };
+
+  struct Engine
+  {
+    string                                                          name;
+    size_t                                                          default_limit;  // largest set run without --full
+    bool                                                            needs_images;   // gets an ImagePacker filled with the set
+    function<Vec2i ( const vector<Vec2i> &sizes, ImagePacker &images )> pack;       // returns total sheet size
+  };
+
+  //! ImagePacker wants surfaces; borrow windows of one shared buffer of noise so the sets cost no pixel memory
+  //! every image starts at a different offset, so none of them look like duplicates
+  void addSurfaces( ImagePacker *packer, const vector<Vec2i> &sizes )
+  {
+    const int stride = cMaxSide * 2;
+    static vector<uint8_t> pixels;
+    if( pixels.empty() )
+    {
+      mt19937 rng( 1u );
+      pixels.resize( stride * stride * 4 );
+      for( uint8_t &p : pixels )
+      {
+        p = rng();
+      }
+    }
+    for( size_t i = 0; i < sizes.size(); ++i )
+    {
+      uint8_t *origin = &pixels[( ( i / cMaxSide ) % cMaxSide * stride + i % cMaxSide ) * 4];
+      Surface surface( origin, sizes[i].x, sizes[i].y, stride * 4, SurfaceChannelOrder::RGBA );
+      packer->addImage( toString( i ), surface );
+    }
+  }
+
+  Vec2i imagePackerSheet( const ImagePacker &packer )
+  { // stack the pages, so area is right for multi-page output
+    Vec2i sheet = Vec2i::zero();
+    for( size_t page = 0; page < packer.getPageCount(); ++page )
+    {
+      sheet.x = math<int>::max( sheet.x, packer.getPageSize( page ).x );
+      sheet.y += packer.getPageSize( page ).y;
+    }
+    return sheet;
+  }
+
+  Vec2i scanlineSheet( const vector<Vec2i> &sizes, ScanlinePacker::Mode mode )
+  {
+    ScanlinePacker packer( cSheetWidth, ScanlinePacker::eUnconstrained, mode );
+    packer.setPadding( 1.0f );
+    for( const Vec2i &size : sizes )
+    {
+      packer.pushRect( Rectf( 0, 0, size.x, size.y ) );
+    }
+    return Vec2i( cSheetWidth, packer.getExtent() );
+  }
+
+  vector<Engine> engines()
+  {
+    return {
+      { "ScanlinePacker::pushRect (skyline)", numeric_limits<size_t>::max(), false, []( const vector<Vec2i> &sizes, ImagePacker & )
+        {
+          return scanlineSheet( sizes, ScanlinePacker::eSkyline );
+        } },
+      { "ScanlinePacker::pushRect (scanline)", 1000, false, []( const vector<Vec2i> &sizes, ImagePacker & )
+        {
+          return scanlineSheet( sizes, ScanlinePacker::eScanline );
+        } },
+      { "placeRects", numeric_limits<size_t>::max(), false, []( const vector<Vec2i> &sizes, ImagePacker & )
+        {
+          vector<Rectf> rects;
+          for( const Vec2i &size : sizes )
+          {
+            rects.push_back( Rectf( 0, 0, size.x, size.y ) );
+          }
+          float bottom = 0.0f;
+          for( const Rectf &placed : placeRects( rects, cSheetWidth ) )
+          {
+            bottom = math<float>::max( bottom, placed.getY2() );
+          }
+          return Vec2i( cSheetWidth, bottom );
+        } },
+      { "MaxRectsPacker::insert", 10000, false, []( const vector<Vec2i> &sizes, ImagePacker & )
+        { // grow the bin the way ImagePacker does until everything fits
+          int64_t area = 0;
+          for( const Vec2i &size : sizes )
+          {
+            area += static_cast<int64_t>( size.x + 1 ) * ( size.y + 1 );
+          }
+          int height = math<int>::max( cMaxSide, static_cast<int>( area / cSheetWidth ) );
+          while( true )
+          {
+            MaxRectsPacker packer( cSheetWidth, height );
+            Area placed;
+            bool fits = true;
+            for( const Vec2i &size : sizes )
+            {
+              if( !packer.insert( size + Vec2i( 1, 1 ), MaxRectsPacker::eBestShortSideFit, &placed ) )
+              {
+                fits = false;
+                break;
+              }
+            }
+            if( fits )
+            {
+              return Vec2i( cSheetWidth, packer.getUsedHeight() );
+            }
+            height += height / 32 + 1;
+          }
+        } },
+      { "ImagePacker::calculatePositions", numeric_limits<size_t>::max(), true, []( const vector<Vec2i> &, ImagePacker &packer )
+        {
+          packer.calculatePositions( Vec2i( 1, 1 ), cSheetWidth );
+          return imagePackerSheet( packer );
+        } },
+      { "ImagePacker::calculatePositionsScanline", 1000, true, []( const vector<Vec2i> &, ImagePacker &packer )
+        {
+          packer.calculatePositionsScanline( Vec2i( 1, 1 ), cSheetWidth );
+          return imagePackerSheet( packer );
+        } },
+      { "ImagePacker::calculatePositionsMaxRects", 10000, true, []( const vector<Vec2i> &, ImagePacker &packer )
+        {
+          packer.calculatePositionsMaxRects( Vec2i( 1, 1 ), cSheetWidth );
+          return imagePackerSheet( packer );
+        } },
+      { "ImagePacker::packBest (250ms)", 10000, true, []( const vector<Vec2i> &, ImagePacker &packer )
+        {
+          packer.packBest( 250.0 );
+          return imagePackerSheet( packer );
+        } }
+    };
+  }
+
+  Result run( const Engine &engine, const vector<Vec2i> &sizes )
+  {
+    int64_t rect_area = 0;
+    for( const Vec2i &size : sizes )
+    {
+      rect_area += static_cast<int64_t>( size.x ) * size.y;
+    }
+    // adding images hashes every pixel, which isn't packing, so do it before measuring
+    ImagePacker images;
+    if( engine.needs_images )
+    {
+      addSurfaces( &images, sizes );
+    }
+    const size_t baseline = sCurrentBytes;
+    sPeakBytes = baseline;
+    auto begin = chrono::steady_clock::now();
+    Vec2i sheet = engine.pack( sizes, images );
+    Result result;
+    result.ms = chrono::duration<double, milli>( chrono::steady_clock::now() - begin ).count();
+    result.peak_bytes = sPeakBytes - baseline;
+    result.sheet = sheet;
+    result.occupancy = sheet.x * sheet.y > 0 ? static_cast<double>( rect_area ) / ( static_cast<double>( sheet.x ) * sheet.y ) : 0.0;
+    return result;
+  }
+} // anon::
+
+int main( int argc, char **argv )
+{
+  bool full = false;
+  string csv_path = "packing-results.csv";
+  for( int i = 1; i < argc; ++i )
+  {
+    if( strcmp( argv[i], "--full" ) == 0 )
+    {
+      full = true;
+    }
+    else if( strcmp( argv[i], "--csv" ) == 0 && i + 1 < argc )
+    {
+      csv_path = argv[++i];
+    }
+  }
+
+  ofstream csv( csv_path );
+  csv << "engine,distribution,rects,ms,occupancy,peak_bytes,sheet_width,sheet_height" << endl;
+  cout << "engine\tdistribution\trects\ttime\toccupancy\tpeak memory\tsheet" << endl;
+  for( const Distribution &distribution : distributions() )
+  {
+    for( size_t count : { 100, 1000, 10000, 100000 } )
+    {
+      mt19937 rng( 5489u );
+      vector<Vec2i> sizes;
+      sizes.reserve( count );
+      for( size_t i = 0; i < count; ++i )
+      {
+        sizes.push_back( distribution.sample( rng ) );
+      }
+      for( const Engine &engine : engines() )
+      {
+        if( count > engine.default_limit && !full )
+        {
+          continue;
+        }
+        Result result = run( engine, sizes );
+        cout << engine.name << "\t" << distribution.name << "\t" << count << "\t"
+             << result.ms << " ms\t" << result.occupancy * 100.0 << "%\t"
+             << result.peak_bytes / 1024 << " KiB\t" << result.sheet.x << "x" << result.sheet.y << endl;
+        csv << "\"" << engine.name << "\"," << distribution.name << "," << count << ","
+            << result.ms << "," << result.occupancy << "," << result.peak_bytes << ","
+            << result.sheet.x << "," << result.sheet.y << endl;
+      }
+    }
+  }
+  cout << "Results written to " << csv_path << endl;
+  return 0;
+}
@@ -0,0 +1,200 @@
+/**
+ Sprite Animation Benchmarks:
+
+ Times SpriteAnimationSystem::update on 100,000 animated sprites, the scale
+ the system is meant to handle in well under a millisecond per tick. Each
+ sprite has a quad RenderMesh and plays one of eight animations (6 to 12
+ frames at 12 fps, with uneven holds) at its own rate and starting point.
+ Cases:
+   tiny dt        0.1 ms; playback steps but no sprite changes frame
+   small dt       1/60 s; most sprites stay on their frame
+   frame dt       1/12 s; nearly every sprite changes frame and rewrites its mesh
+   large dt       2.5 s; every sprite wraps and lands several frames on
+   clocked        frame dt, with the sprites spread across 16 shared clocks
+ Timings include writing the new frame into each changed mesh. "meshes" is
+ how many meshes were rewritten per tick; tiny dt gives the cost of stepping
+ playback alone, and the other cases add write-back, which touches each
+ changed sprite's component, mesh and vertices and so is bound by memory
+ traffic rather than arithmetic.
+
+ Each case is warmed up for a few ticks, then timed over 100; the fastest
+ and mean tick are reported in milliseconds. Results are printed as a table
+ and written as CSV (default sprite-animation-results.csv) so runs can be
+ diffed.
+
+ Usage: SpriteAnimationBenchmarks [--csv path] [--sprites count]
+*/
+
+#include "pockets/puptent/SpriteSystem.h"
+#include "cinder/Json.h"
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <iostream>
+#include <limits>
+#include <random>
+
+using namespace std;
+using namespace cinder;
+using namespace pockets;
+using namespace puptent;
+
+namespace
+{
+  const int animation_count = 8;
+  const int clock_count = 16;
+  const int warmup_ticks = 5;
+  const int timed_ticks = 100;
+
+  //! animations of 6 to 12 frames spread over a 1024px sheet, held one to three frames each
+  void addAnimations( SpriteAnimationSystem &system )
+  {
+    mt19937 rng( 5489u );
+    uniform_int_distribution<int> hold( 1, 3 );
+    for( int a = 0; a < animation_count; ++a )
+    {
+      SpriteAnimationSystem::Animation animation;
+      animation.name = "animation-" + to_string( a );
+      animation.frame_duration = 1.0f / 12.0f;
+      const int frames = 6 + a % 7;
+      for( int f = 0; f < frames; ++f )
+      {
+        const Vec2f ul( f * 64.0f, a * 64.0f );
+        const SpriteData drawing( Rectf( ul / 1024.0f, ( ul + Vec2f( 64.0f, 64.0f ) ) / 1024.0f ), Vec2i( 64, 64 ), Vec2f( 32.0f, 32.0f ) );
+        animation.drawings.emplace_back( drawing, static_cast<float>( hold( rng ) ) );
+      }
+      system.addAnimation( animation.name, animation );
+    }
+  }
+
+  struct Scene
+  {
+    EventManagerRef                 events;
+    EntityManagerRef                entities;
+    SpriteAnimationSystemRef        system;
+    vector<RenderMeshRef>           meshes;
+  };
+
+  //! \a count sprites with quad meshes, each on its own playback or, if \a clocked, on a shared clock
+  Scene makeScene( size_t count, bool clocked )
+  {
+    Scene scene;
+    scene.events = EventManager::make();
+    scene.entities = EntityManager::make( scene.events );
+    // no atlas; the animations are added directly
+    scene.system = SpriteAnimationSystem::create( nullptr, JsonTree() );
+    scene.system->configure( scene.events );
+    addAnimations( *scene.system );
+
+    vector<ClockId> clocks;
+    for( int c = 0; clocked && c < clock_count; ++c )
+    {
+      clocks.push_back( scene.system->createClock( c % animation_count, 0.75f + 0.5f * c / clock_count ) );
+    }
+    mt19937 rng( 1234u );
+    uniform_int_distribution<int> pick( 0, 1023 );
+    uniform_real_distribution<float> rate( 0.5f, 1.5f );
+    uniform_real_distribution<float> hold( 0.0f, 0.08f );
+    scene.meshes.reserve( count );
+    for( size_t i = 0; i < count; ++i )
+    {
+      Entity entity = scene.entities->create();
+      scene.meshes.push_back( entity.assign<RenderMesh>( 4 ) );
+      SpriteAnimationRef sprite;
+      if( clocked )
+      {
+        sprite = scene.system->createClockedAnimation( clocks[pick( rng ) % clock_count] );
+      }
+      else
+      {
+        sprite = scene.system->createSpriteAnimation( pick( rng ) % animation_count );
+        sprite->rate = rate( rng );
+        sprite->current_index = pick( rng ) % 6;
+        sprite->hold = hold( rng );
+      }
+      entity.assign( sprite );
+    }
+    return scene;
+  }
+
+  struct Result
+  {
+    double  best_ms = numeric_limits<double>::max();
+    double  mean_ms = 0.0;
+    double  meshes = 0.0;   // meshes rewritten per tick
+  };
+
+  Result benchmark( size_t count, double dt, bool clocked )
+  {
+    Scene scene = makeScene( count, clocked );
+    for( int tick = 0; tick < warmup_ticks; ++tick )
+    {
+      scene.system->update( scene.entities, scene.events, dt );
+    }
+    vector<uint32_t> versions( scene.meshes.size() );
+    Result result;
+    size_t written = 0;
+    for( int tick = 0; tick < timed_ticks; ++tick )
+    {
+      for( size_t i = 0; i < versions.size(); ++i )
+      {
+        versions[i] = scene.meshes[i]->version;
+      }
+      auto begin = chrono::steady_clock::now();
+      scene.system->update( scene.entities, scene.events, dt );
+      const double ms = chrono::duration<double, milli>( chrono::steady_clock::now() - begin ).count();
+      result.best_ms = math<double>::min( result.best_ms, ms );
+      result.mean_ms += ms / timed_ticks;
+      for( size_t i = 0; i < versions.size(); ++i )
+      {
+        written += scene.meshes[i]->version != versions[i];
+      }
+    }
+    result.meshes = static_cast<double>( written ) / timed_ticks;
+    return result;
+  }
+} // anon::
+
+int main( int argc, char **argv )
+{
+  string csv_path = "sprite-animation-results.csv";
+  size_t count = 100000;
+  for( int i = 1; i < argc; ++i )
+  {
+    if( strcmp( argv[i], "--csv" ) == 0 && i + 1 < argc )
+    {
+      csv_path = argv[++i];
+    }
+    else if( strcmp( argv[i], "--sprites" ) == 0 && i + 1 < argc )
+    {
+      count = strtoul( argv[++i], nullptr, 10 );
+    }
+  }
+
+  struct Case
+  {
+    string  name;
+    double  dt;
+    bool    clocked;
+  };
+  const vector<Case> cases = {
+    { "tiny dt", 1.0e-4, false },
+    { "small dt", 1.0 / 60.0, false },
+    { "frame dt", 1.0 / 12.0, false },
+    { "large dt", 2.5, false },
+    { "clocked", 1.0 / 12.0, true }
+  };
+
+  ofstream csv( csv_path );
+  csv << "case,sprites,dt,best_ms,mean_ms,meshes" << endl;
+  cout << "case\tsprites\tdt\tbest ms\tmean ms\tmeshes/tick" << endl;
+  for( const Case &c : cases )
+  {
+    const Result result = benchmark( count, c.dt, c.clocked );
+    cout << c.name << "\t" << count << "\t" << c.dt << "\t" << result.best_ms << "\t" << result.mean_ms << "\t" << result.meshes << endl;
+    csv << "\"" << c.name << "\"," << count << "," << c.dt << "," << result.best_ms << "," << result.mean_ms << "," << result.meshes << endl;
+  }
+  cout << "Results written to " << csv_path << endl;
+  return 0;
+}
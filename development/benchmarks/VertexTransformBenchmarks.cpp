@@ -0,0 +1,181 @@
+/**
+ Vertex Transform Benchmarks:
+
+ Compares the per-vertex loop the renderers used to run:
+   scalar               Vertex{ mat.transformPoint( v.position ), v.color, v.tex_coord }
+ with pockets::VertexTransform, which transforms positions with SIMD and
+ copies the rest of each vertex, for both vertex layouts in use:
+   puptent::Vertex      position, ColorA, tex_coord (32 bytes)
+   treent::Vertex2D     position, ColorA8u, tex_coord (20 bytes)
+
+ The path column says which loop VertexTransform took. Spans shorter than
+ VertexTransform::vector_span, and layouts that opt out through
+ VectorizeTransform, use plain arithmetic ("scalar"), so their rows measure
+ that loop rather than SIMD. treent::Vertex2D opts out; the
+ "Vertex2D layout" rows run the same 20-byte layout through the SIMD loop
+ anyway, to show whether opting back in would pay off.
+
+ 65536 vertices (a few megabytes, so mostly in cache, as a chunk handed to
+ one thread is) are transformed in spans of 4 (sprite quads), 16 and 64
+ (generative meshes) and 4096 (ribbons, big shapes), with a different
+ matrix for each span as the renderers use one per mesh. Each case runs
+ twenty times; the fastest is reported in millions of vertices per second
+ along with the kernel's speedup over the scalar loop. Results are printed
+ as a table and written as CSV (default vertex-transform-results.csv) so
+ runs can be diffed.
+
+ The instruction set follows the compiler flags; try
+ SIMD_FLAGS="-mavx2 -mfma" to measure the AVX2 path.
+
+ Usage: VertexTransformBenchmarks [--csv path]
+*/
+
+#include "pockets/VertexTransform.h"
+#include "pockets/puptent/RenderMeshComponent.h"
+#include "treent/ShapeComponent.h"
+#include <chrono>
+#include <cstring>
+#include <fstream>
+#include <functional>
+#include <iostream>
+#include <limits>
+#include <random>
+
+using namespace std;
+using namespace cinder;
+using namespace pockets;
+
+namespace
+{
+  const size_t vertex_count = 1 << 16;
+
+  //! treent::Vertex2D's layout without its opt-out, so the SIMD loop can be measured on it
+  struct Vertex2DLayout
+  {
+    Vec2f     position;
+    ColorA8u  color;
+    Vec2f     tex_coord;
+  };
+
+  //! a spread of rotations, scales and offsets, one per span
+  vector<MatrixAffine2f> makeMatrices( size_t count )
+  {
+    mt19937 rng( 5489u );
+    uniform_real_distribution<float> unit( -1.0f, 1.0f );
+    vector<MatrixAffine2f> matrices;
+    matrices.reserve( count );
+    for( size_t i = 0; i < count; ++i )
+    {
+      MatrixAffine2f mat;
+      mat.translate( Vec2f( unit( rng ), unit( rng ) ) * 500.0f );
+      mat.rotate( unit( rng ) * 3.14159f );
+      mat.scale( Vec2f( 1.5f, 1.5f ) + Vec2f( unit( rng ), unit( rng ) ) );
+      matrices.push_back( mat );
+    }
+    return matrices;
+  }
+
+  template<typename Vert>
+  vector<Vert> makeVertices()
+  {
+    mt19937 rng( 1234u );
+    uniform_real_distribution<float> unit( -1.0f, 1.0f );
+    vector<Vert> vertices( vertex_count );
+    for( Vert &v : vertices )
+    {
+      v.position = Vec2f( unit( rng ), unit( rng ) ) * 64.0f;
+      v.tex_coord = Vec2f( unit( rng ), unit( rng ) );
+    }
+    return vertices;
+  }
+
+  //! fastest of twenty runs of \a fn, in milliseconds
+  double bestOf( const function<void ()> &fn )
+  {
+    double best_ms = numeric_limits<double>::max();
+    for( int run = 0; run < 20; ++run )
+    {
+      auto begin = chrono::steady_clock::now();
+      fn();
+      best_ms = math<double>::min( best_ms, chrono::duration<double, milli>( chrono::steady_clock::now() - begin ).count() );
+    }
+    return best_ms;
+  }
+
+  //! keeps the compiler from discarding results nobody reads
+  template<typename Vert>
+  float checksum( const vector<Vert> &vertices )
+  {
+    float sum = 0.0f;
+    for( size_t i = 0; i < vertices.size(); i += 97 )
+    {
+      sum += vertices[i].position.x + vertices[i].position.y;
+    }
+    return sum;
+  }
+
+  template<typename Vert>
+  void benchmark( const string &name, ofstream &csv )
+  {
+    const vector<Vert> input = makeVertices<Vert>();
+    vector<Vert> output( input.size() );
+    for( size_t span : { 4, 16, 64, 4096 } )
+    {
+      const vector<MatrixAffine2f> matrices = makeMatrices( input.size() / span );
+      const double scalar_ms = bestOf( [&]
+      {
+        const Vert *in = input.data();
+        Vert *out = output.data();
+        for( const MatrixAffine2f &mat : matrices )
+        {
+          for( size_t i = 0; i < span; ++i, ++in )
+          {
+            *out++ = Vert{ mat.transformPoint( in->position ), in->color, in->tex_coord };
+          }
+        }
+      } );
+      const float expected = checksum( output );
+      const double kernel_ms = bestOf( [&]
+      {
+        const Vert *in = input.data();
+        Vert *out = output.data();
+        for( const MatrixAffine2f &mat : matrices )
+        {
+          out = VertexTransform( mat ).apply( in, span, out );
+          in += span;
+        }
+      } );
+      if( math<float>::abs( checksum( output ) - expected ) > math<float>::abs( expected ) * 1.0e-4f + 1.0f )
+      {
+        cout << "ERROR: " << name << " results differ for spans of " << span << endl;
+      }
+      const double mverts = input.size() / 1.0e6;
+      const string path = VertexTransform::vectorizes<Vert>( span ) ? VertexTransform::getInstructionSet() : "scalar";
+      cout << name << "\t" << span << "\t" << path << "\t" << mverts / ( scalar_ms / 1000.0 ) << "\t"
+           << mverts / ( kernel_ms / 1000.0 ) << "\t" << scalar_ms / kernel_ms << "x" << endl;
+      csv << "\"" << name << "\"," << span << "," << path << ","
+          << scalar_ms << "," << kernel_ms << "," << scalar_ms / kernel_ms << endl;
+    }
+  }
+} // anon::
+
+int main( int argc, char **argv )
+{
+  string csv_path = "vertex-transform-results.csv";
+  for( int i = 1; i < argc; ++i )
+  {
+    if( strcmp( argv[i], "--csv" ) == 0 && i + 1 < argc )
+    {
+      csv_path = argv[++i];
+    }
+  }
+
+  ofstream csv( csv_path );
+  csv << "vertex,span,path,scalar_ms,kernel_ms,speedup" << endl;
+  cout << "vertex\tspan\tpath\tscalar Mv/s\tkernel Mv/s\tspeedup" << endl;
+  benchmark<puptent::Vertex>( "puptent::Vertex", csv );
+  benchmark<treent::Vertex2D>( "treent::Vertex2D", csv );
+  benchmark<Vertex2DLayout>( "Vertex2D layout", csv );
+  cout << "Results written to " << csv_path << endl;
+  return 0;
+}
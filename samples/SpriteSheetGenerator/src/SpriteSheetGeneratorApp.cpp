@@ -34,6 +34,7 @@
 #include "cinder/params/Params.h"
 
 #include "ImagePacker.h"
+#include "ImageWriter.h"
 #include <set>
 
 using namespace ci;
@@ -56,7 +57,7 @@ class SpriteSheetGeneratorApp : public AppNative {
 	void setup();
 	void draw();
   void fileDrop( FileDropEvent event );
-  void addFile( const fs::path &file );
+  void addFile( const fs::path &file, vector<pk::ImagePacker::ImageFile> *files );
   void saveSpriteSheet( const string &filename );
 private:
   params::InterfaceGl mParams;
@@ -67,6 +68,11 @@ private:
   pk::ImagePacker     mImagePacker;
   int                 mWidestImage = 0;
   ci::Vec2i           mMargin = { 20, 20 };
+  bool                mAllowRotation = false;
+  //! outline vertex budget for tight sprite meshes; zero packs plain quads
+  int                 mOutlineVertices = 0;
+  //! a pk::PixelFormat; anything but RGBA8888 also writes KTX pages
+  int                 mPixelFormat = pk::eRGBA8888;
 };
 
 void SpriteSheetGeneratorApp::prepareSettings(Settings *settings)
@@ -79,41 +85,57 @@ void SpriteSheetGeneratorApp::setup()
   mParams = params::InterfaceGl( "SpriteSheet Generator", Vec2i( 200, 200 ) );
   mParams.setOptions( "", "position='10 20'" );
   mParams.addButton( "Reset packer", [this](){ mImagePacker.clear(); } );
+  mParams.addParam( "Allow rotation", &mAllowRotation );
+  mParams.addParam( "Outline vertices", &mOutlineVertices, "min=0 max=16" );
+  mParams.addParam( "Pixel format", vector<string>{ "RGBA8888", "RGBA4444", "RGB565", "Indexed", "BC1", "BC3" }, &mPixelFormat );
 }
 
 void SpriteSheetGeneratorApp::fileDrop(cinder::app::FileDropEvent event)
 {
+  vector<pk::ImagePacker::ImageFile> files;
   for( fs::path file : event.getFiles() )
   {
-    addFile( file );
+    addFile( file, &files );
   }
+  // decode everything at once on the packer's worker threads
+  for( auto sprite : mImagePacker.addImages( files ) )
+  {
+    mWidestImage = max( sprite->getWidth(), mWidestImage );
+    sprite->setRegistrationPoint( sprite->getSize() / 2 );
+  }
+  cout << "Duplicates: " << mImagePacker.getDuplicateCount() << " images, ";
+  cout << mImagePacker.getDeduplicatedBytes() << " bytes, " << mImagePacker.getDeduplicatedArea() << " pixels of sheet area saved" << endl;
 //  const int w = mWidestImage * 3 + mMargin.x * 2;
+  mImagePacker.setAllowRotation( mAllowRotation );
+  mImagePacker.setOutlineVertices( mOutlineVertices );
   mImagePacker.calculatePositions( { 1, 1 }, 1024 );
   saveSpriteSheet( "spritesheet-basic-pack" );
   mImagePacker.calculatePositionsScanline( { 1, 1 }, 1024 );
   saveSpriteSheet( "spritesheet-scanline-pack" );
+  mImagePacker.calculatePositionsMaxRects( { 1, 1 }, 1024 );
+  saveSpriteSheet( "spritesheet-maxrects-pack" );
+  auto best = mImagePacker.packBest( 500.0 );
+  cout << "Best packing: " << best.config.getDescription() << ", " << best.occupancy * 100 << "% occupied" << endl;
+  saveSpriteSheet( "spritesheet-best-pack" );
 }
 
-void SpriteSheetGeneratorApp::addFile(const fs::path &file)
+void SpriteSheetGeneratorApp::addFile( const fs::path &file, vector<pk::ImagePacker::ImageFile> *files )
 {
   set<string> extensions = { ".png", ".jpg", ".gif", ".tiff", ".tif", ".tga" };
   if( fs::exists( file ) )
   {
     if( fs::is_regular_file( file ) && extensions.count(file.extension().string()) )
     {
-      Surface img = loadImage( file );
       string id = file.stem().string();
       cout << "File: " << file << endl;
       cout << "=> Id: " << id << endl;
-      mWidestImage = max( img.getWidth(), mWidestImage );
-      auto sprite = mImagePacker.addImage( id, img );
-      sprite->setRegistrationPoint( sprite->getSize() / 2 );
+      files->push_back( make_pair( id, file ) );
     }
     else if( fs::is_directory( file ) )
     {
       for( auto iter = fs::directory_iterator( file ); iter != fs::directory_iterator(); ++iter )
       {
-        addFile( *iter );
+        addFile( *iter, files );
       }
     }
   }
@@ -131,7 +153,28 @@ void SpriteSheetGeneratorApp::saveSpriteSheet( const string &filename )
   if( file )
   {
     mImagePacker.surfaceDescription().write( file );
-    writeImage( output_path / (filename + ".png"), mImagePacker.packedSurface() );
+    Buffer binary = mImagePacker.binaryDescription();
+    writeFile( output_path / (filename + ".atlas") )->getStream()->writeData( binary.getData(), binary.getDataSize() );
+    pk::writePng( output_path / (filename + ".png"), mImagePacker.packedSurface() );
+    for( size_t page = 1; page < mImagePacker.getPageCount(); ++page )
+    { // additional pages are numbered by their page id
+      pk::writePng( output_path / (filename + "-" + toString( page ) + ".png"), mImagePacker.packedSurface( page, false ) );
+    }
+    if( mPixelFormat != pk::eRGBA8888 )
+    { // reduced-footprint pages, named like the pngs, with a quality report for each sprite
+      vector<pk::ImagePacker::SpriteQuality> report;
+      for( size_t page = 0; page < mImagePacker.getPageCount(); ++page )
+      {
+        Buffer ktx = pk::writeKtx( mImagePacker.packedTexture( page, static_cast<pk::PixelFormat>( mPixelFormat ), false, &report ) );
+        const string name = page == 0 ? filename : filename + "-" + toString( page );
+        writeFile( output_path / (name + ".ktx") )->getStream()->writeData( ktx.getData(), ktx.getDataSize() );
+      }
+      sort( report.begin(), report.end(), []( const pk::ImagePacker::SpriteQuality &lhs, const pk::ImagePacker::SpriteQuality &rhs ){ return lhs.psnr < rhs.psnr; } );
+      for( const auto &sprite : report )
+      {
+        cout << sprite.id << ": " << sprite.psnr << " dB" << endl;
+      }
+    }
   }
 }
 
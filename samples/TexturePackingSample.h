@@ -36,6 +36,7 @@
 #include "cinder/params/Params.h"
 
 #include "ImagePacker.h"
+#include "ImageWriter.h"
 #include <set>
 
 /**
@@ -55,7 +56,7 @@ class TexturePackingSample : public pk::Scene
   void connect( ci::app::WindowRef window ) override;
 	void draw() override;
   void fileDrop( ci::app::FileDropEvent event );
-  void addFile( const ci::fs::path &file );
+  void addFile( const ci::fs::path &file, std::vector<pk::ImagePacker::ImageFile> *files );
   void saveSpriteSheet( const std::string &filename );
 private:
   ci::params::InterfaceGlRef mParams;
@@ -66,4 +67,9 @@ private:
   pk::ImagePacker         mImagePacker;
   int                     mWidestImage = 0;
   ci::Vec2i               mMargin = { 20, 20 };
+  bool                    mAllowRotation = false;
+  //! outline vertex budget for tight sprite meshes; zero packs plain quads
+  int                     mOutlineVertices = 0;
+  //! a pk::PixelFormat; anything but RGBA8888 also writes KTX pages
+  int                     mPixelFormat = pk::eRGBA8888;
 };
@@ -0,0 +1,121 @@
+/*
+ * Copyright (c) 2013 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+#include <cstdint>
+#include <cstddef>
+#include <utility>
+
+namespace pockets
+{
+  /**
+   Binary atlas description, written by ImagePacker::binaryDescription and
+   read by TextureAtlas, which maps the file and copies each record into its
+   sprite table.
+
+   Layout, every field a little-endian 32-bit value (see toFileOrder):
+   Header
+   AtlasPage   [page_count]
+   AtlasSprite [sprite_count], sorted by name
+   Point       [outline_size], every sprite's outline back to back
+   char        [strings_size], sprite names back to back, not terminated
+
+   Texture bounds are already normalized to their page, so loading is a
+   copy per sprite with no parsing.
+   */
+  namespace atlas
+  {
+    //! "PKAT" when read as bytes
+    const uint32_t cMagic = 0x54414B50;
+    const uint32_t cVersion = 2;
+
+    struct Header
+    {
+      uint32_t  magic;
+      uint32_t  version;
+      uint32_t  page_count;
+      uint32_t  sprite_count;
+      uint32_t  strings_size;
+      uint32_t  outline_size;   // points, not bytes
+    };
+
+    struct Page
+    {
+      uint32_t  width;
+      uint32_t  height;
+    };
+
+    enum SpriteFlags
+    {
+      eRotated = 1 << 0   // stored turned 90 degrees clockwise
+    };
+
+    struct Sprite
+    {
+      uint32_t  name_offset;  // into the string table
+      uint32_t  name_length;
+      float     x1, y1, x2, y2; // normalized texture bounds
+      int32_t   width, height;  // upright screen size
+      float     rx, ry;         // registration point
+      uint32_t  page;
+      uint32_t  flags;
+      uint32_t  outline_offset; // into the outline points
+      uint32_t  outline_length; // zero for a plain quad
+    };
+
+    //! outline vertex, in upright sprite pixels
+    struct Point
+    {
+      float     x, y;
+    };
+
+    static_assert( sizeof( Header ) == 24, "atlas::Header must match the file layout" );
+    static_assert( sizeof( Page ) == 8, "atlas::Page must match the file layout" );
+    static_assert( sizeof( Sprite ) == 56, "atlas::Sprite must match the file layout" );
+    static_assert( sizeof( Point ) == 8, "atlas::Point must match the file layout" );
+
+    //! converts \a record between host and file (little-endian) byte order, in place
+    //! every field is 32 bits, so this swaps each word on big-endian hosts and does nothing elsewhere
+    template<typename Record>
+    inline void toFileOrder( Record &record )
+    {
+      static_assert( sizeof( Record ) % 4 == 0, "atlas records are made of 32-bit fields" );
+      const uint32_t probe = 1;
+      if( *reinterpret_cast<const uint8_t*>( &probe ) == 1 )
+      {
+        return;
+      }
+      uint8_t *bytes = reinterpret_cast<uint8_t*>( &record );
+      for( size_t i = 0; i < sizeof( Record ); i += 4 )
+      {
+        std::swap( bytes[i], bytes[i + 3] );
+        std::swap( bytes[i + 1], bytes[i + 2] );
+      }
+    }
+  } // atlas::
+} // pockets::
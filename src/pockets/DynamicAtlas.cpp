@@ -0,0 +1,245 @@
+/*
+ * Copyright (c) 2013 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "pockets/DynamicAtlas.h"
+#include "cinder/Text.h"
+#include <algorithm>
+
+using namespace std;
+using namespace cinder;
+using namespace pockets;
+
+DynamicAtlas::DynamicAtlas( const Vec2i &size, int padding ):
+mSize( size ),
+mPadding( padding )
+{
+  gl::Texture::Format format;
+  format.setInternalFormat( GL_RGBA );
+  mTexture = gl::Texture::create( size.x, size.y, format );
+}
+
+DynamicAtlasUniqueRef DynamicAtlas::create( const Vec2i &size, int padding )
+{
+  return DynamicAtlasUniqueRef{ new DynamicAtlas{ size, padding } };
+}
+
+bool DynamicAtlas::add( const string &key, const Surface &surface, const Vec2f &registration )
+{
+  remove( key );
+  Area area;
+  if( !allocate( surface.getSize() + Vec2i( mPadding, mPadding ) * 2, &area ) )
+  {
+    std::cout << "DynamicAtlas: no room for " << key << " (" << surface.getWidth() << "x" << surface.getHeight() << ")" << std::endl;
+    return false;
+  }
+  upload( surface, area );
+  const Vec2f upper_left = Vec2f( area.getUL() + Vec2i( mPadding, mPadding ) );
+  const Rectf bounds( upper_left / mSize, ( upper_left + surface.getSize() ) / mSize );
+  mUses.push_front( key );
+  mEntries[key] = Entry{ SpriteData{ bounds, surface.getSize(), registration }, area, mUses.begin() };
+  return true;
+}
+
+bool DynamicAtlas::addString( const string &key, const Font &font, const string &str )
+{
+  TextLayout layout;
+  layout.clear( ColorA( 0, 0, 0, 0 ) );
+  layout.setFont( font );
+  layout.setColor( ColorA::white() );
+  layout.addLine( str );
+  return add( key, layout.render( true, false ) );
+}
+
+const SpriteData* DynamicAtlas::get( const string &key )
+{
+  auto iter = mEntries.find( key );
+  if( iter == mEntries.end() )
+  {
+    return nullptr;
+  }
+  mUses.splice( mUses.begin(), mUses, iter->second.use );
+  return &iter->second.sprite;
+}
+
+void DynamicAtlas::remove( const string &key )
+{
+  auto iter = mEntries.find( key );
+  if( iter != mEntries.end() )
+  {
+    release( iter->second.area );
+    mUses.erase( iter->second.use );
+    mEntries.erase( iter );
+  }
+}
+
+void DynamicAtlas::clear()
+{
+  mEntries.clear();
+  mUses.clear();
+  mShelves.clear();
+}
+
+bool DynamicAtlas::allocate( const Vec2i &size, Area *area )
+{
+  if( size.x > mSize.x || size.y > mSize.y )
+  {
+    return false;
+  }
+  while( !findSpace( size, area ) )
+  {
+    if( mUses.empty() )
+    { // fragmentation can't be the problem once everything is gone
+      return false;
+    }
+    auto iter = mEntries.find( mUses.back() );
+    release( iter->second.area );
+    mEntries.erase( iter );
+    mUses.pop_back();
+    mEvictionCount += 1;
+  }
+  return true;
+}
+
+bool DynamicAtlas::findSpace( const Vec2i &size, Area *area )
+{
+  // the shelf wasting the least height, as long as it wastes less than the image's height
+  Shelf *best = nullptr;
+  size_t best_span = 0;
+  for( Shelf &shelf : mShelves )
+  {
+    const bool empty = shelf.free.size() == 1 && shelf.free.front().width == mSize.x;
+    if( shelf.height < size.y || ( shelf.height >= size.y * 2 && !empty ) || ( best && shelf.height >= best->height ) )
+    {
+      continue;
+    }
+    for( size_t i = 0; i < shelf.free.size(); ++i )
+    {
+      if( shelf.free[i].width >= size.x )
+      {
+        best = &shelf;
+        best_span = i;
+        break;
+      }
+    }
+  }
+  if( !best )
+  { // open a new shelf below the others
+    const int top = mShelves.empty() ? 0 : mShelves.back().y + mShelves.back().height;
+    if( top + size.y > mSize.y )
+    {
+      return false;
+    }
+    mShelves.push_back( Shelf{ top, size.y, { Span{ 0, mSize.x } } } );
+    best = &mShelves.back();
+  }
+  else if( best->height > size.y && best->free.size() == 1 && best->free.front().width == mSize.x )
+  { // an emptied shelf is cut down to size, leaving the rest for other heights
+    const size_t index = best - mShelves.data();
+    const Shelf rest{ best->y + size.y, best->height - size.y, { Span{ 0, mSize.x } } };
+    mShelves[index].height = size.y;
+    mShelves.insert( mShelves.begin() + index + 1, rest );
+    best = &mShelves[index];
+  }
+  Span &span = best->free[best_span];
+  *area = Area( span.x, best->y, span.x + size.x, best->y + size.y );
+  span.x += size.x;
+  span.width -= size.x;
+  if( span.width == 0 )
+  {
+    best->free.erase( best->free.begin() + best_span );
+  }
+  return true;
+}
+
+void DynamicAtlas::release( const Area &area )
+{
+  auto shelf = find_if( mShelves.begin(), mShelves.end(), [&]( const Shelf &s ){ return s.y == area.y1; } );
+  if( shelf == mShelves.end() )
+  {
+    return;
+  }
+  // insert the span in order, then merge it with touching neighbors
+  vector<Span> &free = shelf->free;
+  auto iter = free.insert( find_if( free.begin(), free.end(), [&]( const Span &s ){ return s.x > area.x1; } ), Span{ area.x1, area.getWidth() } );
+  if( iter + 1 != free.end() && iter->x + iter->width == ( iter + 1 )->x )
+  {
+    iter->width += ( iter + 1 )->width;
+    free.erase( iter + 1 );
+  }
+  if( iter != free.begin() && ( iter - 1 )->x + ( iter - 1 )->width == iter->x )
+  {
+    ( iter - 1 )->width += iter->width;
+    free.erase( iter );
+  }
+
+  auto empty = [this]( const Shelf &s ){ return s.free.size() == 1 && s.free.front().width == mSize.x; };
+  if( !empty( *shelf ) )
+  {
+    return;
+  }
+  // merge runs of empty shelves so they can hold taller images again
+  if( shelf + 1 != mShelves.end() && empty( *( shelf + 1 ) ) )
+  {
+    shelf->height += ( shelf + 1 )->height;
+    mShelves.erase( shelf + 1 );
+  }
+  if( shelf != mShelves.begin() && empty( *( shelf - 1 ) ) )
+  {
+    ( shelf - 1 )->height += shelf->height;
+    shelf = mShelves.erase( shelf ) - 1;
+  }
+  if( shelf + 1 == mShelves.end() )
+  { // the bottom shelf goes back to the unused space
+    mShelves.pop_back();
+  }
+}
+
+void DynamicAtlas::upload( const Surface &surface, const Area &area )
+{
+  const int width = area.getWidth();
+  const int height = area.getHeight();
+  mScratch.assign( width * height * 4, 0 );
+  const SurfaceChannelOrder &order = surface.getChannelOrder();
+  const bool has_alpha = surface.hasAlpha();
+  for( int y = 0; y < surface.getHeight(); ++y )
+  {
+    const uint8_t *in = surface.getData( Vec2i( 0, y ) );
+    uint8_t *out = &mScratch[( ( y + mPadding ) * width + mPadding ) * 4];
+    for( int x = 0; x < surface.getWidth(); ++x, in += surface.getPixelInc(), out += 4 )
+    {
+      out[0] = in[order.getRedOffset()];
+      out[1] = in[order.getGreenOffset()];
+      out[2] = in[order.getBlueOffset()];
+      out[3] = has_alpha ? in[order.getAlphaOffset()] : 255;
+    }
+  }
+  mTexture->bind();
+  glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+  glTexSubImage2D( GL_TEXTURE_2D, 0, area.x1, area.y1, width, height, GL_RGBA, GL_UNSIGNED_BYTE, mScratch.data() );
+  mTexture->unbind();
+}
@@ -0,0 +1,117 @@
+/*
+ * Copyright (c) 2013 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+#include "pockets/TextureAtlas.h"
+#include "cinder/Font.h"
+#include <list>
+#include <unordered_map>
+
+namespace pockets
+{
+  /**
+   DynamicAtlas:
+   A single texture that packs images as they come in, for things that change
+   at runtime like text and thumbnails.
+
+   Images are placed on shelves: horizontal strips as tall as the first image
+   they held. Each shelf keeps a list of free spans, so evicting an image frees
+   its span for the next one of similar height. When there is no room, the
+   least-recently-used images are evicted until there is.
+
+   SpriteData handed out stays valid until its image is evicted; look images
+   up with get() each frame so the ones in use aren't the ones evicted.
+   */
+  typedef std::unique_ptr<class DynamicAtlas> DynamicAtlasUniqueRef;
+  class DynamicAtlas
+  {
+  public:
+    //! \a padding transparent pixels are kept around each image so filtering doesn't pick up its neighbors
+    explicit DynamicAtlas( const ci::Vec2i &size = ci::Vec2i( 1024, 1024 ), int padding = 1 );
+    //! uploads \a surface under \a key, replacing any image already there
+    //! returns false if \a surface can't fit even in an empty atlas
+    bool                add( const std::string &key, const ci::Surface &surface, const ci::Vec2f &registration = ci::Vec2f::zero() );
+    //! renders \a str in \a font (white on transparent, as ImagePacker::addString does) and adds it under \a key
+    bool                addString( const std::string &key, const ci::Font &font, const std::string &str );
+    //! returns the sprite stored under \a key and marks it recently used, or nullptr if there is none
+    //! the pointer is good until the next add
+    const SpriteData*   get( const std::string &key );
+    bool                contains( const std::string &key ) const { return mEntries.count( key ) != 0; }
+    //! frees the space held by \a key
+    void                remove( const std::string &key );
+    //! evicts everything
+    void                clear();
+    ci::gl::TextureRef  getTexture() const { return mTexture; }
+    ci::Vec2i           getSize() const { return mSize; }
+    size_t              getImageCount() const { return mEntries.size(); }
+    //! number of images evicted to make room since construction
+    size_t              getEvictionCount() const { return mEvictionCount; }
+
+    static DynamicAtlasUniqueRef create( const ci::Vec2i &size = ci::Vec2i( 1024, 1024 ), int padding = 1 );
+  private:
+    //! free horizontal range on a shelf
+    struct Span
+    {
+      int x;
+      int width;
+    };
+    struct Shelf
+    {
+      int               y;
+      int               height;
+      std::vector<Span> free;   // sorted by x, never adjacent
+    };
+    struct Entry
+    {
+      SpriteData                        sprite;
+      ci::Area                          area;   // space taken on its shelf, including padding
+      std::list<std::string>::iterator  use;
+    };
+
+    //! finds space for a \a size rect (padding included), evicting images if needed
+    bool                allocate( const ci::Vec2i &size, ci::Area *area );
+    //! finds space without evicting anything
+    bool                findSpace( const ci::Vec2i &size, ci::Area *area );
+    //! returns \a area to its shelf, merging free spans and emptied shelves
+    void                release( const ci::Area &area );
+    //! copies \a surface inside \a area and clears the padding around it
+    void                upload( const ci::Surface &surface, const ci::Area &area );
+
+    ci::Vec2i                               mSize;
+    int                                     mPadding;
+    ci::gl::TextureRef                      mTexture;
+    //! sorted top to bottom; everything below the last shelf is unused
+    std::vector<Shelf>                      mShelves;
+    std::unordered_map<std::string, Entry>  mEntries;
+    //! keys, most recently used first
+    std::list<std::string>                  mUses;
+    size_t                                  mEvictionCount = 0;
+    //! RGBA staging for uploads
+    std::vector<uint8_t>                    mScratch;
+  };
+} // pockets::
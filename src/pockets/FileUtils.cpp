@@ -28,6 +28,15 @@
 #include "FileUtils.h"
 #include "cinder/Utilities.h"
 
+#if defined( CINDER_MSW )
+	#include <windows.h>
+#else
+	#include <fcntl.h>
+	#include <sys/mman.h>
+	#include <sys/stat.h>
+	#include <unistd.h>
+#endif
+
 using namespace ci;
 using namespace std;
 
@@ -50,6 +59,56 @@ std::string pockets::getNextNumberedPath( const fs::path &path, int padding, boo
 	return p.generic_string();
 }
 
+pockets::MappedFile::MappedFile( const fs::path &path )
+{
+#if defined( CINDER_MSW )
+	HANDLE file = ::CreateFileW( path.wstring().c_str(), GENERIC_READ, FILE_SHARE_READ, nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr );
+	if( file == INVALID_HANDLE_VALUE )
+		return;
+	LARGE_INTEGER size;
+	if( ::GetFileSizeEx( file, &size ) && size.QuadPart > 0 )
+	{
+		mMapping = ::CreateFileMappingW( file, nullptr, PAGE_READONLY, 0, 0, nullptr );
+		if( mMapping )
+		{
+			mData = static_cast<const uint8_t*>( ::MapViewOfFile( mMapping, FILE_MAP_READ, 0, 0, 0 ) );
+			mSize = mData ? static_cast<size_t>( size.QuadPart ) : 0;
+		}
+	}
+	// the mapping keeps the file open
+	::CloseHandle( file );
+#else
+	int file = ::open( path.c_str(), O_RDONLY );
+	if( file < 0 )
+		return;
+	struct stat info;
+	if( ::fstat( file, &info ) == 0 && info.st_size > 0 )
+	{
+		void *data = ::mmap( nullptr, info.st_size, PROT_READ, MAP_PRIVATE, file, 0 );
+		if( data != MAP_FAILED )
+		{
+			mData = static_cast<const uint8_t*>( data );
+			mSize = info.st_size;
+		}
+	}
+	// the mapping keeps the file open
+	::close( file );
+#endif
+}
+
+pockets::MappedFile::~MappedFile()
+{
+#if defined( CINDER_MSW )
+	if( mData )
+		::UnmapViewOfFile( mData );
+	if( mMapping )
+		::CloseHandle( mMapping );
+#else
+	if( mData )
+		::munmap( const_cast<uint8_t*>( mData ), mSize );
+#endif
+}
+
 std::string pockets::leftPaddedString( const std::string &input, int minSize, const std::string pad )
 {
 	std::string output(input);
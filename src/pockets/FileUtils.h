@@ -37,4 +37,29 @@ std::string getNextNumberedPath( const ci::fs::path &path, int padding = 2, bool
 //! Returns a left-padded string based on the input string. e.g. ("two", 4, "0") returns "0two", ("four", 4, "0") returns "four"
 std::string leftPaddedString( const std::string &input, int minSize, const std::string pad="0" );
 
+/**
+ MappedFile:
+ Read-only view of a file's contents, mapped into memory instead of read.
+ The OS pages data in as it is touched, so opening a large file is cheap.
+ Evaluates to false if the file couldn't be opened or is empty.
+ */
+class MappedFile
+{
+public:
+	explicit MappedFile( const ci::fs::path &path );
+	~MappedFile();
+	MappedFile( const MappedFile &other ) = delete;
+	MappedFile& operator = ( const MappedFile &other ) = delete;
+
+	const uint8_t*	getData() const { return mData; }
+	size_t			getSize() const { return mSize; }
+	explicit operator bool() const { return mData != nullptr; }
+private:
+	const uint8_t	*mData = nullptr;
+	size_t			mSize = 0;
+#if defined( CINDER_MSW )
+	void			*mMapping = nullptr;
+#endif
+};
+
 } // pockets
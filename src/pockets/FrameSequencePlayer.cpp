@@ -0,0 +1,189 @@
+/*
+ * Copyright (c) 2014 David Wicks
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pockets/FrameSequencePlayer.h"
+#include "cinder/Json.h"
+#include <cstring>
+#include <set>
+
+using namespace std;
+using namespace cinder;
+using namespace pockets;
+
+FrameSequencePlayer::FrameSequencePlayer( const vector<Surface> &pages, const JsonTree &description, const string &sequence_id )
+{
+  // uploads read straight from the pages, so keep them as tightly-described RGBA
+  for( const Surface &page : pages )
+  {
+    if( page.getChannelOrder().getCode() == SurfaceChannelOrder::RGBA )
+    {
+      mPages.push_back( page );
+    }
+    else
+    {
+      Surface rgba( page.getWidth(), page.getHeight(), true, SurfaceChannelOrder::RGBA );
+      rgba.copyFrom( page, page.getBounds() );
+      mPages.push_back( rgba );
+    }
+  }
+
+  map<string, Patch> sprites;
+  set<string> rotated;
+  for( const auto &child : description["sprites"] )
+  {
+    size_t page = child.hasChild( "page" ) ? child["page"].getValue<int>() : 0;
+    Area bounds( child["x1"].getValue<int>(), child["y1"].getValue<int>()
+                , child["x2"].getValue<int>(), child["y2"].getValue<int>() );
+    sprites[child["id"].getValue()] = Patch{ page, bounds, Vec2i::zero() };
+    if( child.hasChild( "rotated" ) && child["rotated"].getValue<bool>() )
+    {
+      rotated.insert( child["id"].getValue() );
+    }
+  }
+
+  if( description.hasChild( "sequences" ) )
+  {
+    for( const auto &sequence : description["sequences"] )
+    {
+      if( sequence["id"].getValue() != sequence_id )
+      {
+        continue;
+      }
+      mSize.set( sequence["width"].getValue<int>(), sequence["height"].getValue<int>() );
+      for( const auto &frame : sequence["frames"] )
+      {
+        Frame f{ frame["keyframe"].getValue<bool>(), {} };
+        for( const auto &patch : frame["patches"] )
+        {
+          const string sprite = patch["sprite"].getValue();
+          if( rotated.erase( sprite ) )
+          { // uploads can't turn pixels, so the first use makes an upright copy on a page of its own
+            Patch &stored = sprites.at( sprite );
+            stored.source = uprightCopy( stored.page, stored.source );
+            stored.page = mPages.size() - 1;
+          }
+          Patch p = sprites.at( sprite );
+          p.offset.set( patch["x"].getValue<int>(), patch["y"].getValue<int>() );
+          f.patches.push_back( p );
+        }
+        mFrames.push_back( f );
+      }
+    }
+  }
+  if( mFrames.empty() )
+  { // unknown or empty sequence; leave an empty player with no texture
+    std::cout << "FrameSequencePlayer: no frames for sequence " << sequence_id << std::endl;
+    return;
+  }
+  // create from a surface so rows are laid out the same way as the packed pages
+  mTexture = gl::Texture::create( Surface( mSize.x, mSize.y, true, SurfaceChannelOrder::RGBA ) );
+  applyFrame( 0 );
+}
+
+Area FrameSequencePlayer::uprightCopy( size_t page, const Area &bounds )
+{
+  const Surface &source = mPages.at( page );
+  Surface upright( bounds.getHeight(), bounds.getWidth(), true, SurfaceChannelOrder::RGBA );
+  for( int y = 0; y < upright.getHeight(); ++y )
+  {
+    uint8_t *row = upright.getData( Vec2i( 0, y ) );
+    for( int x = 0; x < upright.getWidth(); ++x )
+    { // stored turned clockwise, so upright (x, y) is at (width - 1 - y, x) in the packed rect
+      memcpy( row + x * 4, source.getData( bounds.getUL() + Vec2i( bounds.getWidth() - 1 - y, x ) ), 4 );
+    }
+  }
+  mPages.push_back( upright );
+  return upright.getBounds();
+}
+
+void FrameSequencePlayer::setFrame( size_t frame )
+{
+  if( frame >= mFrames.size() || frame == mFrame )
+  {
+    return;
+  }
+  size_t start = mFrame + 1;
+  if( frame < mFrame || mFrames[frame].keyframe )
+  { // rebuild from the closest keyframe at or before the target
+    start = frame;
+    while( !mFrames[start].keyframe )
+    {
+      start -= 1;
+    }
+  }
+  for( size_t i = start; i <= frame; ++i )
+  {
+    applyFrame( i );
+  }
+  mFrame = frame;
+}
+
+void FrameSequencePlayer::nextFrame()
+{
+  if( !mFrames.empty() )
+  {
+    setFrame( ( mFrame + 1 ) % mFrames.size() );
+  }
+}
+
+void FrameSequencePlayer::applyFrame( size_t frame )
+{
+  if( mFrames[frame].patches.empty() )
+  {
+    return;
+  }
+  mTexture->bind();
+  glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+  for( const Patch &patch : mFrames[frame].patches )
+  {
+    const Surface &page = mPages.at( patch.page );
+    const Area &source = patch.source;
+    const uint8_t *pixels = page.getData( source.getUL() );
+#if defined( CINDER_GL_ES_2 )
+    // no GL_UNPACK_ROW_LENGTH, so gather the patch rows into a contiguous buffer
+    const size_t row_length = source.getWidth() * 4;
+    mScratch.resize( row_length * source.getHeight() );
+    for( int y = 0; y < source.getHeight(); ++y )
+    {
+      memcpy( &mScratch[y * row_length], pixels + y * page.getRowBytes(), row_length );
+    }
+    pixels = mScratch.data();
+#else
+    glPixelStorei( GL_UNPACK_ROW_LENGTH, page.getRowBytes() / 4 );
+#endif
+    glTexSubImage2D( GL_TEXTURE_2D, 0, patch.offset.x, patch.offset.y, source.getWidth(), source.getHeight(), GL_RGBA, GL_UNSIGNED_BYTE, pixels );
+  }
+#if ! defined( CINDER_GL_ES_2 )
+  glPixelStorei( GL_UNPACK_ROW_LENGTH, 0 );
+#endif
+  mTexture->unbind();
+}
+
+FrameSequencePlayerUniqueRef FrameSequencePlayer::create( const vector<Surface> &pages, const JsonTree &description, const string &sequence_id )
+{
+  return FrameSequencePlayerUniqueRef{ new FrameSequencePlayer{ pages, description, sequence_id } };
+}
@@ -0,0 +1,95 @@
+/*
+ * Copyright (c) 2014 David Wicks
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "Pockets.h"
+#include "cinder/Surface.h"
+#include "cinder/gl/Texture.h"
+
+namespace cinder
+{
+  class JsonTree;
+}
+
+namespace pockets
+{
+  /**
+   FrameSequencePlayer:
+   Plays back a frame sequence packed with ImagePacker::addSequence.
+   Frames are rebuilt in a texture the size of the original frames by
+   copying each frame's changed areas out of the packed pages with
+   glTexSubImage2D, so advancing a frame costs a few small uploads.
+   Stepping backward replays from the nearest preceding keyframe.
+   Patches packed with rotation are turned upright once, when loaded.
+   A sequence missing from the description makes an empty player: it has
+   no texture and ignores setFrame and nextFrame.
+   */
+  typedef std::unique_ptr<class FrameSequencePlayer> FrameSequencePlayerUniqueRef;
+  class FrameSequencePlayer
+  {
+  public:
+    //! \a pages are the packed surfaces in page order; \a description is ImagePacker::surfaceDescription()
+    FrameSequencePlayer( const std::vector<ci::Surface> &pages, const ci::JsonTree &description, const std::string &sequence_id );
+    //! show \a frame in the texture, applying only the patches needed to get there
+    void                setFrame( size_t frame );
+    //! advance one frame, wrapping to the start at the end
+    void                nextFrame();
+    size_t              getFrame() const { return mFrame; }
+    size_t              getFrameCount() const { return mFrames.size(); }
+    //! true if the sequence had no frames to play
+    bool                empty() const { return mFrames.empty(); }
+    //! texture holding the current frame, or null if empty()
+    ci::gl::TextureRef  getTexture() const { return mTexture; }
+    ci::Vec2i           getSize() const { return mSize; }
+
+    static FrameSequencePlayerUniqueRef create( const std::vector<ci::Surface> &pages, const ci::JsonTree &description, const std::string &sequence_id );
+  private:
+    //! a rect on a packed page and where it goes in the frame
+    struct Patch
+    {
+      size_t      page;
+      ci::Area    source;
+      ci::Vec2i   offset;
+    };
+    struct Frame
+    {
+      bool                keyframe;
+      std::vector<Patch>  patches;
+    };
+    void                applyFrame( size_t frame );
+    //! appends an upright copy of the rotated sprite at \a bounds on \a page to mPages, returning its bounds there
+    ci::Area            uprightCopy( size_t page, const ci::Area &bounds );
+
+    std::vector<ci::Surface>  mPages;
+    std::vector<Frame>        mFrames;
+    ci::gl::TextureRef        mTexture;
+    ci::Vec2i                 mSize = ci::Vec2i::zero();
+    size_t                    mFrame = 0;
+    //! rows of the current patch, for GL versions that can't upload from a sub-rect of a page
+    std::vector<uint8_t>      mScratch;
+  };
+} // pockets::
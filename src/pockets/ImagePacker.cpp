@@ -26,15 +26,486 @@
  */
 
 #include "ImagePacker.h"
+#include "AtlasFormat.h"
+#include "ThreadPool.h"
 #include "cinder/Text.h"
-#include "cinder/ip/Trim.h"
-#include "cinder/ip/Fill.h"
-#include "cinder/ip/Premultiply.h"
+#include "cinder/ImageIo.h"
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <limits>
+#include <mutex>
+#include <unordered_set>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+  #include <emmintrin.h>
+  #define POCKETS_SSE2 1
+#elif defined( __ARM_NEON__ ) || defined( __ARM_NEON )
+  #include <arm_neon.h>
+  #define POCKETS_NEON 1
+#endif
 
 using namespace ci;
 using namespace std;
 using namespace pockets;
 
+namespace
+{
+  inline bool isOpaque( const uint8_t *row, int x, uint32_t alpha_mask )
+  {
+    uint32_t pixel;
+    memcpy( &pixel, row + x * 4, sizeof( pixel ) );
+    return ( pixel & alpha_mask ) != 0;
+  }
+
+  //! index of the first pixel in [begin, end) with non-zero alpha, or end if there is none
+  //! works on four-channel rows; alpha_mask selects the alpha byte of a little-endian pixel
+  int firstOpaque( const uint8_t *row, int begin, int end, uint32_t alpha_mask )
+  {
+    int x = begin;
+#if POCKETS_SSE2
+    const __m128i mask = _mm_set1_epi32( static_cast<int>( alpha_mask ) );
+    const __m128i zero = _mm_setzero_si128();
+    for( ; x + 4 <= end; x += 4 )
+    { // test four pixels at a time, leaving the scalar loop to find which one hit
+      __m128i alpha = _mm_and_si128( _mm_loadu_si128( reinterpret_cast<const __m128i*>( row + x * 4 ) ), mask );
+      if( _mm_movemask_epi8( _mm_cmpeq_epi32( alpha, zero ) ) != 0xFFFF )
+      {
+        break;
+      }
+    }
+#elif POCKETS_NEON
+    const uint32x4_t mask = vdupq_n_u32( alpha_mask );
+    for( ; x + 4 <= end; x += 4 )
+    {
+      uint32x4_t alpha = vandq_u32( vreinterpretq_u32_u8( vld1q_u8( row + x * 4 ) ), mask );
+      uint32x2_t either = vorr_u32( vget_low_u32( alpha ), vget_high_u32( alpha ) );
+      if( vget_lane_u32( vpmax_u32( either, either ), 0 ) != 0 )
+      {
+        break;
+      }
+    }
+#endif
+    for( ; x < end; ++x )
+    {
+      if( isOpaque( row, x, alpha_mask ) )
+      {
+        return x;
+      }
+    }
+    return end;
+  }
+
+  //! one past the last pixel in [begin, end) with non-zero alpha, or begin if there is none
+  int lastOpaque( const uint8_t *row, int begin, int end, uint32_t alpha_mask )
+  {
+    int x = end;
+#if POCKETS_SSE2
+    const __m128i mask = _mm_set1_epi32( static_cast<int>( alpha_mask ) );
+    const __m128i zero = _mm_setzero_si128();
+    for( ; x - 4 >= begin; x -= 4 )
+    {
+      __m128i alpha = _mm_and_si128( _mm_loadu_si128( reinterpret_cast<const __m128i*>( row + ( x - 4 ) * 4 ) ), mask );
+      if( _mm_movemask_epi8( _mm_cmpeq_epi32( alpha, zero ) ) != 0xFFFF )
+      {
+        break;
+      }
+    }
+#elif POCKETS_NEON
+    const uint32x4_t mask = vdupq_n_u32( alpha_mask );
+    for( ; x - 4 >= begin; x -= 4 )
+    {
+      uint32x4_t alpha = vandq_u32( vreinterpretq_u32_u8( vld1q_u8( row + ( x - 4 ) * 4 ) ), mask );
+      uint32x2_t either = vorr_u32( vget_low_u32( alpha ), vget_high_u32( alpha ) );
+      if( vget_lane_u32( vpmax_u32( either, either ), 0 ) != 0 )
+      {
+        break;
+      }
+    }
+#endif
+    for( ; x > begin; --x )
+    {
+      if( isOpaque( row, x - 1, alpha_mask ) )
+      {
+        return x;
+      }
+    }
+    return begin;
+  }
+
+  //! bounds of the non-transparent pixels in \a surface
+  //! equivalent to ip::findNonTransparentArea, but only scans the columns that can still widen the bounds
+  Area findOpaqueArea( const Surface &surface )
+  {
+    if( !surface.hasAlpha() )
+    {
+      return surface.getBounds();
+    }
+    const int width = surface.getWidth();
+    const int height = surface.getHeight();
+    const uint32_t alpha_mask = 0xFFu << ( 8 * surface.getChannelOrder().getAlphaOffset() );
+    auto row = [&surface]( int y ){ return surface.getData() + y * surface.getRowBytes(); };
+
+    int top = 0;
+    while( top < height && firstOpaque( row( top ), 0, width, alpha_mask ) == width )
+    {
+      top += 1;
+    }
+    if( top == height )
+    { // nothing visible; keep a single transparent pixel so the sprite still has a place
+      return Area( 0, 0, 1, 1 );
+    }
+    int bottom = height;
+    while( firstOpaque( row( bottom - 1 ), 0, width, alpha_mask ) == width )
+    {
+      bottom -= 1;
+    }
+    int left = width;
+    int right = 0;
+    for( int y = top; y < bottom; ++y )
+    {
+      left = firstOpaque( row( y ), 0, left, alpha_mask );
+      right = lastOpaque( row( y ), right, width, alpha_mask );
+    }
+    return Area( left, top, right, bottom );
+  }
+
+  //! FNV-1a over the image size and visible pixel bytes (row padding is skipped)
+  uint64_t hashPixels( const Surface &surface )
+  {
+    uint64_t hash = 14695981039346656037ULL;
+    auto mix = [&hash]( const uint8_t *bytes, size_t count )
+    {
+      for( size_t i = 0; i < count; ++i )
+      {
+        hash = ( hash ^ bytes[i] ) * 1099511628211ULL;
+      }
+    };
+    const int32_t size[] = { surface.getWidth(), surface.getHeight() };
+    mix( reinterpret_cast<const uint8_t*>( size ), sizeof( size ) );
+    const size_t row_length = surface.getWidth() * surface.getPixelInc();
+    for( int y = 0; y < surface.getHeight(); ++y )
+    {
+      mix( surface.getData() + y * surface.getRowBytes(), row_length );
+    }
+    return hash;
+  }
+
+  bool samePixels( const Surface &lhs, const Surface &rhs )
+  {
+    if( lhs.getSize() != rhs.getSize() || lhs.getPixelInc() != rhs.getPixelInc() || !( lhs.getChannelOrder() == rhs.getChannelOrder() ) )
+    {
+      return false;
+    }
+    const size_t row_length = lhs.getWidth() * lhs.getPixelInc();
+    for( int y = 0; y < lhs.getHeight(); ++y )
+    {
+      if( memcmp( lhs.getData() + y * lhs.getRowBytes(), rhs.getData() + y * rhs.getRowBytes(), row_length ) != 0 )
+      {
+        return false;
+      }
+    }
+    return true;
+  }
+
+  //! areas of \a current that differ from \a previous
+  //! changed tiles are joined into horizontal runs, runs with the same span are stacked,
+  //! and each result is tightened to the pixels that actually changed
+  vector<Area> findChangedAreas( const Surface &previous, const Surface &current, int tile_size )
+  {
+    assert( previous.getSize() == current.getSize() && previous.getPixelInc() == current.getPixelInc() );
+    const int width = current.getWidth();
+    const int height = current.getHeight();
+    const int inc = current.getPixelInc();
+    const int tiles_x = ( width + tile_size - 1 ) / tile_size;
+    const int tiles_y = ( height + tile_size - 1 ) / tile_size;
+    auto differs = [&]( int x1, int x2, int y )
+    {
+      return memcmp( previous.getData() + y * previous.getRowBytes() + x1 * inc,
+                     current.getData() + y * current.getRowBytes() + x1 * inc, ( x2 - x1 ) * inc ) != 0;
+    };
+
+    vector<bool> dirty( tiles_x * tiles_y, false );
+    for( int y = 0; y < height; ++y )
+    {
+      if( !differs( 0, width, y ) )
+      {
+        continue;
+      }
+      const int ty = y / tile_size;
+      for( int tx = 0; tx < tiles_x; ++tx )
+      {
+        if( !dirty[ty * tiles_x + tx] && differs( tx * tile_size, math<int>::min( ( tx + 1 ) * tile_size, width ), y ) )
+        {
+          dirty[ty * tiles_x + tx] = true;
+        }
+      }
+    }
+
+    // rects in tile units; open ones reach the previous tile row and can keep growing down
+    vector<Area> closed;
+    vector<Area> open;
+    for( int ty = 0; ty < tiles_y; ++ty )
+    {
+      vector<Area> next;
+      int tx = 0;
+      while( tx < tiles_x )
+      {
+        if( !dirty[ty * tiles_x + tx] )
+        {
+          tx += 1;
+          continue;
+        }
+        const int run_start = tx;
+        while( tx < tiles_x && dirty[ty * tiles_x + tx] )
+        {
+          tx += 1;
+        }
+        auto above = find_if( open.begin(), open.end(), [=]( const Area &a ){ return a.x1 == run_start && a.x2 == tx; } );
+        if( above != open.end() )
+        {
+          next.push_back( Area( run_start, above->y1, tx, ty + 1 ) );
+          open.erase( above );
+        }
+        else
+        {
+          next.push_back( Area( run_start, ty, tx, ty + 1 ) );
+        }
+      }
+      closed.insert( closed.end(), open.begin(), open.end() );
+      open.swap( next );
+    }
+    closed.insert( closed.end(), open.begin(), open.end() );
+
+    vector<Area> changed;
+    for( const Area &tiles : closed )
+    {
+      Area area( tiles.x1 * tile_size, tiles.y1 * tile_size, math<int>::min( tiles.x2 * tile_size, width ), math<int>::min( tiles.y2 * tile_size, height ) );
+      while( !differs( area.x1, area.x2, area.y1 ) )
+      {
+        area.y1 += 1;
+      }
+      while( !differs( area.x1, area.x2, area.y2 - 1 ) )
+      {
+        area.y2 -= 1;
+      }
+      int left = area.x2;
+      int right = area.x1;
+      for( int y = area.y1; y < area.y2; ++y )
+      {
+        const uint8_t *before = previous.getData() + y * previous.getRowBytes();
+        const uint8_t *after = current.getData() + y * current.getRowBytes();
+        for( int x = area.x1; x < left; ++x )
+        {
+          if( memcmp( before + x * inc, after + x * inc, inc ) != 0 )
+          {
+            left = x;
+            break;
+          }
+        }
+        for( int x = area.x2; x > right; --x )
+        {
+          if( memcmp( before + ( x - 1 ) * inc, after + ( x - 1 ) * inc, inc ) != 0 )
+          {
+            right = x;
+            break;
+          }
+        }
+      }
+      changed.push_back( Area( left, area.y1, right, area.y2 ) );
+    }
+    return changed;
+  }
+
+  Surface trimToOpaqueArea( const Surface &surface )
+  {
+    Area bounds = findOpaqueArea( surface );
+    assert( bounds.getWidth() <= surface.getWidth() );
+    assert( bounds.getHeight() <= surface.getHeight() );
+    Surface trimmed_copy( bounds.getWidth(), bounds.getHeight(), true, SurfaceChannelOrder::RGBA );
+    trimmed_copy.copyFrom( surface, bounds, -bounds.getUL() );
+    return trimmed_copy;
+  }
+
+  //! outlines covering at least this fraction of their image's quad aren't worth the extra vertices
+  const double cOutlineWorthwhile = 0.9;
+
+  inline double cross( const Vec2d &a, const Vec2d &b )
+  {
+    return a.x * b.y - a.y * b.x;
+  }
+
+  double polygonArea( const vector<Vec2d> &polygon )
+  {
+    double area = 0.0;
+    for( size_t i = 0; i < polygon.size(); ++i )
+    {
+      area += cross( polygon[i], polygon[( i + 1 ) % polygon.size()] );
+    }
+    return math<double>::abs( area ) * 0.5;
+  }
+
+  /**
+   Convex outline of the pixels in \a surface with any alpha, through pixel corners.
+   The hull is reduced to \a max_vertices by repeatedly removing the edge whose
+   neighbors, extended to meet, add the least area; the outline only ever grows,
+   and never past the image bounds. Returns nothing if a quad would do about as well.
+   */
+  vector<Vec2f> calculateOutline( const Surface &surface, size_t max_vertices )
+  {
+    const int width = surface.getWidth();
+    const int height = surface.getHeight();
+    if( max_vertices < 3 || !surface.hasAlpha() )
+    {
+      return {};
+    }
+    // the outer corners of each row's visible span, sorted by x then y for the hull
+    vector<Vec2d> corners;
+    const int alpha = surface.getChannelOrder().getAlphaOffset();
+    const int inc = surface.getPixelInc();
+    for( int y = 0; y < height; ++y )
+    {
+      const uint8_t *row = surface.getData() + y * surface.getRowBytes() + alpha;
+      int left = 0;
+      while( left < width && row[left * inc] == 0 )
+      {
+        left += 1;
+      }
+      if( left == width )
+      {
+        continue;
+      }
+      int right = width;
+      while( row[( right - 1 ) * inc] == 0 )
+      {
+        right -= 1;
+      }
+      corners.insert( corners.end(), { Vec2d( left, y ), Vec2d( left, y + 1 ), Vec2d( right, y ), Vec2d( right, y + 1 ) } );
+    }
+    if( corners.empty() )
+    {
+      return {};
+    }
+    sort( corners.begin(), corners.end(), []( const Vec2d &lhs, const Vec2d &rhs )
+    {
+      return lhs.x < rhs.x || ( lhs.x == rhs.x && lhs.y < rhs.y );
+    } );
+    // monotone chain, dropping collinear points
+    vector<Vec2d> hull( corners.size() * 2 );
+    size_t k = 0;
+    for( size_t i = 0; i < corners.size(); ++i )
+    {
+      while( k >= 2 && cross( hull[k - 1] - hull[k - 2], corners[i] - hull[k - 2] ) <= 0.0 )
+      {
+        k -= 1;
+      }
+      hull[k++] = corners[i];
+    }
+    for( size_t i = corners.size() - 1, lower = k + 1; i > 0; --i )
+    {
+      while( k >= lower && cross( hull[k - 1] - hull[k - 2], corners[i - 1] - hull[k - 2] ) <= 0.0 )
+      {
+        k -= 1;
+      }
+      hull[k++] = corners[i - 1];
+    }
+    hull.resize( k - 1 );
+
+    while( hull.size() > max_vertices )
+    {
+      const size_t n = hull.size();
+      size_t best_edge = n;
+      double best_area = numeric_limits<double>::max();
+      Vec2d best_point;
+      for( size_t i = 0; i < n; ++i )
+      { // extend the edges either side of edge i until they meet
+        const Vec2d &a = hull[i];
+        const Vec2d &b = hull[( i + 1 ) % n];
+        const Vec2d before = a - hull[( i + n - 1 ) % n];
+        const Vec2d after = hull[( i + 2 ) % n] - b;
+        const Vec2d edge = b - a;
+        const double denominator = cross( before, after );
+        if( denominator <= 1.0e-9 )
+        { // neighbors are parallel or diverge, so never meet beyond the edge
+          continue;
+        }
+        const double t = cross( edge, after ) / denominator;
+        const Vec2d point = a + before * t;
+        if( t < 0.0 || point.x < -1.0e-6 || point.y < -1.0e-6 || point.x > width + 1.0e-6 || point.y > height + 1.0e-6 )
+        {
+          continue;
+        }
+        const double area = math<double>::abs( cross( edge, point - a ) ) * 0.5;
+        if( area < best_area )
+        {
+          best_area = area;
+          best_edge = i;
+          best_point = point;
+        }
+      }
+      if( best_edge == n )
+      { // can't get under budget while staying within the image
+        return {};
+      }
+      hull[best_edge] = best_point;
+      hull.erase( hull.begin() + ( best_edge + 1 ) % n );
+    }
+
+    if( polygonArea( hull ) >= cOutlineWorthwhile * width * height )
+    {
+      return {};
+    }
+    vector<Vec2f> outline;
+    for( const Vec2d &point : hull )
+    {
+      outline.push_back( Vec2f( math<double>::clamp( point.x, 0.0, width ), math<double>::clamp( point.y, 0.0, height ) ) );
+    }
+    return outline;
+  }
+
+  //! write \a count RGBA pixels starting at \a src_loc in \a src to \a dst
+  //! rotated sprites are stored turned clockwise, so their rows are read up a source column
+  void blitRow( const Surface &src, const Vec2i &src_loc, int count, uint8_t *dst, bool premultiply, bool rotated )
+  {
+    const uint8_t *in = src.getData( src_loc );
+    const SurfaceChannelOrder &order = src.getChannelOrder();
+    if( order.getCode() == SurfaceChannelOrder::RGBA && !premultiply && !rotated )
+    {
+      memcpy( dst, in, count * 4 );
+      return;
+    }
+    const int inc = rotated ? -src.getRowBytes() : src.getPixelInc();
+    const int r = order.getRedOffset();
+    const int g = order.getGreenOffset();
+    const int b = order.getBlueOffset();
+    const int a = order.getAlphaOffset();
+    const bool has_alpha = src.hasAlpha();
+    for( int i = 0; i < count; ++i, in += inc, dst += 4 )
+    {
+      const uint8_t alpha = has_alpha ? in[a] : 255;
+      if( premultiply )
+      {
+        dst[0] = in[r] * alpha / 255;
+        dst[1] = in[g] * alpha / 255;
+        dst[2] = in[b] * alpha / 255;
+      }
+      else
+      {
+        dst[0] = in[r];
+        dst[1] = in[g];
+        dst[2] = in[b];
+      }
+      dst[3] = alpha;
+    }
+  }
+
+  //! true if a rect of \a size can't fit in \a width, even turned on its side when \a allow_rotation
+  inline bool tooWide( const Vec2i &size, int width, bool allow_rotation )
+  {
+    return size.x > width && ( !allow_rotation || size.y > width );
+  }
+} // anon::
+
 ImagePacker::ImagePacker()
 {}
 
@@ -45,17 +516,165 @@ ImagePacker::ImageDataRef ImagePacker::addImage( const std::string &id, ci::Surf
 {
   if( trim_alpha )
   {
-    Area bounds = ip::findNonTransparentArea( surface, surface.getBounds() );
-    assert( bounds.getWidth() <= surface.getWidth() );
-    assert( bounds.getHeight() <= surface.getHeight() );
-    Surface trimmed_copy( bounds.getWidth(), bounds.getHeight(), true, SurfaceChannelOrder::RGBA );
-    trimmed_copy.copyFrom( surface, bounds, -bounds.getUL() );
-    surface = trimmed_copy;
+    surface = trimToOpaqueArea( surface );
+  }
+  return addUniqueImage( id, surface, hashPixels( surface ) );
+}
+
+ImagePacker::ImageDataRef ImagePacker::addUniqueImage( const std::string &id, const ci::Surface &surface, uint64_t hash )
+{
+  auto range = mImagesByHash.equal_range( hash );
+  for( auto iter = range.first; iter != range.second; ++iter )
+  {
+    if( samePixels( iter->second->getSurface(), surface ) )
+    {
+      mImages.push_back( make_shared<ImageData>( iter->second, id ) );
+      return mImages.back();
+    }
   }
   mImages.push_back( make_shared<ImageData>( surface, id ) );
+  mImagesByHash.insert( make_pair( hash, mImages.back() ) );
+  if( mOutlineVertices > 0 )
+  {
+    mImages.back()->setOutline( calculateOutline( surface, mOutlineVertices ) );
+  }
   return mImages.back();
 }
 
+void ImagePacker::setOutlineVertices( size_t max_vertices )
+{
+  mOutlineVertices = max_vertices;
+  ThreadPool::shared().parallelFor( 0, mImages.size(), 16, [&]( size_t first, size_t last )
+  {
+    for( size_t i = first; i < last; ++i )
+    {
+      ImageDataRef image = mImages[i];
+      if( !image->isAlias() )
+      {
+        image->setOutline( max_vertices > 0 ? calculateOutline( image->getSurface(), max_vertices ) : vector<Vec2f>() );
+      }
+    }
+  } );
+}
+
+size_t ImagePacker::getDuplicateCount() const
+{
+  return count_if( mImages.begin(), mImages.end(), []( const ImageDataRef &image ){ return image->isAlias(); } );
+}
+
+size_t ImagePacker::getDeduplicatedBytes() const
+{
+  size_t bytes = 0;
+  for( const ImageDataRef &image : mImages )
+  {
+    if( image->isAlias() )
+    {
+      bytes += image->getWidth() * image->getHeight() * image->getSurface().getPixelInc();
+    }
+  }
+  return bytes;
+}
+
+size_t ImagePacker::getDeduplicatedArea() const
+{
+  size_t area = 0;
+  for( const ImageDataRef &image : mImages )
+  {
+    if( image->isAlias() )
+    {
+      area += image->getWidth() * image->getHeight();
+    }
+  }
+  return area;
+}
+
+vector<ImagePacker::ImageDataRef> ImagePacker::addImages( const vector<ImageFile> &files, bool trim_alpha )
+{
+  vector<Surface> surfaces( files.size() );
+  vector<uint64_t> hashes( files.size() );
+  ThreadPool::shared().parallelFor( 0, files.size(), 1, [&]( size_t begin, size_t end )
+  {
+    for( size_t i = begin; i < end; ++i )
+    {
+      try
+      {
+        Surface surface = loadImage( files[i].second );
+        surfaces[i] = trim_alpha ? trimToOpaqueArea( surface ) : surface;
+        hashes[i] = hashPixels( surfaces[i] );
+      }
+      catch( std::exception & )
+      { // leave the surface empty; reported below on the calling thread
+      }
+    }
+  } );
+
+  vector<ImageDataRef> ret;
+  for( size_t i = 0; i < files.size(); ++i )
+  {
+    if( surfaces[i] )
+    {
+      ret.push_back( addUniqueImage( files[i].first, surfaces[i], hashes[i] ) );
+    }
+    else
+    {
+      std::cout << "ImagePacker: unable to load " << files[i].second << std::endl;
+    }
+  }
+  return ret;
+}
+
+void ImagePacker::addSequence( const string &id, const vector<Surface> &frames, int tile_size, size_t keyframe_interval )
+{
+  tile_size = math<int>::max( tile_size, 1 );
+  // diff and copy out every frame's patches in parallel, then add them in order
+  struct Patches
+  {
+    vector<Area>      areas;
+    vector<Surface>   surfaces;
+    vector<uint64_t>  hashes;
+  };
+  vector<Patches> patches( frames.size() );
+  auto is_keyframe = [keyframe_interval]( size_t frame ){ return frame == 0 || ( keyframe_interval > 0 && frame % keyframe_interval == 0 ); };
+  ThreadPool::shared().parallelFor( 0, frames.size(), 1, [&]( size_t begin, size_t end )
+  {
+    for( size_t i = begin; i < end; ++i )
+    {
+      const Surface &frame = frames[i];
+      Patches &frame_patches = patches[i];
+      if( is_keyframe( i ) )
+      {
+        frame_patches.areas.push_back( frame.getBounds() );
+      }
+      else
+      {
+        frame_patches.areas = findChangedAreas( frames[i - 1], frame, tile_size );
+      }
+      for( const Area &area : frame_patches.areas )
+      {
+        Surface patch( area.getWidth(), area.getHeight(), true, SurfaceChannelOrder::RGBA );
+        patch.copyFrom( frame, area, -area.getUL() );
+        frame_patches.hashes.push_back( hashPixels( patch ) );
+        frame_patches.surfaces.push_back( patch );
+      }
+    }
+  } );
+
+  Sequence sequence;
+  sequence.id = id;
+  sequence.size = frames.empty() ? Vec2i::zero() : frames.front().getSize();
+  for( size_t i = 0; i < frames.size(); ++i )
+  {
+    SequenceFrame frame{ is_keyframe( i ), {} };
+    for( size_t p = 0; p < patches[i].areas.size(); ++p )
+    {
+      const string patch_id = id + "-" + toString( i ) + "-" + toString( p );
+      frame.patches.push_back( SequencePatch{ addUniqueImage( patch_id, patches[i].surfaces[p], patches[i].hashes[p] ), patches[i].areas[p].getUL() } );
+    }
+    sequence.frames.push_back( frame );
+  }
+  mSequences.push_back( sequence );
+}
+
 vector<ImagePacker::ImageDataRef> ImagePacker::addGlyphs( const ci::Font &font, const string &glyphs, const string &id_prefix, bool trim_alpha )
 {
   vector<ImageDataRef> ret;
@@ -82,8 +701,24 @@ JsonTree ImagePacker::surfaceDescription()
   JsonTree description;
   JsonTree metaData = JsonTree::makeObject("meta");
   metaData.pushBack( JsonTree("created_by", "David Wicks' pockets::ImagePacker") );
-  metaData.pushBack( JsonTree("width", mWidth ) );
-  metaData.pushBack( JsonTree("height", mHeight ) );
+  metaData.pushBack( JsonTree("width", mPageSizes.front().x ) );
+  metaData.pushBack( JsonTree("height", mPageSizes.front().y ) );
+  JsonTree pages = JsonTree::makeArray("pages");
+  for( size_t i = 0; i < mPageSizes.size(); ++i )
+  {
+    JsonTree page;
+    page.pushBack( JsonTree( "id", static_cast<int>( i ) ) );
+    page.pushBack( JsonTree( "width", mPageSizes[i].x ) );
+    page.pushBack( JsonTree( "height", mPageSizes[i].y ) );
+    pages.pushBack( page );
+  }
+  metaData.pushBack( pages );
+  // identical images are listed under each of their ids, all pointing at one packed rect
+  JsonTree duplicates = JsonTree::makeObject( "duplicates" );
+  duplicates.pushBack( JsonTree( "count", static_cast<int>( getDuplicateCount() ) ) );
+  duplicates.pushBack( JsonTree( "bytes_saved", static_cast<int>( getDeduplicatedBytes() ) ) );
+  duplicates.pushBack( JsonTree( "area_saved", static_cast<int>( getDeduplicatedArea() ) ) );
+  metaData.pushBack( duplicates );
   description.pushBack( metaData );
 
   JsonTree sprites = JsonTree::makeArray("sprites");
@@ -93,109 +728,619 @@ JsonTree ImagePacker::surfaceDescription()
   }
   description.pushBack( sprites );
 
+  if( !mSequences.empty() )
+  { // each frame lists the sprites to draw over the previous frame, and where
+    JsonTree sequences = JsonTree::makeArray( "sequences" );
+    for( const Sequence &sequence : mSequences )
+    {
+      JsonTree seq;
+      seq.pushBack( JsonTree( "id", sequence.id ) );
+      seq.pushBack( JsonTree( "width", sequence.size.x ) );
+      seq.pushBack( JsonTree( "height", sequence.size.y ) );
+      JsonTree frames = JsonTree::makeArray( "frames" );
+      for( const SequenceFrame &frame : sequence.frames )
+      {
+        JsonTree f;
+        f.pushBack( JsonTree( "keyframe", frame.keyframe ) );
+        JsonTree patches = JsonTree::makeArray( "patches" );
+        for( const SequencePatch &patch : frame.patches )
+        {
+          JsonTree p;
+          p.pushBack( JsonTree( "sprite", patch.image->getId() ) );
+          p.pushBack( JsonTree( "x", patch.offset.x ) );
+          p.pushBack( JsonTree( "y", patch.offset.y ) );
+          patches.pushBack( p );
+        }
+        f.pushBack( patches );
+        frames.pushBack( f );
+      }
+      seq.pushBack( frames );
+      sequences.pushBack( seq );
+    }
+    description.pushBack( sequences );
+  }
+
   return description;
 }
 
-Surface ImagePacker::packedSurface( bool premultiply )
+EncodedImage ImagePacker::packedTexture( size_t page, PixelFormat format, bool premultiply, vector<SpriteQuality> *report )
+{
+  const Surface packed = packedSurface( page, premultiply );
+  EncodedImage image = encodeImage( packed, format );
+  if( report )
+  {
+    const Surface decoded = decodeImage( image );
+    for( ImageDataRef sprite : mImages )
+    {
+      if( sprite->getPage() == page && !sprite->isAlias() )
+      {
+        const Area bounds( sprite->getLoc(), sprite->getLoc() + sprite->getPlacedSize() );
+        report->push_back( SpriteQuality{ sprite->getId(), measurePsnr( packed, decoded, bounds ) } );
+      }
+    }
+  }
+  return image;
+}
+
+Buffer ImagePacker::binaryDescription() const
+{
+  // sorted by name so loaders can fill ordered containers (or binary search) without comparing around
+  vector<ImageDataRef> sprites( mImages );
+  stable_sort( sprites.begin(), sprites.end(), []( const ImageDataRef &lhs, const ImageDataRef &rhs )
+  {
+    return lhs->getId() < rhs->getId();
+  } );
+  size_t strings_size = 0;
+  size_t outline_size = 0;
+  for( const ImageDataRef &sprite : sprites )
+  {
+    strings_size += sprite->getId().size();
+    outline_size += sprite->getOutline().size();
+  }
+
+  atlas::Header header{ atlas::cMagic, atlas::cVersion, static_cast<uint32_t>( mPageSizes.size() ), static_cast<uint32_t>( sprites.size() ), static_cast<uint32_t>( strings_size ), static_cast<uint32_t>( outline_size ) };
+  Buffer buffer( sizeof( atlas::Header ) + mPageSizes.size() * sizeof( atlas::Page ) + sprites.size() * sizeof( atlas::Sprite ) + outline_size * sizeof( atlas::Point ) + strings_size );
+  uint8_t *out = static_cast<uint8_t*>( buffer.getData() );
+  atlas::toFileOrder( header );
+  memcpy( out, &header, sizeof( header ) );
+  out += sizeof( header );
+  for( const Vec2i &size : mPageSizes )
+  {
+    atlas::Page page{ static_cast<uint32_t>( size.x ), static_cast<uint32_t>( size.y ) };
+    atlas::toFileOrder( page );
+    memcpy( out, &page, sizeof( page ) );
+    out += sizeof( page );
+  }
+  uint32_t name_offset = 0;
+  uint32_t outline_offset = 0;
+  for( const ImageDataRef &sprite : sprites )
+  {
+    const Vec2f page_size = mPageSizes.at( sprite->getPage() );
+    const Vec2f ul = Vec2f( sprite->getLoc() ) / page_size;
+    const Vec2f lr = Vec2f( sprite->getLoc() + sprite->getPlacedSize() ) / page_size;
+    atlas::Sprite record{ name_offset, static_cast<uint32_t>( sprite->getId().size() ),
+                          ul.x, ul.y, lr.x, lr.y,
+                          sprite->getWidth(), sprite->getHeight(),
+                          static_cast<float>( sprite->getRegistrationPoint().x ), static_cast<float>( sprite->getRegistrationPoint().y ),
+                          static_cast<uint32_t>( sprite->getPage() ),
+                          sprite->isRotated() ? static_cast<uint32_t>( atlas::eRotated ) : 0u,
+                          outline_offset, static_cast<uint32_t>( sprite->getOutline().size() ) };
+    name_offset += record.name_length;
+    outline_offset += record.outline_length;
+    atlas::toFileOrder( record );
+    memcpy( out, &record, sizeof( record ) );
+    out += sizeof( record );
+  }
+  for( const ImageDataRef &sprite : sprites )
+  {
+    for( const Vec2f &point : sprite->getOutline() )
+    {
+      atlas::Point p{ point.x, point.y };
+      atlas::toFileOrder( p );
+      memcpy( out, &p, sizeof( p ) );
+      out += sizeof( p );
+    }
+  }
+  for( const ImageDataRef &sprite : sprites )
+  {
+    memcpy( out, sprite->getId().data(), sprite->getId().size() );
+    out += sprite->getId().size();
+  }
+  return buffer;
+}
+
+Surface ImagePacker::packedSurface( size_t page, bool premultiply )
 {
-  Surface output( mWidth, mHeight, true, SurfaceChannelOrder::RGBA );
-  ip::fill( &output, ColorA( 0, 0, 0, 0 ) );
+  const Vec2i size = mPageSizes.at( page );
+  Surface output( size.x, size.y, true, SurfaceChannelOrder::RGBA );
+  // sort left-to-right so each output row is written front to back in a single pass
+  vector<ImageDataRef> sprites;
   for( ImageDataRef sprite : mImages )
   {
-    output.copyFrom( sprite->getSurface(), sprite->getBounds(), sprite->getLoc() );
+    if( sprite->getPage() == page && !sprite->isAlias() )
+    { // aliases share their primary's pixels, which are drawn once
+      sprites.push_back( sprite );
+    }
   }
+  sort( sprites.begin(), sprites.end(), []( const ImageDataRef &lhs, const ImageDataRef &rhs )
+  {
+    return lhs->getLoc().x < rhs->getLoc().x;
+  } );
+
   // XCode premultiplies anything going to an iOS device (ignores flag telling it not to)
   // Double-premultiplication makes everything have dark edges
   // So we'll just premultiply on the client side if the graphics aren't already
-  if( premultiply )
+  uint8_t *data = output.getData();
+  const int32_t row_bytes = output.getRowBytes();
+  ThreadPool::shared().parallelFor( 0, size.y, 32, [&]( size_t first_row, size_t last_row )
+  { // every pixel in the band is written once: gaps are cleared and sprites copied in the same sweep
+    vector<ImageData*> band;
+    for( const ImageDataRef &sprite : sprites )
+    {
+      const int top = sprite->getLoc().y;
+      if( top < static_cast<int>( last_row ) && top + sprite->getPlacedSize().y > static_cast<int>( first_row ) )
+      {
+        band.push_back( sprite.get() );
+      }
+    }
+    for( int y = first_row; y < static_cast<int>( last_row ); ++y )
+    {
+      uint8_t *row = data + y * row_bytes;
+      int x = 0;
+      for( ImageData *sprite : band )
+      {
+        const Vec2i loc = sprite->getLoc();
+        const Vec2i placed_size = sprite->getPlacedSize();
+        if( y < loc.y || y >= loc.y + placed_size.y )
+        {
+          continue;
+        }
+        // clip against the page and anything already written to this row
+        const int left = math<int>::max( loc.x, x );
+        const int right = math<int>::min( loc.x + placed_size.x, size.x );
+        if( right <= left )
+        {
+          continue;
+        }
+        memset( row + x * 4, 0, ( left - x ) * 4 );
+        // page pixel (x, y) of a rotated sprite comes from source pixel (y, height - 1 - x)
+        const Vec2i src_loc = sprite->isRotated() ? Vec2i( y - loc.y, sprite->getHeight() - 1 - ( left - loc.x ) ) : Vec2i( left - loc.x, y - loc.y );
+        blitRow( sprite->getSurface(), src_loc, right - left, row + left * 4, premultiply, sprite->isRotated() );
+        x = right;
+      }
+      memset( row + x * 4, 0, ( size.x - x ) * 4 );
+    }
+  } );
+  output.setPremultiplied( premultiply );
+  return output;
+}
+
+bool ImagePacker::paginate( int width, const PageFn &place_page, bool tight )
+{
+  if( mMaxPageSize.x > 0 )
   {
-    ip::premultiply( &output );
+    width = math<int>::min( width, mMaxPageSize.x );
   }
-  return output;
+  const int max_height = mMaxPageSize.y > 0 ? mMaxPageSize.y : numeric_limits<int>::max();
+  mPageSizes.clear();
+  // duplicates follow their primary image, so only unique images need a place
+  vector<ImageDataRef> remaining;
+  copy_if( mImages.begin(), mImages.end(), back_inserter( remaining ), []( const ImageDataRef &image ){ return !image->isAlias(); } );
+  while( !remaining.empty() )
+  {
+    vector<ImageDataRef> overflow = place_page( remaining, width, max_height );
+    if( chrono::steady_clock::now() > mDeadline )
+    { // engines give up on the rest of the images once time is up
+      return false;
+    }
+    if( overflow.size() == remaining.size() )
+    { // nothing fits on an empty page, so the first image is larger than a page
+      // give it a page of its own rather than looping forever
+      std::cout << "ImagePacker: " << overflow.front()->getId() << " is larger than the maximum page size" << std::endl;
+      overflow.front()->setLoc( Vec2i::zero() );
+      overflow.erase( overflow.begin() );
+    }
+    const size_t page = mPageSizes.size();
+    int right = tight ? 1 : width;
+    int bottom = 0;
+    // whatever didn't overflow was placed on this page
+    unordered_set<const ImageData*> unplaced;
+    unplaced.reserve( overflow.size() );
+    for( const ImageDataRef &image : overflow )
+    {
+      unplaced.insert( image.get() );
+    }
+    for( const ImageDataRef &sprite : remaining )
+    {
+      if( unplaced.count( sprite.get() ) == 0 )
+      {
+        sprite->setPage( page );
+        right = math<int>::max( right, sprite->getLoc().x + sprite->getPlacedSize().x );
+        bottom = math<int>::max( bottom, sprite->getLoc().y + sprite->getPlacedSize().y );
+      }
+    }
+    const int height = tight ? bottom : math<int>::min( math<int>::max( bottom, width ), math<int>::max( bottom, max_height ) );
+    mPageSizes.push_back( Vec2i( right, height ) );
+    remaining.swap( overflow );
+  }
+  if( mPageSizes.empty() )
+  {
+    mPageSizes.push_back( Vec2i( width, 1 ) );
+  }
+  return true;
 }
 
-void ImagePacker::calculatePositions( const ci::Vec2i &padding, const int width )
+bool ImagePacker::pack( const PackConfig &config, const Vec2i &padding, bool tight )
 {
-  //  auto rev_area_compare = []( const ImageData &lhs, const ImageData &rhs )
-  //  {
-  //    return lhs.getBounds().calcArea() > rhs.getBounds().calcArea();
-  //  };
-  auto rev_height_compare = []( const ImageDataRef &lhs, const ImageDataRef &rhs )
+  // rows and scanline keep shelves short by laying images on their long side, if that still fits the width
+  // MaxRects chooses each image's orientation as it goes
+  const bool allow_rotation = mAllowRotation;
+  for( ImageDataRef &image : mImages )
   {
-    return lhs->getBounds().getHeight() > rhs->getBounds().getHeight();
-  };
-  sort( mImages.begin(), mImages.end(), rev_height_compare );
-  Vec2i loc( 0, 0 );
-  int bottom_y = 0;
-  for( ImageDataRef sprite : mImages )
+    image->setRotated( allow_rotation && config.engine != eEngineMaxRects && image->getHeight() > image->getWidth() && image->getHeight() <= config.width );
+  }
+  switch( config.order )
   {
-    if( loc.x + sprite->getBounds().getWidth() > width )
+    case eSortHeight:
+      stable_sort( mImages.begin(), mImages.end(), []( const ImageDataRef &lhs, const ImageDataRef &rhs )
+      {
+        return lhs->getPlacedSize().y > rhs->getPlacedSize().y;
+      } );
+    break;
+    case eSortArea:
+      stable_sort( mImages.begin(), mImages.end(), []( const ImageDataRef &lhs, const ImageDataRef &rhs )
+      {
+        return lhs->getWidth() * lhs->getHeight() > rhs->getWidth() * rhs->getHeight();
+      } );
+    break;
+    case eSortPerimeter:
+      stable_sort( mImages.begin(), mImages.end(), []( const ImageDataRef &lhs, const ImageDataRef &rhs )
+      {
+        return lhs->getWidth() + lhs->getHeight() > rhs->getWidth() + rhs->getHeight();
+      } );
+    break;
+    case eSortMaxSide:
+      // longest side first gives the free list the most room to work with
+      stable_sort( mImages.begin(), mImages.end(), []( const ImageDataRef &lhs, const ImageDataRef &rhs )
+      {
+        return math<int>::max( lhs->getWidth(), lhs->getHeight() ) > math<int>::max( rhs->getWidth(), rhs->getHeight() );
+      } );
+    break;
+  }
+  const auto deadline = mDeadline;
+  auto expired = [deadline](){ return chrono::steady_clock::now() > deadline; };
+
+  switch( config.engine )
+  {
+    case eEngineRows:
+      return paginate( config.width, [padding, expired]( const vector<ImageDataRef> &images, int width, int max_height )
+      {
+        vector<ImageDataRef> overflow;
+        Vec2i loc( 0, 0 );
+        int bottom_y = 0;
+        for( ImageDataRef sprite : images )
+        {
+          if( !overflow.empty() || expired() )
+          { // rows fill in order, so once one is full everything else waits for the next page
+            overflow.push_back( sprite );
+            continue;
+          }
+          const Vec2i size = sprite->getPlacedSize();
+          if( loc.x + size.x > width )
+          {
+            loc.y = bottom_y + padding.y;
+            loc.x = 0;
+          }
+          if( loc.y + size.y > max_height )
+          {
+            overflow.push_back( sprite );
+            continue;
+          }
+          sprite->setLoc( loc );
+          loc.x += size.x + padding.x;
+          bottom_y = math<int>::max( size.y + loc.y, bottom_y );
+        }
+        return overflow;
+      }, tight );
+    case eEngineScanline:
+      return paginate( config.width, [padding, expired]( const vector<ImageDataRef> &images, int width, int max_height )
+      {
+        vector<ImageDataRef> placed;
+        vector<ImageDataRef> overflow;
+        for( ImageDataRef img : images )
+        {
+          const Vec2i size = img->getPlacedSize();
+          if( size.y + padding.y * 2 > max_height || expired() )
+          {
+            overflow.push_back( img );
+            continue;
+          }
+          if( placed.empty() )
+          { // place largest image at top-left
+            img->setLoc( padding );
+            placed.push_back( img );
+            continue;
+          }
+          // for each following image, start at top-left and look on each
+          // pixel row for a potential free space
+          Vec2i loc{ padding };
+          bool done = false;
+          bool fits = true;
+          while ( !done && fits )
+          {
+            for( ImageDataRef other : placed )
+            { // check whether we're inside the bounds of any placed image (including padding)
+              auto bounds = other->getPlacedBounds().inflated( padding );
+              if( bounds.contains( loc ) )
+              { // jump to right edge of image
+                loc.x = bounds.getX2();
+              }
+            }
+
+            if( loc.x + size.x < width - padding.x )
+            { // we fit on the page, though we may still overlap other images
+              // tentatively set the image location here
+              img->setLoc( loc );
+              done = true;
+              // shrink potential bounds by one, since sharing a vertex counts as Rectf intersecting
+              auto potential_bounds = img->getPlacedBounds().inflated( { -1, -1 } );
+              for( ImageDataRef other : placed )
+              { // check that the placed boundaries don't overlap any other placed image
+                auto bounds = other->getPlacedBounds().inflated( padding );
+                if( potential_bounds.intersects( bounds ) )
+                { // a collision was found, so we'll continue the loop
+                  done = false;
+                }
+              }
+            }
+            // move to next row of pixels for continued evaluation
+            loc.x = padding.x;
+            loc.y += 1;
+            // stop once the image would hang off the bottom of the page
+            fits = loc.y + size.y + padding.y <= max_height;
+          }
+          if( done )
+          {
+            placed.push_back( img );
+          }
+          else
+          {
+            overflow.push_back( img );
+          }
+        }
+        return overflow;
+      }, tight );
+    case eEngineMaxRects:
     {
-      loc.y = bottom_y + padding.y;
-      loc.x = 0;
+      const bool widen = mMaxPageSize.x <= 0;
+      const MaxRectsPacker::Heuristic heuristic = config.heuristic;
+      return paginate( config.width, [padding, heuristic, widen, allow_rotation, expired]( const vector<ImageDataRef> &images, int width, int max_height )
+      {
+        // pad the right and bottom of every image; the bin gets matching extra room
+        // so images can sit flush against the right edge of the sheet
+        int bin_width = width;
+        int64_t padded_area = 0;
+        int64_t stacked_height = 0;
+        int tallest = 0;
+        for( ImageDataRef sprite : images )
+        {
+          if( widen )
+          { // without a page limit, make room for images wider than requested
+            bin_width = math<int>::max( bin_width, sprite->getWidth() );
+          }
+          padded_area += static_cast<int64_t>( sprite->getWidth() + padding.x ) * ( sprite->getHeight() + padding.y );
+          const int height = allow_rotation ? math<int>::min( sprite->getWidth(), sprite->getHeight() ) : sprite->getHeight();
+          tallest = math<int>::max( tallest, height + padding.y );
+          stacked_height += math<int>::max( sprite->getWidth(), sprite->getHeight() ) + padding.y;
+        }
+        bin_width += padding.x;
+        // a bin as tall as every image stacked up is as far as growing needs to go
+        const int64_t grow_limit = min<int64_t>( stacked_height, numeric_limits<int>::max() / 2 );
+        const bool constrained = max_height < numeric_limits<int>::max();
+        // without a page limit, start from a perfect-occupancy guess and grow the bin until everything fits
+        int bin_height = constrained ? max_height + padding.y : math<int>::max( tallest, static_cast<int>( ( padded_area + bin_width - 1 ) / bin_width ) );
+        vector<ImageDataRef> overflow;
+        bool placed_all = false;
+        while( !placed_all )
+        {
+          MaxRectsPacker packer( bin_width, bin_height );
+          overflow.clear();
+          placed_all = true;
+          for( ImageDataRef sprite : images )
+          {
+            Area placed;
+            if( expired() )
+            {
+              overflow.push_back( sprite );
+            }
+            else if( packer.insert( sprite->getSize() + padding, heuristic, &placed, allow_rotation ) )
+            {
+              sprite->setLoc( placed.getUL() );
+              sprite->setRotated( placed.getWidth() != sprite->getWidth() + padding.x );
+            }
+            else if( constrained || bin_height >= grow_limit || tooWide( sprite->getSize() + padding, bin_width, allow_rotation ) )
+            { // save it for the next page; paginate gives images wider than a page one of their own
+              overflow.push_back( sprite );
+            }
+            else
+            {
+              placed_all = false;
+              break;
+            }
+          }
+          bin_height += bin_height / 32 + 1;
+        }
+        return overflow;
+      }, tight );
     }
-    sprite->setLoc( loc );
-    loc.x += sprite->getBounds().getWidth() + padding.x;
-    bottom_y = math<int>::max( sprite->getBounds().getHeight() + loc.y, bottom_y );
   }
-  mWidth = width;
-  mHeight = math<int>::max( bottom_y, width );
+  return false;
+}
+
+void ImagePacker::calculatePositions( const ci::Vec2i &padding, const int width )
+{
+  pack( PackConfig{ eEngineRows, MaxRectsPacker::eBestShortSideFit, eSortHeight, width }, padding, false );
 }
 
 void ImagePacker::calculatePositionsScanline( const Vec2i &padding, const int width )
 {
-  // auto rev_area_compare = []( const ImageDataRef &lhs, const ImageDataRef &rhs )
-  // {
-  //   return lhs->getBounds().calcArea() > rhs->getBounds().calcArea();
-  // }
-  auto rev_height_compare = []( const ImageDataRef &lhs, const ImageDataRef &rhs )
+  pack( PackConfig{ eEngineScanline, MaxRectsPacker::eBestShortSideFit, eSortHeight, width }, padding, false );
+}
+
+void ImagePacker::calculatePositionsMaxRects( const Vec2i &padding, const int width, MaxRectsPacker::Heuristic heuristic )
+{
+  pack( PackConfig{ eEngineMaxRects, heuristic, eSortMaxSide, width }, padding, false );
+}
+
+ImagePacker::PackResult ImagePacker::packBest( double budget_ms, const Vec2i &padding )
+{
+  const auto start = chrono::steady_clock::now();
+  vector<ImageDataRef> unique;
+  copy_if( mImages.begin(), mImages.end(), back_inserter( unique ), []( const ImageDataRef &image ){ return !image->isAlias(); } );
+
+  // candidate widths bracket a square sheet; a page limit caps them
+  int64_t padded_area = 0;
+  int widest = 1;
+  for( const ImageDataRef &image : unique )
   {
-    return lhs->getBounds().getHeight() > rhs->getBounds().getHeight();
-  };
-  sort( mImages.begin(), mImages.end(), rev_height_compare );
-  int bottom_y = 0;
-  // place largest image at top-left
-  mImages.at( 0 )->setLoc( padding );
-  for( int i = 1; i < mImages.size(); ++i )
-  { // for each following image, start at top-left and look on each
-    // pixel row for a potential free space
-    Vec2i loc{ padding };
-    auto img = mImages.at( i );
-    bool placed = false;
-    while ( !placed )
-    {
-      for( int j = 0; j < i; ++j )
-      { // check whether we're inside the bounds of any placed image (including padding)
-        auto bounds = mImages.at( j )->getPlacedBounds().inflated( padding );
-        if( bounds.contains( loc ) )
-        { // jump to right edge of image
-          loc.x = bounds.getX2();
-        }
-      }
-      
-      if( loc.x + img->getWidth() < width - padding.x )
-      { // we fit on the page, though we may still overlap other images
-        // tentatively set the image location here
-        img->setLoc( loc );
-        placed = true;
-        // shrink potential bounds by one, since sharing a vertex counts as Rectf intersecting
-        auto potential_bounds = img->getPlacedBounds().inflated( { -1, -1 } );
-        for( int j = 0; j < i; ++j )
-        { // check that the placed boundaries don't overlap any other placed image
-          auto bounds = mImages.at( j )->getPlacedBounds().inflated( padding );
-          if( potential_bounds.intersects( bounds ) )
-          { // a collision was found, so we'll continue the loop
-            placed = false;
-          }
+    padded_area += static_cast<int64_t>( image->getWidth() + padding.x * 2 ) * ( image->getHeight() + padding.y * 2 );
+    widest = math<int>::max( widest, image->getWidth() + padding.x * 2 );
+  }
+  vector<int> widths;
+  for( float aspect : { 0.5f, 0.7f, 0.85f, 1.0f, 1.2f, 1.4f, 2.0f } )
+  {
+    int width = math<int>::max( widest, static_cast<int>( math<float>::sqrt( static_cast<float>( padded_area ) ) * aspect ) );
+    if( mMaxPageSize.x > 0 )
+    {
+      width = math<int>::min( width, mMaxPageSize.x );
+    }
+    if( find( widths.begin(), widths.end(), width ) == widths.end() )
+    {
+      widths.push_back( width );
+    }
+  }
+
+  // cheapest engines first so a short budget still sees plenty of candidates; scanline is slowest by far
+  vector<PackConfig> configs;
+  for( int engine = eEngineMaxRects; engine >= eEngineRows; --engine )
+  {
+    const int heuristics = engine == eEngineMaxRects ? MaxRectsPacker::eContactPoint + 1 : 1;
+    for( int heuristic = 0; heuristic < heuristics; ++heuristic )
+    {
+      for( int order = eSortHeight; order <= eSortMaxSide; ++order )
+      {
+        for( int width : widths )
+        {
+          configs.push_back( PackConfig{ static_cast<Engine>( engine ), static_cast<MaxRectsPacker::Heuristic>( heuristic ), static_cast<SortOrder>( order ), width } );
         }
-        bottom_y = math<int>::max( img->getBounds().getHeight() + loc.y, bottom_y );
       }
-      // move to next row of pixels for continued evaluation
-      loc.x = padding.x;
-      loc.y += 1;
     }
   }
-  mWidth = width;
-  mHeight = math<int>::max( bottom_y, width );
+
+  struct Trial
+  {
+    int64_t                 area = numeric_limits<int64_t>::max();
+    size_t                  config = 0;
+    vector<Vec2i>           locs;
+    vector<size_t>          pages;
+    vector<bool>            rotated;
+    vector<ci::Vec2i>       page_sizes;
+  };
+  Trial best;
+  mutex best_mutex;
+  atomic<size_t> tried( 0 );
+  const auto deadline = start + chrono::microseconds( static_cast<int64_t>( budget_ms * 1000.0 ) );
+  auto run = [&]( size_t index, chrono::steady_clock::time_point trial_deadline )
+  {
+    if( chrono::steady_clock::now() > trial_deadline )
+    {
+      return;
+    }
+    // each trial works on its own copies so trials can't disturb each other or the real images
+    ImagePacker trial;
+    trial.mMaxPageSize = mMaxPageSize;
+    trial.mAllowRotation = mAllowRotation;
+    trial.mDeadline = trial_deadline;
+    for( const ImageDataRef &image : unique )
+    {
+      trial.mImages.push_back( make_shared<ImageData>( image->getSurface(), image->getId() ) );
+    }
+    // remember the original position of each copy, since packing reorders them
+    map<ImageData*, size_t> index_of;
+    for( size_t i = 0; i < trial.mImages.size(); ++i )
+    {
+      index_of[trial.mImages[i].get()] = i;
+    }
+    if( !trial.pack( configs[index], padding, true ) )
+    {
+      return;
+    }
+    tried += 1;
+    int64_t area = 0;
+    for( const Vec2i &size : trial.mPageSizes )
+    {
+      area += static_cast<int64_t>( size.x ) * size.y;
+    }
+    lock_guard<mutex> lock( best_mutex );
+    if( area < best.area || ( area == best.area && index < best.config ) )
+    {
+      best.area = area;
+      best.config = index;
+      best.locs.assign( unique.size(), Vec2i::zero() );
+      best.pages.assign( unique.size(), 0 );
+      best.rotated.assign( unique.size(), false );
+      for( const ImageDataRef &image : trial.mImages )
+      {
+        const size_t i = index_of[image.get()];
+        best.locs[i] = image->getLoc();
+        best.pages[i] = image->getPage();
+        best.rotated[i] = image->isRotated();
+      }
+      best.page_sizes = trial.mPageSizes;
+    }
+  };
+  // make sure there is always an answer, no matter how small the budget
+  run( 0, chrono::steady_clock::time_point::max() );
+  ThreadPool::shared().parallelFor( 1, configs.size(), 1, [&]( size_t begin, size_t end )
+  {
+    for( size_t i = begin; i < end; ++i )
+    {
+      run( i, deadline );
+    }
+  } );
+
+  for( size_t i = 0; i < unique.size(); ++i )
+  {
+    unique[i]->setLoc( best.locs[i] );
+    unique[i]->setPage( best.pages[i] );
+    unique[i]->setRotated( best.rotated[i] );
+  }
+  mPageSizes = best.page_sizes;
+
+  PackResult result;
+  result.config = configs[best.config];
+  result.area = best.area;
+  int64_t image_area = 0;
+  for( const ImageDataRef &image : unique )
+  {
+    image_area += static_cast<int64_t>( image->getWidth() ) * image->getHeight();
+  }
+  result.occupancy = best.area > 0 ? static_cast<double>( image_area ) / best.area : 0.0;
+  result.configs_tried = tried;
+  result.configs_total = configs.size();
+  result.milliseconds = chrono::duration<double, milli>( chrono::steady_clock::now() - start ).count();
+  return result;
 }
 
+string ImagePacker::PackConfig::getDescription() const
+{
+  const char *engines[] = { "rows", "scanline", "maxrects" };
+  const char *heuristics[] = { "best short side fit", "best area fit", "bottom left", "contact point" };
+  const char *orders[] = { "height", "area", "perimeter", "max side" };
+  string description = engines[engine];
+  if( engine == eEngineMaxRects )
+  {
+    description += string( " (" ) + heuristics[heuristic] + ")";
+  }
+  return description + ", sorted by " + orders[order] + ", " + toString( width ) + "px wide";
+}
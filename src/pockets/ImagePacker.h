@@ -27,10 +27,17 @@
 
 #pragma once
 #include "Pockets.h"
+#include "Packing.h"
+#include "PixelFormat.h"
 #include "cinder/Json.h"
+#include "cinder/Buffer.h"
 #include "cinder/Surface.h"
 #include "cinder/Rect.h"
 #include "cinder/Font.h"
+#include "cinder/Filesystem.h"
+#include <chrono>
+#include <functional>
+#include <unordered_map>
 
 namespace pockets
 {
@@ -40,6 +47,13 @@ namespace pockets
  Place all elements, largest-first, into a single Surface
  Height expands to fit
 
+ If a maximum page size is set, images that don't fit on the first page
+ spill onto additional pages, each generated as its own Surface.
+
+ With rotation allowed, images may be stored turned 90 degrees clockwise.
+ The description marks them "rotated": true; TextureAtlas turns their
+ texture coordinates back so they draw upright.
+
  Though spritesheet generation is generally an offline task, it
  could be useful for things like super-8-style-recording and gif-playback
 */
@@ -58,11 +72,31 @@ class ImagePacker
     mSurface( surface )
     , mId( id )
     {}
-    ci::Rectf           getPlacedBounds() const { return mSurface.getBounds() + getLoc(); }
+    //! an image whose pixels are identical to \a primary's; it shares the primary's packed location
+    ImageData( const std::shared_ptr<ImageData> &primary, const std::string &id ):
+    mSurface( primary->getSurface() )
+    , mPrimary( primary )
+    , mId( id )
+    {}
+    ci::Rectf           getPlacedBounds() const { return ci::Rectf( ci::Vec2f::zero(), getPlacedSize() ) + getLoc(); }
     ci::Area            getBounds() const { return mSurface.getBounds(); }
     const ci::Surface&  getSurface() const { return mSurface; }
-    ci::Vec2i           getLoc() const { return mLoc; }
+    ci::Vec2i           getLoc() const { return mPrimary ? mPrimary->getLoc() : mLoc; }
     void                setLoc( const ci::Vec2i &loc ){ mLoc = loc; }
+    //! index of the page this image is packed on
+    size_t              getPage() const { return mPrimary ? mPrimary->getPage() : mPage; }
+    void                setPage( size_t page ){ mPage = page; }
+    //! true if the image is stored turned 90 degrees clockwise
+    bool                isRotated() const { return mPrimary ? mPrimary->isRotated() : mRotated; }
+    void                setRotated( bool rotated ){ mRotated = rotated; }
+    //! size of the image as stored on the page, swapped if rotated
+    ci::Vec2i           getPlacedSize() const { return isRotated() ? ci::Vec2i( getHeight(), getWidth() ) : getSize(); }
+    //! true if this image duplicates another and isn't packed on its own
+    bool                isAlias() const { return mPrimary != nullptr; }
+    //! convex outline around the image's visible pixels, in upright image pixels
+    //! empty when the image is best drawn as a plain quad
+    const std::vector<ci::Vec2f>& getOutline() const { return mPrimary ? mPrimary->getOutline() : mOutline; }
+    void                setOutline( const std::vector<ci::Vec2f> &outline ){ mOutline = outline; }
     void                setRegistrationPoint( const ci::Vec2i &reg ){ mRegistrationPoint = reg; }
     ci::Vec2i           getRegistrationPoint() const { return mRegistrationPoint; }
     ci::Vec2i           getSize() const { return mSurface.getSize(); }
@@ -73,48 +107,176 @@ class ImagePacker
     {
       using ci::JsonTree;
       JsonTree tree;
+      // aliases report their primary's placement
+      const ci::Vec2i loc = getLoc();
       tree.pushBack( JsonTree( "id", mId ) );
-      tree.pushBack( JsonTree( "x1", mLoc.x ) );
-      tree.pushBack( JsonTree( "y1", mLoc.y ) );
-      tree.pushBack( JsonTree( "x2", mLoc.x + getBounds().getWidth() ) );
-      tree.pushBack( JsonTree( "y2", mLoc.y + getBounds().getHeight() ) );
+      tree.pushBack( JsonTree( "x1", loc.x ) );
+      tree.pushBack( JsonTree( "y1", loc.y ) );
+      tree.pushBack( JsonTree( "x2", loc.x + getPlacedSize().x ) );
+      tree.pushBack( JsonTree( "y2", loc.y + getPlacedSize().y ) );
+      tree.pushBack( JsonTree( "rotated", isRotated() ) );
       tree.pushBack( JsonTree( "rx", mRegistrationPoint.x ) );
       tree.pushBack( JsonTree( "ry", mRegistrationPoint.y ) );
+      tree.pushBack( JsonTree( "page", static_cast<int>( getPage() ) ) );
+      if( !getOutline().empty() )
+      {
+        JsonTree outline = JsonTree::makeArray( "outline" );
+        for( const ci::Vec2f &point : getOutline() )
+        {
+          JsonTree p;
+          p.pushBack( JsonTree( "x", point.x ) );
+          p.pushBack( JsonTree( "y", point.y ) );
+          outline.pushBack( p );
+        }
+        tree.pushBack( outline );
+      }
       return tree;
     }
   private:
     ci::Surface     mSurface;
     ci::Vec2i       mLoc = ci::Vec2i::zero();
     ci::Vec2i       mRegistrationPoint = ci::Vec2i::zero();
+    size_t          mPage = 0;
+    bool            mRotated = false;
+    std::vector<ci::Vec2f> mOutline;
+    std::shared_ptr<ImageData> mPrimary;
     std::string     mId;
   };
   typedef std::shared_ptr<ImageData> ImageDataRef;
+  //! a sprite id and the image file to load it from
+  typedef std::pair<std::string, ci::fs::path> ImageFile;
+  //! order images are offered to the packing engine, largest first
+  enum SortOrder { eSortHeight, eSortArea, eSortPerimeter, eSortMaxSide };
+  enum Engine { eEngineRows, eEngineScanline, eEngineMaxRects };
+  //! one way of packing the images; the heuristic only matters to the MaxRects engine
+  struct PackConfig
+  {
+    Engine                    engine;
+    MaxRectsPacker::Heuristic heuristic;
+    SortOrder                 order;
+    int                       width;
+    //! human-readable summary, e.g. "maxrects (contact point), sorted by area, 512px wide"
+    std::string               getDescription() const;
+  };
+  //! outcome of packBest
+  struct PackResult
+  {
+    PackConfig  config;         // winning configuration
+    int64_t     area;           // total area of all pages, in pixels
+    double      occupancy;      // fraction of that area covered by images
+    size_t      configs_tried;  // configurations that finished within the budget
+    size_t      configs_total;  // configurations considered
+    double      milliseconds;   // time spent searching
+  };
+  //! how closely a sprite survived conversion to a reduced pixel format
+  struct SpriteQuality
+  {
+    std::string id;
+    double      psnr;           // decibels; infinite where lossless
+  };
 	ImagePacker();
 	~ImagePacker();
   //! add an image to the sheet. If trim_alpha, trims image bounds to non-alpha area
+  //! images whose (trimmed) pixels match an earlier image are packed once and share its rect
   ImageDataRef              addImage( const std::string &id, ci::Surface surface, bool trim_alpha=false );
+  //! load, decode, and optionally trim a batch of image files on the shared ThreadPool
+  //! images are added in the order given; files that fail to load are reported and skipped
+  std::vector<ImageDataRef> addImages( const std::vector<ImageFile> &files, bool trim_alpha=false );
   //! add the specified glyphs from a font; id is equal to the character, e.g. "a"
   std::vector<ImageDataRef> addGlyphs( const ci::Font &font, const std::string &glyphs, const std::string &id_prefix="", bool trim_alpha=false );
   //! add the specified string set in a font
   ImageDataRef              addString( const std::string &id, const ci::Font &font, const std::string &str, bool trim_alpha=false );
+  //! add a recorded frame sequence, e.g. for super-8 recording or gif playback
+  //! keyframes (the first frame, then one every \a keyframe_interval frames; 0 for only the first) are stored whole
+  //! other frames store only the areas that changed since the previous frame, found on a grid of \a tile_size
+  //! patches are ordinary images with ids like "<id>-<frame>-<patch>"; see FrameSequencePlayer for playback
+  void                      addSequence( const std::string &id, const std::vector<ci::Surface> &frames, int tile_size=16, size_t keyframe_interval=0 );
+  //! limit the size of each page; images that don't fit go onto additional pages
+  //! pass zero for either dimension to leave it unconstrained (the default)
+  void                      setMaxPageSize( int max_width, int max_height ) { mMaxPageSize.set( max_width, max_height ); }
+  //! let images be stored turned 90 degrees clockwise when that packs tighter (off by default)
+  //! rows and scanline lay every image on its long side; MaxRects tries both ways for each image
+  void                      setAllowRotation( bool allow ) { mAllowRotation = allow; }
+  bool                      getAllowRotation() const { return mAllowRotation; }
   //! assign positions to images
   void                      calculatePositions( const ci::Vec2i &padding, const int width=1024 );
   //! use a scanline algorithm to calculate positions (slower to run, more compact)
   void                      calculatePositionsScanline( const ci::Vec2i &padding, const int width=1024 );
+  //! use a MaxRects free-list to calculate positions (fast to run, most compact)
+  void                      calculatePositionsMaxRects( const ci::Vec2i &padding, const int width=1024, MaxRectsPacker::Heuristic heuristic=MaxRectsPacker::eBestShortSideFit );
+  //! try every sort order, engine, and a range of widths in parallel, keeping the smallest tightly-fit result
+  //! configurations that don't finish within \a budget_ms are dropped; the first one always runs to completion
+  //! pages are cropped to their contents rather than padded out to a square
+  PackResult                packBest( double budget_ms, const ci::Vec2i &padding=ci::Vec2i( 1, 1 ) );
   //! generates a surface containing all added images in their packed locations
   //! premultiply unless you are using this spritesheet on iOS, in which case XCode will do that later
-  ci::Surface               packedSurface( bool premultiply=false );
+  ci::Surface               packedSurface( bool premultiply=false ) { return packedSurface( 0, premultiply ); }
+  //! generates a surface containing the images packed on \a page
+  //! bands of rows are filled in parallel, with clearing and premultiplication done in the same pass
+  ci::Surface               packedSurface( size_t page, bool premultiply );
+  //! the packed surface of \a page in \a format, ready for writeKtx
+  //! if \a report is given, the PSNR of every sprite on the page is appended to it
+  EncodedImage              packedTexture( size_t page, PixelFormat format, bool premultiply, std::vector<SpriteQuality> *report=nullptr );
+  //! outline each image with a polygon of at most \a max_vertices, for drawing with less overdraw
+  //! images whose outline wouldn't save much area over their quad keep none; zero turns outlines off
+  void                      setOutlineVertices( size_t max_vertices );
+  size_t                    getOutlineVertices() const { return mOutlineVertices; }
+  //! number of pages needed to hold all the images
+  size_t                    getPageCount() const { return mPageSizes.size(); }
+  ci::Vec2i                 getPageSize( size_t page ) const { return mPageSizes.at( page ); }
   //! returns a JSON-formatted description of all images and their packed locations
   ci::JsonTree              surfaceDescription();
+  //! returns the same sprite descriptions in the binary format of AtlasFormat.h, for fast loading
+  //! sequences are only described in JSON
+  ci::Buffer                binaryDescription() const;
+  //! number of images that duplicated an earlier image's pixels
+  size_t                    getDuplicateCount() const;
+  //! pixel bytes that didn't need to be stored or packed thanks to duplicate detection
+  size_t                    getDeduplicatedBytes() const;
+  //! atlas area, in pixels, that duplicates would otherwise have taken (excluding padding)
+  size_t                    getDeduplicatedArea() const;
   //! remove all images from packer
-  void                      clear() { mImages.clear(); }
+  void                      clear() { mImages.clear(); mImagesByHash.clear(); mSequences.clear(); }
   std::vector<ImageDataRef>::iterator begin(){ return mImages.begin(); }
   std::vector<ImageDataRef>::iterator end(){ return mImages.end(); }
 private:
-  //! width should be set to maximum desired width
-  uint32_t                  mWidth = 1024;
-  //! height expands as elements are added
-  uint32_t                  mHeight = 1;
+  //! size of each page; width is set to maximum desired width, height expands as elements are added
+  std::vector<ci::Vec2i>    mPageSizes = { ci::Vec2i( 1024, 1 ) };
+  //! zero components are unconstrained
+  ci::Vec2i                 mMaxPageSize = ci::Vec2i::zero();
+  bool                      mAllowRotation = false;
+  size_t                    mOutlineVertices = 0;
   std::vector<ImageDataRef> mImages;
+  //! unique images, keyed by a hash of their pixels
+  std::unordered_multimap<uint64_t, ImageDataRef> mImagesByHash;
+  //! a changed area of a sequence frame and where it goes in the reconstructed frame
+  struct SequencePatch
+  {
+    ImageDataRef  image;
+    ci::Vec2i     offset;
+  };
+  struct SequenceFrame
+  {
+    bool                        keyframe;
+    std::vector<SequencePatch>  patches;
+  };
+  struct Sequence
+  {
+    std::string                 id;
+    ci::Vec2i                   size;
+    std::vector<SequenceFrame>  frames;
+  };
+  std::vector<Sequence>     mSequences;
+  //! adds \a surface, or an alias if an identical image was already added
+  ImageDataRef              addUniqueImage( const std::string &id, const ci::Surface &surface, uint64_t hash );
+  //! positions \a images on a single page no taller than \a max_height, returning the ones that didn't fit
+  typedef std::function<std::vector<ImageDataRef> ( const std::vector<ImageDataRef> &images, int width, int max_height )> PageFn;
+  //! runs \a place_page on successive pages until every image has a place
+  //! tight pages are cropped to their contents; returns false if packing ran past mDeadline
+  bool                      paginate( int width, const PageFn &place_page, bool tight );
+  //! sorts images and places them according to \a config
+  bool                      pack( const PackConfig &config, const ci::Vec2i &padding, bool tight );
+  //! engines abandon packing after this time; only set for packBest trials
+  std::chrono::steady_clock::time_point mDeadline = std::chrono::steady_clock::time_point::max();
 };
 } // ns pockets
\ No newline at end of file
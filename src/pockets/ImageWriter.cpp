@@ -0,0 +1,939 @@
+/*
+ * Copyright (c) 2013 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "ImageWriter.h"
+#include "ThreadPool.h"
+#include "cinder/DataTarget.h"
+#include <algorithm>
+#include <array>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+using namespace ci;
+using namespace std;
+using namespace pockets;
+
+namespace
+{
+  //
+  // Checksums
+  //
+
+  const array<uint32_t, 256>& crcTable()
+  {
+    static const array<uint32_t, 256> table = []()
+    {
+      array<uint32_t, 256> t;
+      for( uint32_t n = 0; n < 256; ++n )
+      {
+        uint32_t c = n;
+        for( int k = 0; k < 8; ++k )
+        {
+          c = ( c & 1 ) ? 0xEDB88320u ^ ( c >> 1 ) : c >> 1;
+        }
+        t[n] = c;
+      }
+      return t;
+    }();
+    return table;
+  }
+
+  uint32_t crc32( const uint8_t *data, size_t size, uint32_t crc = 0 )
+  {
+    const array<uint32_t, 256> &table = crcTable();
+    crc = ~crc;
+    for( size_t i = 0; i < size; ++i )
+    {
+      crc = table[( crc ^ data[i] ) & 0xFF] ^ ( crc >> 8 );
+    }
+    return ~crc;
+  }
+
+  const uint32_t cAdlerBase = 65521;
+
+  uint32_t adler32( const uint8_t *data, size_t size )
+  {
+    uint32_t a = 1;
+    uint32_t b = 0;
+    while( size > 0 )
+    { // largest run that can't overflow before taking the modulus
+      const size_t run = min<size_t>( size, 5552 );
+      for( size_t i = 0; i < run; ++i )
+      {
+        a += data[i];
+        b += a;
+      }
+      a %= cAdlerBase;
+      b %= cAdlerBase;
+      data += run;
+      size -= run;
+    }
+    return ( b << 16 ) | a;
+  }
+
+  //! checksum of two runs of bytes given each run's checksum and the second run's length
+  uint32_t combineAdler32( uint32_t first, uint32_t second, size_t second_size )
+  {
+    const uint32_t remainder = second_size % cAdlerBase;
+    uint32_t a = first & 0xFFFF;
+    uint32_t b = ( remainder * a ) % cAdlerBase;
+    a += ( second & 0xFFFF ) + cAdlerBase - 1;
+    b += ( first >> 16 ) + ( second >> 16 ) + cAdlerBase - remainder;
+    a = a % cAdlerBase;
+    b = b % cAdlerBase;
+    return ( b << 16 ) | a;
+  }
+
+  void putBigEndian( vector<uint8_t> *out, uint32_t value )
+  {
+    out->push_back( static_cast<uint8_t>( value >> 24 ) );
+    out->push_back( static_cast<uint8_t>( value >> 16 ) );
+    out->push_back( static_cast<uint8_t>( value >> 8 ) );
+    out->push_back( static_cast<uint8_t>( value ) );
+  }
+
+  uint32_t getBigEndian( const uint8_t *in )
+  {
+    return uint32_t( in[0] ) << 24 | uint32_t( in[1] ) << 16 | uint32_t( in[2] ) << 8 | in[3];
+  }
+
+  //
+  // Deflate
+  //
+
+  class BitWriter
+  {
+  public:
+    explicit BitWriter( vector<uint8_t> *out ):
+    mOut( out )
+    {}
+    //! appends the low \a count bits of \a value, least significant first
+    void put( uint32_t value, int count )
+    {
+      mBits |= uint64_t( value ) << mCount;
+      mCount += count;
+      while( mCount >= 8 )
+      {
+        mOut->push_back( static_cast<uint8_t>( mBits ) );
+        mBits >>= 8;
+        mCount -= 8;
+      }
+    }
+    //! pads with zeros to the next byte
+    void align()
+    {
+      if( mCount > 0 )
+      {
+        put( 0, 8 - mCount );
+      }
+    }
+  private:
+    vector<uint8_t> *mOut;
+    uint64_t        mBits = 0;
+    int             mCount = 0;
+  };
+
+  //! a literal byte when distance is zero, otherwise a back-reference of \a value bytes
+  struct Symbol
+  {
+    uint16_t  value;
+    uint16_t  distance;
+  };
+
+  const int cLengthBase[29] = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+  const int cLengthExtra[29] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+  const int cDistanceBase[30] = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+  const int cDistanceExtra[30] = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+  //! order code length code lengths are written in
+  const int cCodeLengthOrder[19] = { 16, 17, 18, 0, 8, 7, 9, 6, 10, 5, 11, 4, 12, 3, 13, 2, 14, 1, 15 };
+
+  const int cMinMatch = 3;
+  const int cMaxMatch = 258;
+  const int cWindowSize = 32768;
+  const int cHashBits = 15;
+  //! candidates checked per position; more compresses slightly better, much more slowly
+  const int cMaxChain = 24;
+  //! symbols per deflate block, each with its own Huffman tables
+  const size_t cBlockSymbols = 1 << 15;
+
+  //! matches longer than this don't add their interior to the hash chains, which saves a lot of time on flat areas
+  const int cMaxInsertLength = 32;
+
+  //! code for each match length, 3 through 258
+  const array<uint8_t, 259>& lengthCodes()
+  {
+    static const array<uint8_t, 259> table = []()
+    {
+      array<uint8_t, 259> t;
+      for( int length = 0; length < 259; ++length )
+      {
+        t[length] = static_cast<uint8_t>( max<ptrdiff_t>( 0, upper_bound( begin( cLengthBase ), end( cLengthBase ), length ) - begin( cLengthBase ) - 1 ) );
+      }
+      return t;
+    }();
+    return table;
+  }
+
+  //! code for distances up to 256, then for each 128 after that
+  const array<uint8_t, 512>& distanceCodes()
+  {
+    static const array<uint8_t, 512> table = []()
+    {
+      array<uint8_t, 512> t;
+      for( int i = 0; i < 512; ++i )
+      {
+        const int distance = i < 256 ? i + 1 : ( ( i - 256 ) << 7 ) + 1;
+        t[i] = static_cast<uint8_t>( upper_bound( begin( cDistanceBase ), end( cDistanceBase ), distance ) - begin( cDistanceBase ) - 1 );
+      }
+      return t;
+    }();
+    return table;
+  }
+
+  inline int lengthCode( int length )
+  {
+    return lengthCodes()[length];
+  }
+
+  inline int distanceCode( int distance )
+  {
+    return distanceCodes()[distance <= 256 ? distance - 1 : 256 + ( ( distance - 1 ) >> 7 )];
+  }
+
+  //! greedy LZ77 over \a data with hash chains; matches never reach outside \a data
+  vector<Symbol> findMatches( const uint8_t *data, size_t size )
+  {
+    vector<Symbol> symbols;
+    symbols.reserve( size / 2 );
+    vector<int32_t> head( 1 << cHashBits, -1 );
+    vector<int32_t> previous( size, -1 );
+    auto hash = [data]( size_t i ){ return ( ( data[i] << 10 ) ^ ( data[i + 1] << 5 ) ^ data[i + 2] ) & ( ( 1 << cHashBits ) - 1 ); };
+    auto insert = [&]( size_t i )
+    {
+      const int h = hash( i );
+      previous[i] = head[h];
+      head[h] = static_cast<int32_t>( i );
+    };
+    size_t i = 0;
+    while( i < size )
+    {
+      int best_length = 0;
+      int best_distance = 0;
+      if( i + cMinMatch <= size )
+      {
+        const int max_length = static_cast<int>( min<size_t>( cMaxMatch, size - i ) );
+        int candidate = head[hash( i )];
+        for( int chain = 0; candidate >= 0 && chain < cMaxChain && static_cast<int>( i ) - candidate <= cWindowSize; ++chain )
+        {
+          const uint8_t *a = data + candidate;
+          const uint8_t *b = data + i;
+          if( a[best_length] == b[best_length] )
+          {
+            int length = 0;
+            while( length < max_length && a[length] == b[length] )
+            {
+              length += 1;
+            }
+            if( length > best_length )
+            {
+              best_length = length;
+              best_distance = static_cast<int>( i ) - candidate;
+              if( length == max_length )
+              {
+                break;
+              }
+            }
+          }
+          candidate = previous[candidate];
+        }
+        insert( i );
+      }
+      if( best_length >= cMinMatch )
+      {
+        symbols.push_back( Symbol{ static_cast<uint16_t>( best_length ), static_cast<uint16_t>( best_distance ) } );
+        for( size_t k = i + 1; best_length <= cMaxInsertLength && k < i + best_length && k + cMinMatch <= size; ++k )
+        {
+          insert( k );
+        }
+        i += best_length;
+      }
+      else
+      {
+        symbols.push_back( Symbol{ data[i], 0 } );
+        i += 1;
+      }
+    }
+    return symbols;
+  }
+
+  //! Huffman code lengths for \a frequencies, none longer than \a limit bits
+  //! unused symbols get length zero; at least two symbols always get a code
+  vector<uint8_t> codeLengths( vector<uint32_t> frequencies, int limit )
+  {
+    const size_t count = frequencies.size();
+    size_t used = count_if( frequencies.begin(), frequencies.end(), []( uint32_t f ){ return f > 0; } );
+    for( size_t s = 0; used < 2 && s < count; ++s )
+    { // a lone code would be incomplete; give it a partner
+      if( frequencies[s] == 0 )
+      {
+        frequencies[s] = 1;
+        used += 1;
+      }
+    }
+    vector<uint8_t> lengths( count, 0 );
+    while( true )
+    {
+      struct Node
+      {
+        uint64_t  weight;
+        int       parent;
+      };
+      vector<Node> nodes;
+      vector<pair<uint64_t, int>> queue;
+      for( size_t s = 0; s < count; ++s )
+      {
+        if( frequencies[s] > 0 )
+        {
+          queue.push_back( make_pair( uint64_t( frequencies[s] ), static_cast<int>( nodes.size() ) ) );
+          nodes.push_back( Node{ frequencies[s], -1 } );
+        }
+      }
+      auto heavier = []( const pair<uint64_t, int> &lhs, const pair<uint64_t, int> &rhs ){ return lhs.first > rhs.first || ( lhs.first == rhs.first && lhs.second > rhs.second ); };
+      make_heap( queue.begin(), queue.end(), heavier );
+      while( queue.size() > 1 )
+      {
+        pop_heap( queue.begin(), queue.end(), heavier );
+        const pair<uint64_t, int> a = queue.back();
+        queue.pop_back();
+        pop_heap( queue.begin(), queue.end(), heavier );
+        const pair<uint64_t, int> b = queue.back();
+        queue.pop_back();
+        const int parent = static_cast<int>( nodes.size() );
+        nodes.push_back( Node{ a.first + b.first, -1 } );
+        nodes[a.second].parent = parent;
+        nodes[b.second].parent = parent;
+        queue.push_back( make_pair( a.first + b.first, parent ) );
+        push_heap( queue.begin(), queue.end(), heavier );
+      }
+      int longest = 0;
+      int leaf = 0;
+      for( size_t s = 0; s < count; ++s )
+      {
+        if( frequencies[s] > 0 )
+        {
+          int depth = 0;
+          for( int n = leaf++; nodes[n].parent >= 0; n = nodes[n].parent )
+          {
+            depth += 1;
+          }
+          lengths[s] = static_cast<uint8_t>( depth );
+          longest = max( longest, depth );
+        }
+      }
+      if( longest <= limit )
+      {
+        return lengths;
+      }
+      // flatten the distribution and try again
+      for( uint32_t &f : frequencies )
+      {
+        if( f > 0 )
+        {
+          f = ( f >> 1 ) | 1;
+        }
+      }
+    }
+  }
+
+  //! canonical codes for \a lengths, bit-reversed for writing least significant bit first
+  vector<uint16_t> canonicalCodes( const vector<uint8_t> &lengths )
+  {
+    int length_counts[16] = { 0 };
+    for( uint8_t length : lengths )
+    {
+      length_counts[length] += 1;
+    }
+    length_counts[0] = 0;
+    int next[16] = { 0 };
+    for( int bits = 1, code = 0; bits < 16; ++bits )
+    {
+      code = ( code + length_counts[bits - 1] ) << 1;
+      next[bits] = code;
+    }
+    vector<uint16_t> codes( lengths.size(), 0 );
+    for( size_t s = 0; s < lengths.size(); ++s )
+    {
+      const int length = lengths[s];
+      if( length > 0 )
+      {
+        int code = next[length]++;
+        int reversed = 0;
+        for( int b = 0; b < length; ++b )
+        {
+          reversed = ( reversed << 1 ) | ( code & 1 );
+          code >>= 1;
+        }
+        codes[s] = static_cast<uint16_t>( reversed );
+      }
+    }
+    return codes;
+  }
+
+  //! writes \a symbols as one deflate block with dynamic Huffman tables
+  void writeBlock( BitWriter &bits, const Symbol *symbols, size_t count, bool final )
+  {
+    vector<uint32_t> literal_frequencies( 286, 0 );
+    vector<uint32_t> distance_frequencies( 30, 0 );
+    for( size_t i = 0; i < count; ++i )
+    {
+      const Symbol &symbol = symbols[i];
+      if( symbol.distance == 0 )
+      {
+        literal_frequencies[symbol.value] += 1;
+      }
+      else
+      {
+        literal_frequencies[257 + lengthCode( symbol.value )] += 1;
+        distance_frequencies[distanceCode( symbol.distance )] += 1;
+      }
+    }
+    literal_frequencies[256] = 1;
+    const vector<uint8_t> literal_lengths = codeLengths( literal_frequencies, 15 );
+    const vector<uint8_t> distance_lengths = codeLengths( distance_frequencies, 15 );
+    const vector<uint16_t> literal_codes = canonicalCodes( literal_lengths );
+    const vector<uint16_t> distance_codes = canonicalCodes( distance_lengths );
+
+    int literal_count = 286;
+    while( literal_count > 257 && literal_lengths[literal_count - 1] == 0 )
+    {
+      literal_count -= 1;
+    }
+    int distance_count = 30;
+    while( distance_count > 1 && distance_lengths[distance_count - 1] == 0 )
+    {
+      distance_count -= 1;
+    }
+    // run-length encode both tables' lengths as one sequence
+    vector<uint8_t> all_lengths( literal_lengths.begin(), literal_lengths.begin() + literal_count );
+    all_lengths.insert( all_lengths.end(), distance_lengths.begin(), distance_lengths.begin() + distance_count );
+    vector<pair<uint8_t, uint8_t>> runs; // code length symbol, extra bits value
+    for( size_t i = 0; i < all_lengths.size(); )
+    {
+      const uint8_t value = all_lengths[i];
+      size_t run = 1;
+      while( i + run < all_lengths.size() && all_lengths[i + run] == value )
+      {
+        run += 1;
+      }
+      i += run;
+      if( value == 0 )
+      {
+        while( run >= 11 )
+        {
+          const size_t n = min<size_t>( run, 138 );
+          runs.push_back( make_pair( 18, static_cast<uint8_t>( n - 11 ) ) );
+          run -= n;
+        }
+        if( run >= 3 )
+        {
+          runs.push_back( make_pair( 17, static_cast<uint8_t>( run - 3 ) ) );
+          run = 0;
+        }
+      }
+      else
+      {
+        runs.push_back( make_pair( value, 0 ) );
+        run -= 1;
+        while( run >= 3 )
+        {
+          const size_t n = min<size_t>( run, 6 );
+          runs.push_back( make_pair( 16, static_cast<uint8_t>( n - 3 ) ) );
+          run -= n;
+        }
+      }
+      for( ; run > 0; --run )
+      {
+        runs.push_back( make_pair( value, 0 ) );
+      }
+    }
+    vector<uint32_t> length_frequencies( 19, 0 );
+    for( const auto &run : runs )
+    {
+      length_frequencies[run.first] += 1;
+    }
+    const vector<uint8_t> length_lengths = codeLengths( length_frequencies, 7 );
+    const vector<uint16_t> length_codes = canonicalCodes( length_lengths );
+    int length_count = 19;
+    while( length_count > 4 && length_lengths[cCodeLengthOrder[length_count - 1]] == 0 )
+    {
+      length_count -= 1;
+    }
+
+    bits.put( final ? 1 : 0, 1 );
+    bits.put( 2, 2 );
+    bits.put( literal_count - 257, 5 );
+    bits.put( distance_count - 1, 5 );
+    bits.put( length_count - 4, 4 );
+    for( int i = 0; i < length_count; ++i )
+    {
+      bits.put( length_lengths[cCodeLengthOrder[i]], 3 );
+    }
+    for( const auto &run : runs )
+    {
+      bits.put( length_codes[run.first], length_lengths[run.first] );
+      if( run.first == 16 )
+      {
+        bits.put( run.second, 2 );
+      }
+      else if( run.first == 17 )
+      {
+        bits.put( run.second, 3 );
+      }
+      else if( run.first == 18 )
+      {
+        bits.put( run.second, 7 );
+      }
+    }
+    for( size_t i = 0; i < count; ++i )
+    {
+      const Symbol &symbol = symbols[i];
+      if( symbol.distance == 0 )
+      {
+        bits.put( literal_codes[symbol.value], literal_lengths[symbol.value] );
+      }
+      else
+      {
+        const int length = lengthCode( symbol.value );
+        bits.put( literal_codes[257 + length], literal_lengths[257 + length] );
+        bits.put( symbol.value - cLengthBase[length], cLengthExtra[length] );
+        const int distance = distanceCode( symbol.distance );
+        bits.put( distance_codes[distance], distance_lengths[distance] );
+        bits.put( symbol.distance - cDistanceBase[distance], cDistanceExtra[distance] );
+      }
+    }
+    bits.put( literal_codes[256], literal_lengths[256] );
+  }
+
+  //! raw deflate data for \a data, ending byte-aligned
+  //! unless \a last, the final block is left open and followed by an empty stored block, so more can follow
+  vector<uint8_t> deflateBand( const uint8_t *data, size_t size, bool last )
+  {
+    const vector<Symbol> symbols = findMatches( data, size );
+    vector<uint8_t> out;
+    out.reserve( size / 2 );
+    BitWriter bits( &out );
+    for( size_t first = 0; first < symbols.size(); first += cBlockSymbols )
+    {
+      const size_t count = min( cBlockSymbols, symbols.size() - first );
+      writeBlock( bits, &symbols[first], count, last && first + count == symbols.size() );
+    }
+    if( !last )
+    { // sync flush: an empty stored block brings the stream to a byte boundary
+      bits.put( 0, 3 );
+      bits.align();
+      out.insert( out.end(), { 0x00, 0x00, 0xFF, 0xFF } );
+    }
+    bits.align();
+    return out;
+  }
+
+  //
+  // PNG
+  //
+
+  inline uint8_t paeth( int a, int b, int c )
+  {
+    const int p = a + b - c;
+    const int pa = abs( p - a );
+    const int pb = abs( p - b );
+    const int pc = abs( p - c );
+    return static_cast<uint8_t>( ( pa <= pb && pa <= pc ) ? a : ( pb <= pc ) ? b : c );
+  }
+
+  //! writes the filter type and filtered bytes of \a row to \a out, picking the filter with the smallest output
+  //! \a above is the unfiltered previous row, or all zeros for the first row
+  void filterRow( const uint8_t *row, const uint8_t *above, size_t size, int bpp, uint8_t *out, vector<uint8_t> *scratch )
+  {
+    scratch->resize( size * 5 );
+    uint8_t *none = scratch->data();
+    uint8_t *sub = none + size;
+    uint8_t *up = sub + size;
+    uint8_t *average = up + size;
+    uint8_t *paeth_filtered = average + size;
+    for( size_t i = 0; i < static_cast<size_t>( bpp ); ++i )
+    { // the first pixel has nothing to its left
+      none[i] = row[i];
+      sub[i] = row[i];
+      up[i] = row[i] - above[i];
+      average[i] = row[i] - above[i] / 2;
+      paeth_filtered[i] = row[i] - above[i];
+    }
+    for( size_t i = bpp; i < size; ++i )
+    {
+      none[i] = row[i];
+      sub[i] = row[i] - row[i - bpp];
+      up[i] = row[i] - above[i];
+      average[i] = row[i] - ( row[i - bpp] + above[i] ) / 2;
+      paeth_filtered[i] = row[i] - paeth( row[i - bpp], above[i], above[i - bpp] );
+    }
+    // smallest sum of magnitudes, reading bytes as signed, tends to deflate best
+    uint64_t best_cost = numeric_limits<uint64_t>::max();
+    int best = 0;
+    for( int type = 0; type < 5; ++type )
+    {
+      const int8_t *filtered = reinterpret_cast<const int8_t*>( none + type * size );
+      uint64_t cost = 0;
+      for( size_t i = 0; i < size; ++i )
+      {
+        cost += abs( filtered[i] );
+      }
+      if( cost < best_cost )
+      {
+        best_cost = cost;
+        best = type;
+      }
+    }
+    out[0] = static_cast<uint8_t>( best );
+    memcpy( out + 1, none + best * size, size );
+  }
+
+  void writeChunk( vector<uint8_t> *out, const char *type, const uint8_t *data, size_t size )
+  {
+    putBigEndian( out, static_cast<uint32_t>( size ) );
+    const size_t start = out->size();
+    out->insert( out->end(), type, type + 4 );
+    out->insert( out->end(), data, data + size );
+    putBigEndian( out, crc32( out->data() + start, size + 4 ) );
+  }
+
+  //! rows of \a surface as tightly-packed RGB(A)
+  void readRow( const Surface &surface, int y, int channels, uint8_t *out )
+  {
+    const SurfaceChannelOrder &order = surface.getChannelOrder();
+    const uint8_t *in = surface.getData( Vec2i( 0, y ) );
+    const int inc = surface.getPixelInc();
+    if( order.getCode() == ( channels == 4 ? SurfaceChannelOrder::RGBA : SurfaceChannelOrder::RGB ) )
+    {
+      memcpy( out, in, surface.getWidth() * channels );
+      return;
+    }
+    for( int x = 0; x < surface.getWidth(); ++x, in += inc, out += channels )
+    {
+      out[0] = in[order.getRedOffset()];
+      out[1] = in[order.getGreenOffset()];
+      out[2] = in[order.getBlueOffset()];
+      if( channels == 4 )
+      {
+        out[3] = in[order.getAlphaOffset()];
+      }
+    }
+  }
+
+  //
+  // QOI
+  //
+
+  const uint8_t cQoiIndex = 0x00;
+  const uint8_t cQoiDiff = 0x40;
+  const uint8_t cQoiLuma = 0x80;
+  const uint8_t cQoiRun = 0xC0;
+  const uint8_t cQoiRgb = 0xFE;
+  const uint8_t cQoiRgba = 0xFF;
+  const uint8_t cQoiMask = 0xC0;
+  const uint8_t cQoiEnd[8] = { 0, 0, 0, 0, 0, 0, 0, 1 };
+
+  struct Pixel
+  {
+    uint8_t r, g, b, a;
+    bool operator == ( const Pixel &other ) const { return r == other.r && g == other.g && b == other.b && a == other.a; }
+  };
+
+  inline int qoiHash( const Pixel &p )
+  {
+    return ( p.r * 3 + p.g * 5 + p.b * 7 + p.a * 11 ) % 64;
+  }
+} // anon::
+
+Buffer pockets::encodePng( const Surface &surface )
+{
+  const int width = surface.getWidth();
+  const int height = surface.getHeight();
+  const int channels = surface.hasAlpha() ? 4 : 3;
+  const size_t row_size = width * channels;
+  // bands big enough to compress well, and enough of them to keep every thread busy
+  const size_t target_bytes = math<size_t>::clamp( row_size * height / ( ThreadPool::shared().size() * 2 + 1 ), 128 * 1024, 1024 * 1024 );
+  const int band_rows = math<int>::max( 1, static_cast<int>( target_bytes / ( row_size + 1 ) ) );
+  const int band_count = math<int>::max( 1, ( height + band_rows - 1 ) / band_rows );
+
+  struct Band
+  {
+    vector<uint8_t> deflated;
+    uint32_t        adler;
+    size_t          size;
+  };
+  vector<Band> bands( band_count );
+  ThreadPool::shared().parallelFor( 0, band_count, 1, [&]( size_t first, size_t last )
+  {
+    vector<uint8_t> rows;
+    vector<uint8_t> scratch;
+    vector<uint8_t> current( row_size ), above( row_size, 0 );
+    for( size_t b = first; b < last; ++b )
+    {
+      const int top = static_cast<int>( b ) * band_rows;
+      const int bottom = math<int>::min( height, top + band_rows );
+      rows.resize( ( bottom - top ) * ( row_size + 1 ) );
+      if( top > 0 )
+      { // filters may predict from the last row of the band above
+        readRow( surface, top - 1, channels, above.data() );
+      }
+      else
+      {
+        fill( above.begin(), above.end(), 0 );
+      }
+      for( int y = top; y < bottom; ++y )
+      {
+        readRow( surface, y, channels, current.data() );
+        filterRow( current.data(), above.data(), row_size, channels, &rows[( y - top ) * ( row_size + 1 )], &scratch );
+        current.swap( above );
+      }
+      bands[b].deflated = deflateBand( rows.data(), rows.size(), b + 1 == static_cast<size_t>( band_count ) );
+      bands[b].adler = adler32( rows.data(), rows.size() );
+      bands[b].size = rows.size();
+    }
+  } );
+
+  vector<uint8_t> png = { 0x89, 'P', 'N', 'G', 0x0D, 0x0A, 0x1A, 0x0A };
+  vector<uint8_t> header;
+  putBigEndian( &header, width );
+  putBigEndian( &header, height );
+  header.insert( header.end(), { 8, static_cast<uint8_t>( channels == 4 ? 6 : 2 ), 0, 0, 0 } );
+  writeChunk( &png, "IHDR", header.data(), header.size() );
+
+  uint32_t adler = 1;
+  for( const Band &band : bands )
+  {
+    adler = combineAdler32( adler, band.adler, band.size );
+  }
+  // one IDAT per band; the zlib header leads the first and the checksum trails the last
+  for( int b = 0; b < band_count; ++b )
+  {
+    vector<uint8_t> &data = bands[b].deflated;
+    if( b == 0 )
+    {
+      data.insert( data.begin(), { 0x78, 0x01 } );
+    }
+    if( b == band_count - 1 )
+    {
+      putBigEndian( &data, adler );
+    }
+    writeChunk( &png, "IDAT", data.data(), data.size() );
+  }
+  writeChunk( &png, "IEND", nullptr, 0 );
+
+  Buffer buffer( png.size() );
+  memcpy( buffer.getData(), png.data(), png.size() );
+  return buffer;
+}
+
+Buffer pockets::encodeQoi( const Surface &surface )
+{
+  const int width = surface.getWidth();
+  const int height = surface.getHeight();
+  const int channels = surface.hasAlpha() ? 4 : 3;
+  vector<uint8_t> out;
+  // worst case is every pixel spelled out in full
+  out.reserve( 14 + static_cast<size_t>( width ) * height * ( channels + 1 ) + sizeof( cQoiEnd ) );
+  out.insert( out.end(), { 'q', 'o', 'i', 'f' } );
+  putBigEndian( &out, width );
+  putBigEndian( &out, height );
+  out.push_back( static_cast<uint8_t>( channels ) );
+  out.push_back( 0 ); // sRGB with linear alpha
+
+  Pixel index[64];
+  memset( index, 0, sizeof( index ) );
+  Pixel previous{ 0, 0, 0, 255 };
+  int run = 0;
+  vector<uint8_t> row( width * channels );
+  for( int y = 0; y < height; ++y )
+  {
+    readRow( surface, y, channels, row.data() );
+    for( int x = 0; x < width; ++x )
+    {
+      const uint8_t *p = &row[x * channels];
+      const Pixel pixel{ p[0], p[1], p[2], channels == 4 ? p[3] : static_cast<uint8_t>( 255 ) };
+      const bool last_pixel = ( y == height - 1 ) && ( x == width - 1 );
+      if( pixel == previous )
+      {
+        run += 1;
+        if( run == 62 || last_pixel )
+        {
+          out.push_back( static_cast<uint8_t>( cQoiRun | ( run - 1 ) ) );
+          run = 0;
+        }
+        continue;
+      }
+      if( run > 0 )
+      {
+        out.push_back( static_cast<uint8_t>( cQoiRun | ( run - 1 ) ) );
+        run = 0;
+      }
+      const int hash = qoiHash( pixel );
+      if( index[hash] == pixel )
+      {
+        out.push_back( static_cast<uint8_t>( cQoiIndex | hash ) );
+      }
+      else
+      {
+        index[hash] = pixel;
+        if( pixel.a == previous.a )
+        {
+          const int8_t dr = static_cast<int8_t>( pixel.r - previous.r );
+          const int8_t dg = static_cast<int8_t>( pixel.g - previous.g );
+          const int8_t db = static_cast<int8_t>( pixel.b - previous.b );
+          const int dr_dg = dr - dg;
+          const int db_dg = db - dg;
+          if( dr > -3 && dr < 2 && dg > -3 && dg < 2 && db > -3 && db < 2 )
+          {
+            out.push_back( static_cast<uint8_t>( cQoiDiff | ( dr + 2 ) << 4 | ( dg + 2 ) << 2 | ( db + 2 ) ) );
+          }
+          else if( dr_dg > -9 && dr_dg < 8 && dg > -33 && dg < 32 && db_dg > -9 && db_dg < 8 )
+          {
+            out.push_back( static_cast<uint8_t>( cQoiLuma | ( dg + 32 ) ) );
+            out.push_back( static_cast<uint8_t>( ( dr_dg + 8 ) << 4 | ( db_dg + 8 ) ) );
+          }
+          else
+          {
+            out.insert( out.end(), { cQoiRgb, pixel.r, pixel.g, pixel.b } );
+          }
+        }
+        else
+        {
+          out.insert( out.end(), { cQoiRgba, pixel.r, pixel.g, pixel.b, pixel.a } );
+        }
+      }
+      previous = pixel;
+    }
+  }
+  out.insert( out.end(), begin( cQoiEnd ), end( cQoiEnd ) );
+
+  Buffer buffer( out.size() );
+  memcpy( buffer.getData(), out.data(), out.size() );
+  return buffer;
+}
+
+Surface pockets::decodeQoi( const uint8_t *data, size_t size )
+{
+  if( size < 14 + sizeof( cQoiEnd ) || memcmp( data, "qoif", 4 ) != 0 )
+  {
+    return Surface();
+  }
+  const uint32_t width = getBigEndian( data + 4 );
+  const uint32_t height = getBigEndian( data + 8 );
+  const int channels = data[12];
+  if( width == 0 || height == 0 || ( channels != 3 && channels != 4 ) || uint64_t( width ) * height > ( uint64_t( 1 ) << 30 ) )
+  {
+    return Surface();
+  }
+  Surface surface( width, height, channels == 4, channels == 4 ? SurfaceChannelOrder::RGBA : SurfaceChannelOrder::RGB );
+  Pixel index[64];
+  memset( index, 0, sizeof( index ) );
+  Pixel pixel{ 0, 0, 0, 255 };
+  int run = 0;
+  size_t p = 14;
+  const size_t chunks_end = size - sizeof( cQoiEnd );
+  for( uint32_t y = 0; y < height; ++y )
+  {
+    uint8_t *out = surface.getData( Vec2i( 0, y ) );
+    for( uint32_t x = 0; x < width; ++x, out += surface.getPixelInc() )
+    {
+      if( run > 0 )
+      {
+        run -= 1;
+      }
+      else if( p < chunks_end )
+      {
+        const uint8_t op = data[p++];
+        if( op == cQoiRgb && p + 3 <= chunks_end )
+        {
+          pixel.r = data[p]; pixel.g = data[p + 1]; pixel.b = data[p + 2];
+          p += 3;
+        }
+        else if( op == cQoiRgba && p + 4 <= chunks_end )
+        {
+          pixel.r = data[p]; pixel.g = data[p + 1]; pixel.b = data[p + 2]; pixel.a = data[p + 3];
+          p += 4;
+        }
+        else if( ( op & cQoiMask ) == cQoiIndex )
+        {
+          pixel = index[op];
+        }
+        else if( ( op & cQoiMask ) == cQoiDiff )
+        {
+          pixel.r += ( ( op >> 4 ) & 3 ) - 2;
+          pixel.g += ( ( op >> 2 ) & 3 ) - 2;
+          pixel.b += ( op & 3 ) - 2;
+        }
+        else if( ( op & cQoiMask ) == cQoiLuma && p < chunks_end )
+        {
+          const int dg = ( op & 0x3F ) - 32;
+          const uint8_t next = data[p++];
+          pixel.r += dg - 8 + ( ( next >> 4 ) & 0x0F );
+          pixel.g += dg;
+          pixel.b += dg - 8 + ( next & 0x0F );
+        }
+        else if( ( op & cQoiMask ) == cQoiRun )
+        {
+          run = op & 0x3F;
+        }
+        index[qoiHash( pixel )] = pixel;
+      }
+      const SurfaceChannelOrder &order = surface.getChannelOrder();
+      out[order.getRedOffset()] = pixel.r;
+      out[order.getGreenOffset()] = pixel.g;
+      out[order.getBlueOffset()] = pixel.b;
+      if( channels == 4 )
+      {
+        out[order.getAlphaOffset()] = pixel.a;
+      }
+    }
+  }
+  return surface;
+}
+
+void pockets::writePng( const fs::path &path, const Surface &surface )
+{
+  Buffer png = encodePng( surface );
+  writeFile( path )->getStream()->writeData( png.getData(), png.getDataSize() );
+}
+
+void pockets::writeQoi( const fs::path &path, const Surface &surface )
+{
+  Buffer qoi = encodeQoi( surface );
+  writeFile( path )->getStream()->writeData( qoi.getData(), qoi.getDataSize() );
+}
@@ -0,0 +1,59 @@
+/*
+ * Copyright (c) 2013 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+#include "Pockets.h"
+#include "cinder/Surface.h"
+#include "cinder/Buffer.h"
+#include "cinder/Filesystem.h"
+
+namespace pockets
+{
+  /**
+   Image encoders for exporting atlases and captured frames quickly.
+
+   PNG output is split into bands of rows that are filtered and deflated in
+   parallel on the shared ThreadPool. Each band is an independent run of
+   deflate blocks ending on a byte boundary, so the bands are concatenated
+   into one ordinary zlib stream that any PNG reader accepts. Bands don't
+   reference each other's bytes, which costs a little compression.
+
+   QOI output (https://qoiformat.org) is lossless and far faster to write and
+   read than PNG, at somewhat larger sizes; use it for intermediate files.
+   */
+
+  //! PNG file for \a surface: RGBA if it has alpha, otherwise RGB
+  ci::Buffer    encodePng( const ci::Surface &surface );
+  //! QOI file for \a surface: four channels if it has alpha, otherwise three
+  ci::Buffer    encodeQoi( const ci::Surface &surface );
+  //! reads a QOI file; returns an empty surface if \a data isn't one
+  ci::Surface   decodeQoi( const uint8_t *data, size_t size );
+
+  void          writePng( const ci::fs::path &path, const ci::Surface &surface );
+  void          writeQoi( const ci::fs::path &path, const ci::Surface &surface );
+} // pockets::
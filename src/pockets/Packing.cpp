@@ -26,12 +26,15 @@
  */
 
 #include "Packing.h"
+#include "CollectionUtilities.hpp"
+#include <algorithm>
+#include <limits>
 
 using namespace std;
 using namespace cinder;
 using namespace pockets;
 
-size_t ScanlinePacker::pushRect( Rectf rect )
+ScanlinePacker::Handle ScanlinePacker::pushRect( Rectf rect )
 {	// TODO: better error handling
 	assert( rect.getWidth() < mConstraints.x );
 	if( rect.getUpperLeft() != Vec2f::zero() )
@@ -39,6 +42,334 @@ size_t ScanlinePacker::pushRect( Rectf rect )
 		rect -= rect.getUpperLeft();
 	}
 
+	Vec2f loc;
+	if( findFreeLocation( rect, &loc ) )
+	{	// reuse space left by a removed rect
+		rect += loc;
+	}
+	else if( mMode == eSkyline )
+	{
+		rect += findSkylineLocation( rect );
+		addSkylineSegment( rect );
+	}
+	else
+	{
+		rect += findScanlineLocation( rect );
+	}
+	claimFreeSpace( footprint( rect ) );
+
+	Handle handle = mNextHandle++;
+	mSlots[handle] = mRectangles.size();
+	mRectangles.push_back( rect );
+	mHandles.push_back( handle );
+	return handle;
+}
+
+void ScanlinePacker::removeRect( Handle handle )
+{
+	auto iter = mSlots.find( handle );
+	if( iter == mSlots.end() )
+	{
+		return;
+	}
+	const size_t index = iter->second;
+	const Rectf rect = mRectangles.at( index );
+	mSlots.erase( iter );
+	// swap-and-pop to keep the rectangles contiguous
+	if( index != mRectangles.size() - 1 )
+	{
+		mRectangles[index] = mRectangles.back();
+		mHandles[index] = mHandles.back();
+		mSlots[mHandles[index]] = index;
+	}
+	mRectangles.pop_back();
+	mHandles.pop_back();
+
+	if( mRectangles.empty() )
+	{	// nothing left to work around, start fresh
+		mFreeRects.clear();
+		mSkyline.clear();
+	}
+	else
+	{
+		releaseFreeSpace( footprint( rect ) );
+		mNeedsRebuild = true;
+	}
+}
+
+void ScanlinePacker::clear()
+{
+	mRectangles.clear();
+	mHandles.clear();
+	mSlots.clear();
+	mFreeRects.clear();
+	mSkyline.clear();
+	mNeedsRebuild = false;
+	mInsertionCost = 0;
+}
+
+void ScanlinePacker::setMode( Mode mode )
+{
+	if( mode == mMode )
+	{
+		return;
+	}
+	mMode = mode;
+	mSkyline.clear();
+	if( !mRectangles.empty() )
+	{	// the skyline and free rects are tracked differently in each mode
+		if( mMode == eSkyline )
+		{
+			rebuildSkyline();
+		}
+		rebuildFreeRects();
+	}
+}
+
+float ScanlinePacker::getExtent() const
+{
+	float extent = 0.0f;
+	for( const Rectf &r : mRectangles )
+	{
+		extent = math<float>::max( extent, r.getY2() );
+	}
+	return extent;
+}
+
+vector<ScanlinePacker::Handle> ScanlinePacker::defragment( size_t max_moves )
+{
+	vector<Handle> moved;
+	// consider the lowest rects first, since moving them shrinks the extent
+	vector<size_t> order( mRectangles.size() );
+	for( size_t i = 0; i < order.size(); ++i )
+	{
+		order[i] = i;
+	}
+	sort( order.begin(), order.end(), [this]( size_t lhs, size_t rhs )
+	{
+		return mRectangles[lhs].getY2() > mRectangles[rhs].getY2();
+	} );
+	// don't let a heavily fragmented packing turn this into a full scan
+	const size_t max_attempts = math<size_t>::min( order.size(), max_moves * 8 );
+	for( size_t i = 0; i < max_attempts && moved.size() < max_moves; ++i )
+	{
+		const size_t index = order[i];
+		const Rectf rect = mRectangles[index];
+		const Rectf sized = rect - rect.getUpperLeft();
+		const Vec2f needed = sized.getSize() + mPadding;
+		// highest free rect that fits and actually raises the rect
+		const Rectf *best = nullptr;
+		for( const Rectf &free : mFreeRects )
+		{
+			if( free.getWidth() >= needed.x && free.getHeight() >= needed.y && free.getY1() < rect.getY1()
+				&& ( !best || free.getY1() < best->getY1() || ( free.getY1() == best->getY1() && free.getX1() < best->getX1() ) ) )
+			{
+				best = &free;
+			}
+		}
+		if( best )
+		{
+			const Rectf placed = sized + best->getUpperLeft();
+			claimFreeSpace( footprint( placed ) );
+			releaseFreeSpace( footprint( rect ) );
+			mRectangles[index] = placed;
+			moved.push_back( mHandles[index] );
+			mNeedsRebuild = true;
+		}
+	}
+	if( mNeedsRebuild )
+	{
+		if( mMode == eSkyline && !mSkyline.empty() )
+		{
+			rebuildSkyline();
+		}
+		rebuildFreeRects();
+	}
+	return moved;
+}
+
+bool ScanlinePacker::findFreeLocation( const Rectf &rect, Vec2f *loc )
+{
+	const Vec2f needed = rect.getSize() + mPadding;
+	const Rectf *best = nullptr;
+	float best_waste = numeric_limits<float>::max();
+	for( const Rectf &free : mFreeRects )
+	{
+		if( free.getWidth() >= needed.x && free.getHeight() >= needed.y )
+		{
+			float waste = free.calcArea() - needed.x * needed.y;
+			if( waste < best_waste )
+			{
+				best_waste = waste;
+				best = &free;
+			}
+		}
+	}
+	mInsertionCost += mFreeRects.size();
+	if( best )
+	{
+		*loc = best->getUpperLeft();
+		return true;
+	}
+	return false;
+}
+
+namespace
+{
+	bool overlaps( const Rectf &a, const Rectf &b )
+	{	// sharing an edge doesn't count
+		return a.getX1() < b.getX2() && b.getX1() < a.getX2() && a.getY1() < b.getY2() && b.getY1() < a.getY2();
+	}
+
+	bool encloses( const Rectf &outer, const Rectf &inner )
+	{
+		return inner.getX1() >= outer.getX1() && inner.getY1() >= outer.getY1()
+			&& inner.getX2() <= outer.getX2() && inner.getY2() <= outer.getY2();
+	}
+} // anon::
+
+void ScanlinePacker::claimFreeSpace( const Rectf &area )
+{
+	if( mFreeRects.empty() )
+	{
+		return;
+	}
+	vector<Rectf> pieces;
+	auto iter = mFreeRects.begin();
+	while( iter != mFreeRects.end() )
+	{
+		const Rectf free = *iter;
+		if( !overlaps( free, area ) )
+		{
+			++iter;
+			continue;
+		}
+		// keep the maximal pieces of free around area; they may overlap each other
+		if( area.getX1() > free.getX1() )
+		{ pieces.push_back( Rectf( free.getX1(), free.getY1(), area.getX1(), free.getY2() ) ); }
+		if( area.getX2() < free.getX2() )
+		{ pieces.push_back( Rectf( area.getX2(), free.getY1(), free.getX2(), free.getY2() ) ); }
+		if( area.getY1() > free.getY1() )
+		{ pieces.push_back( Rectf( free.getX1(), free.getY1(), free.getX2(), area.getY1() ) ); }
+		if( area.getY2() < free.getY2() )
+		{ pieces.push_back( Rectf( free.getX1(), area.getY2(), free.getX2(), free.getY2() ) ); }
+		iter = mFreeRects.erase( iter );
+	}
+	for( const Rectf &piece : pieces )
+	{	// slivers narrower than the padding can't hold anything
+		if( piece.getWidth() > mPadding.x && piece.getHeight() > mPadding.y
+			&& none_of( mFreeRects.begin(), mFreeRects.end(), [&piece]( const Rectf &r ){ return encloses( r, piece ); } ) )
+		{
+			mFreeRects.push_back( piece );
+		}
+	}
+}
+
+void ScanlinePacker::releaseFreeSpace( Rectf area )
+{
+	bool merged = true;
+	while( merged )
+	{	// grow area by any free rect that shares a whole edge with it
+		merged = false;
+		for( auto iter = mFreeRects.begin(); iter != mFreeRects.end(); ++iter )
+		{
+			const Rectf &free = *iter;
+			bool same_rows = free.getY1() == area.getY1() && free.getY2() == area.getY2();
+			bool same_columns = free.getX1() == area.getX1() && free.getX2() == area.getX2();
+			if( ( same_rows && ( free.getX2() == area.getX1() || free.getX1() == area.getX2() ) )
+				|| ( same_columns && ( free.getY2() == area.getY1() || free.getY1() == area.getY2() ) ) )
+			{
+				area.set( math<float>::min( area.getX1(), free.getX1() ), math<float>::min( area.getY1(), free.getY1() ),
+						  math<float>::max( area.getX2(), free.getX2() ), math<float>::max( area.getY2(), free.getY2() ) );
+				mFreeRects.erase( iter );
+				merged = true;
+				break;
+			}
+		}
+	}
+	erase_if( &mFreeRects, [&area]( const Rectf &r ){ return encloses( area, r ); } );
+	mFreeRects.push_back( area );
+}
+
+void ScanlinePacker::rebuildSkyline()
+{	// split the width at every rect edge and take the lowest footprint in each column
+	vector<float> edges = { mPadding.x, mConstraints.x };
+	for( const Rectf &r : mRectangles )
+	{
+		edges.push_back( r.getX1() );
+		edges.push_back( footprint( r ).getX2() );
+	}
+	sort( edges.begin(), edges.end() );
+	edges.erase( unique( edges.begin(), edges.end() ), edges.end() );
+	vector<float> heights( edges.size() - 1, mPadding.y );
+	for( const Rectf &r : mRectangles )
+	{
+		const Rectf f = footprint( r );
+		size_t begin = lower_bound( edges.begin(), edges.end(), f.getX1() ) - edges.begin();
+		size_t end = lower_bound( edges.begin(), edges.end(), f.getX2() ) - edges.begin();
+		for( size_t i = begin; i < end; ++i )
+		{
+			heights[i] = math<float>::max( heights[i], f.getY2() );
+		}
+	}
+	mSkyline.clear();
+	for( size_t i = 0; i < heights.size(); ++i )
+	{
+		if( !mSkyline.empty() && mSkyline.back().y == heights[i] )
+		{
+			mSkyline.back().width += edges[i + 1] - edges[i];
+		}
+		else
+		{
+			mSkyline.push_back( SkylineSegment{ edges[i], heights[i], edges[i + 1] - edges[i] } );
+		}
+	}
+}
+
+void ScanlinePacker::rebuildFreeRects()
+{	// a MaxRects bin with every footprint marked as used holds exactly the maximal holes
+	// footprints are rounded outward so the holes never overlap a packed rect
+	float extent = mPadding.y;
+	for( const Rectf &r : mRectangles )
+	{
+		extent = math<float>::max( extent, footprint( r ).getY2() );
+	}
+	MaxRectsPacker bin( math<int>::ceil( mConstraints.x ), math<int>::ceil( extent ) );
+	bin.occupy( Area( 0, 0, bin.getWidth(), math<int>::ceil( mPadding.y ) ) );
+	bin.occupy( Area( 0, 0, math<int>::ceil( mPadding.x ), bin.getHeight() ) );
+	// occupying top-down keeps the bin's free list short while we work
+	vector<Rectf> sorted( mRectangles );
+	sort( sorted.begin(), sorted.end(), []( const Rectf &lhs, const Rectf &rhs ){ return lhs.getY1() < rhs.getY1(); } );
+	for( const Rectf &r : sorted )
+	{
+		const Rectf f = footprint( r );
+		bin.occupy( Area( math<int>::floor( f.getX1() ), math<int>::floor( f.getY1() ),
+						  math<int>::ceil( f.getX2() ), math<int>::ceil( f.getY2() ) ) );
+	}
+	mFreeRects.clear();
+	for( const Area &hole : bin.getFreeRects() )
+	{
+		Rectf free( hole );
+		if( mMode == eSkyline )
+		{	// space above the skyline belongs to skyline placement; keep only the holes below it
+			for( const SkylineSegment &segment : mSkyline )
+			{
+				if( segment.x < free.getX2() && free.getX1() < segment.x + segment.width )
+				{
+					free.y2 = math<float>::min( free.y2, segment.y );
+				}
+			}
+		}
+		if( free.getWidth() > mPadding.x && free.getHeight() > mPadding.y )
+		{
+			mFreeRects.push_back( free );
+		}
+	}
+	mNeedsRebuild = false;
+}
+
+Vec2f ScanlinePacker::findScanlineLocation( const Rectf &rect )
+{
 	Vec2f loc( mPadding );
 	bool placed = false;
 	while( !placed )
@@ -51,6 +382,7 @@ size_t ScanlinePacker::pushRect( Rectf rect )
 				loc.x = bounds.getX2();
 			}
 		}
+		mInsertionCost += mRectangles.size();
 		if( loc.x + rect.getWidth() < mConstraints.x - mPadding.x )
 		{	// probably placed, let's check our boundaries
 			placed = true;
@@ -63,20 +395,350 @@ size_t ScanlinePacker::pushRect( Rectf rect )
 					placed = false;
 				}
 			}
+			mInsertionCost += mRectangles.size();
 		}
 		if( !placed )
 		{	// move to next row for continued evaluation
 			loc.x = mPadding.x;
 			loc.y += mPadding.y;	// could vary this step to optimize for grid
 		}
+	}
+	return loc;
+}
+
+Vec2f ScanlinePacker::findSkylineLocation( const Rectf &rect )
+{
+	if( mSkyline.empty() )
+	{	// the usable span matches the scanline mode's edge padding
+		mSkyline.push_back( SkylineSegment{ mPadding.x, mPadding.y, mConstraints.x - mPadding.x } );
+	}
+	// every rect claims its padding to the right and below
+	const float width = rect.getWidth() + mPadding.x;
+	const float right_edge = mConstraints.x;
+	Vec2f best( mPadding.x, numeric_limits<float>::max() );
+	float best_span = numeric_limits<float>::max();
+	for( size_t i = 0; i < mSkyline.size(); ++i )
+	{
+		const float x = mSkyline[i].x;
+		if( x + width > right_edge )
+		{	// segments are ordered left to right, so nothing further can fit
+			break;
+		}
+		// the rect rests on the highest segment it spans
+		float y = 0.0f;
+		float covered = 0.0f;
+		size_t j = i;
+		while( covered < width && j < mSkyline.size() )
+		{
+			y = math<float>::max( y, mSkyline[j].y );
+			covered += mSkyline[j].width;
+			++j;
+		}
+		mInsertionCost += j - i;
+		// prefer the lowest spot, then the narrowest resting segment to limit waste
+		if( y < best.y || ( y == best.y && mSkyline[i].width < best_span ) )
+		{
+			best.set( x, y );
+			best_span = mSkyline[i].width;
+		}
+	}
+	if( best.y == numeric_limits<float>::max() )
+	{	// too wide to keep its right padding on the sheet; rest it at the left edge on top of what it spans
+		best.y = 0.0f;
+		for( const SkylineSegment &segment : mSkyline )
+		{
+			if( segment.x < best.x + width )
+			{
+				best.y = math<float>::max( best.y, segment.y );
+			}
+		}
+		mInsertionCost += mSkyline.size();
+	}
+	return best;
+}
+
+void ScanlinePacker::addSkylineSegment( const Rectf &rect )
+{
+	const float x1 = rect.getX1();
+	// the padding of a rect at the right edge may hang off the sheet
+	const float x2 = math<float>::min( rect.getX2() + mPadding.x, mConstraints.x );
+	SkylineSegment segment{ x1, rect.getY2() + mPadding.y, x2 - x1 };
+	// find insertion point and trim the segments the new one covers
+	auto iter = mSkyline.begin();
+	while( iter != mSkyline.end() && iter->x + iter->width <= x1 )
+	{
+		++iter;
+	}
+	if( iter != mSkyline.end() && iter->x < x1 )
+	{	// split the segment the rect starts in
+		SkylineSegment left{ iter->x, iter->y, x1 - iter->x };
+		iter->width -= left.width;
+		iter->x = x1;
+		iter = mSkyline.insert( iter, left ) + 1;
+	}
+	iter = mSkyline.insert( iter, segment ) + 1;
+	while( iter != mSkyline.end() && iter->x < x2 )
+	{
+		const float end = iter->x + iter->width;
+		if( end <= x2 )
+		{	// fully covered
+			iter = mSkyline.erase( iter );
+		}
 		else
+		{	// partially covered
+			iter->width = end - x2;
+			iter->x = x2;
+			break;
+		}
+	}
+	// merge neighbors at the same height
+	for( size_t i = 1; i < mSkyline.size(); ++i )
+	{
+		if( mSkyline[i - 1].y == mSkyline[i].y )
 		{
-			rect += loc;
-			mRectangles.push_back( rect );
+			mSkyline[i - 1].width += mSkyline[i].width;
+			mSkyline.erase( mSkyline.begin() + i );
+			--i;
 		}
 	}
-	return mRectangles.size() - 1;
 }
 
+MaxRectsPacker::MaxRectsPacker( int width, int height ):
+mWidth( width ),
+mHeight( height )
+{
+	mFreeRects.push_back( Area( 0, 0, width, height ) );
+}
+
+bool MaxRectsPacker::insert( const Vec2i &size, Heuristic heuristic, Area *placed, bool allow_rotation )
+{
+	Area area;
+	int best_a = numeric_limits<int>::max();
+	int best_b = numeric_limits<int>::max();
+	bool found = findPosition( size, heuristic, &area, &best_a, &best_b );
+	if( allow_rotation && size.x != size.y )
+	{ // the turned rect only wins with a strictly better score, so ties stay upright
+		found = findPosition( Vec2i( size.y, size.x ), heuristic, &area, &best_a, &best_b ) || found;
+	}
+	if( !found )
+	{
+		return false;
+	}
+	occupy( area );
+	if( placed )
+	{
+		*placed = area;
+	}
+	return true;
+}
 
+void MaxRectsPacker::occupy( const Area &area )
+{
+	place( area );
+	mUsedRects.push_back( area );
+	mUsedArea += area.calcArea();
+	mUsedHeight = math<int>::max( mUsedHeight, area.getY2() );
+}
 
+float MaxRectsPacker::getOccupancy() const
+{
+	if( mUsedHeight == 0 || mWidth == 0 )
+	{
+		return 0.0f;
+	}
+	return static_cast<float>( mUsedArea ) / ( static_cast<float>( mWidth ) * mUsedHeight );
+}
+
+bool MaxRectsPacker::findPosition( const Vec2i &size, Heuristic heuristic, Area *placed, int *best_a, int *best_b ) const
+{
+	bool found = false;
+	// primary and secondary scores; lower is better for every heuristic
+	for( const Area &free : mFreeRects )
+	{
+		if( free.getWidth() < size.x || free.getHeight() < size.y )
+		{
+			continue;
+		}
+		const int leftover_x = free.getWidth() - size.x;
+		const int leftover_y = free.getHeight() - size.y;
+		int a = 0;
+		int b = 0;
+		switch( heuristic )
+		{
+			case eBestShortSideFit:
+				a = math<int>::min( leftover_x, leftover_y );
+				b = math<int>::max( leftover_x, leftover_y );
+				break;
+			case eBestAreaFit:
+				a = free.getWidth() * free.getHeight() - size.x * size.y;
+				b = math<int>::min( leftover_x, leftover_y );
+				break;
+			case eBottomLeft:
+				a = free.getY1() + size.y;
+				b = free.getX1();
+				break;
+			case eContactPoint:
+				a = -contactScore( Area( free.getUL(), free.getUL() + size ) );
+				b = free.getY1();
+				break;
+		}
+		if( a < *best_a || ( a == *best_a && b < *best_b ) )
+		{
+			*best_a = a;
+			*best_b = b;
+			*placed = Area( free.getUL(), free.getUL() + size );
+			found = true;
+		}
+	}
+	return found;
+}
+
+namespace
+{
+	//! length of the overlap between intervals [a1, a2) and [b1, b2)
+	int overlap( int a1, int a2, int b1, int b2 )
+	{
+		if( a2 < b1 || b2 < a1 )
+		{
+			return 0;
+		}
+		return math<int>::min( a2, b2 ) - math<int>::max( a1, b1 );
+	}
+} // anon::
+
+int MaxRectsPacker::contactScore( const Area &area ) const
+{
+	int score = 0;
+	if( area.getX1() == 0 || area.getX2() == mWidth )
+	{
+		score += area.getHeight();
+	}
+	if( area.getY1() == 0 || area.getY2() == mHeight )
+	{
+		score += area.getWidth();
+	}
+	for( const Area &used : mUsedRects )
+	{
+		if( used.getX2() == area.getX1() || used.getX1() == area.getX2() )
+		{
+			score += overlap( used.getY1(), used.getY2(), area.getY1(), area.getY2() );
+		}
+		if( used.getY2() == area.getY1() || used.getY1() == area.getY2() )
+		{
+			score += overlap( used.getX1(), used.getX2(), area.getX1(), area.getX2() );
+		}
+	}
+	return score;
+}
+
+namespace
+{
+	bool contains( const Area &outer, const Area &inner )
+	{
+		return inner.getX1() >= outer.getX1() && inner.getY1() >= outer.getY1()
+			&& inner.getX2() <= outer.getX2() && inner.getY2() <= outer.getY2();
+	}
+} // anon::
+
+void MaxRectsPacker::place( const Area &placed )
+{
+	vector<Area> split;
+	size_t i = 0;
+	while( i < mFreeRects.size() )
+	{
+		const Area free = mFreeRects[i];
+		// rects sharing only an edge leave free untouched
+		if( placed.getX1() >= free.getX2() || placed.getX2() <= free.getX1()
+			|| placed.getY1() >= free.getY2() || placed.getY2() <= free.getY1() )
+		{
+			++i;
+			continue;
+		}
+		// keep the (up to four) maximal pieces of free that lie outside placed
+		if( placed.getX1() > free.getX1() )
+		{
+			split.push_back( Area( free.getX1(), free.getY1(), placed.getX1(), free.getY2() ) );
+		}
+		if( placed.getX2() < free.getX2() )
+		{
+			split.push_back( Area( placed.getX2(), free.getY1(), free.getX2(), free.getY2() ) );
+		}
+		if( placed.getY1() > free.getY1() )
+		{
+			split.push_back( Area( free.getX1(), free.getY1(), free.getX2(), placed.getY1() ) );
+		}
+		if( placed.getY2() < free.getY2() )
+		{
+			split.push_back( Area( free.getX1(), placed.getY2(), free.getX2(), free.getY2() ) );
+		}
+		// swap-and-pop; order of free rects doesn't matter
+		mFreeRects[i] = mFreeRects.back();
+		mFreeRects.pop_back();
+	}
+	pruneFreeRects( &split );
+}
+
+void MaxRectsPacker::pruneFreeRects( vector<Area> *split )
+{	// untouched free rects were already maximal, so only the new pieces need checking
+	vector<Area> &pieces = *split;
+	for( size_t i = 0; i < pieces.size(); ++i )
+	{
+		for( size_t j = 0; j < pieces.size(); ++j )
+		{	// of two identical pieces, keep the first
+			if( i != j && contains( pieces[j], pieces[i] ) && ( !( pieces[i] == pieces[j] ) || j < i ) )
+			{
+				pieces.erase( pieces.begin() + i );
+				--i;
+				break;
+			}
+		}
+	}
+	size_t untouched = mFreeRects.size();
+	for( const Area &piece : pieces )
+	{
+		bool redundant = false;
+		size_t j = 0;
+		while( j < untouched && !redundant )
+		{
+			if( contains( mFreeRects[j], piece ) )
+			{
+				redundant = true;
+			}
+			else if( contains( piece, mFreeRects[j] ) )
+			{	// swap the last untouched rect into this slot
+				mFreeRects[j] = mFreeRects[untouched - 1];
+				mFreeRects.erase( mFreeRects.begin() + untouched - 1 );
+				--untouched;
+			}
+			else
+			{
+				++j;
+			}
+		}
+		if( !redundant )
+		{
+			mFreeRects.push_back( piece );
+		}
+	}
+}
+
+vector<Rectf> pockets::placeRects( const vector<Rectf> &rectangles, float containerWidth )
+{	// tallest first keeps the skyline flat; results come back in the order given
+	vector<size_t> order( rectangles.size() );
+	for( size_t i = 0; i < order.size(); ++i )
+	{
+		order[i] = i;
+	}
+	stable_sort( order.begin(), order.end(), [&rectangles]( size_t lhs, size_t rhs )
+	{
+		return rectangles[lhs].getHeight() > rectangles[rhs].getHeight();
+	} );
+	ScanlinePacker packer( containerWidth, ScanlinePacker::eUnconstrained, ScanlinePacker::eSkyline );
+	packer.setPadding( 0.0f );
+	vector<Rectf> placed( rectangles.size() );
+	for( size_t index : order )
+	{
+		placed[index] = packer.getRect( packer.pushRect( rectangles[index] ) );
+	}
+	return placed;
+}
@@ -29,6 +29,9 @@
 
 #include "Pockets.h"
 #include "cinder/Rect.h"
+#include "cinder/Area.h"
+#include <vector>
+#include <map>
 
 namespace pockets
 {
@@ -56,8 +59,20 @@ namespace pockets
 	 ScanlinePacker:
 	 
 	 An online rectangle packer.
-	 Pushing a rectangle into the collection adds it.
-	 Need some kind of id system before allowing removal of objects.
+	 Pushing a rectangle into the collection adds it and returns a handle.
+	 Handles stay valid until the rectangle is removed, and are never reused.
+
+	 Two placement modes are available:
+	 eScanline steps down the sheet by the padding amount, checking every
+	 placed rectangle at each step. Slow, but finds holes anywhere.
+	 eSkyline keeps the upper outline of the placed rectangles and puts each
+	 new rectangle at its lowest point, so an insertion only visits the
+	 segments of that outline. Use it for packing at runtime.
+
+	 Space left by removed rectangles goes into a free-rect index that is
+	 checked before either mode, so long-running packings reuse holes
+	 instead of growing. Call defragment() now and then (e.g. once a frame)
+	 to move low rectangles up into holes and shrink the packed extent.
 	 */
 	class ScanlinePacker
 	{
@@ -65,28 +80,142 @@ namespace pockets
 		enum{
 			eUnconstrained = -1
 		};
+		enum Mode
+		{
+			eScanline,
+			eSkyline
+		};
+		typedef size_t Handle;
 		ScanlinePacker() {}
-		ScanlinePacker( float maxWidth, float maxHeight = eUnconstrained ):
+		ScanlinePacker( float maxWidth, float maxHeight = eUnconstrained, Mode mode = eScanline ):
 		mConstraints( maxWidth, maxHeight ),
-		mPadding( 8.0f, 8.0f )
+		mPadding( 8.0f, 8.0f ),
+		mMode( mode )
 		{}
-		//! adds a new \a rect to the packing and returns its index
-		size_t		pushRect( ci::Rectf rect );
-		//! returns the packed rectangle at \a index
-		ci::Rectf	getRect ( size_t index ) const { return mRectangles.at( index ); }
+		//! adds a new \a rect to the packing and returns its handle
+		Handle		pushRect( ci::Rectf rect );
+		//! removes the rectangle with \a handle, making its space available for reuse
+		void		removeRect( Handle handle );
+		//! returns true if \a handle refers to a packed rectangle
+		bool		contains( Handle handle ) const { return mSlots.count( handle ) > 0; }
+		//! returns the packed rectangle with \a handle
+		ci::Rectf	getRect ( Handle handle ) const { return mRectangles.at( mSlots.at( handle ) ); }
+		//! moves up to \a max_moves of the lowest rectangles into higher holes
+		//! returns the handles that moved so their contents can be copied to the new location
+		//! After removals it also lowers the skyline and recomputes the holes, which costs
+		//! O(rects * holes), so call it when idle rather than after every removal.
+		std::vector<Handle> defragment( size_t max_moves = 1 );
+		//! bottom edge of the lowest packed rectangle
+		float		getExtent() const;
 		//! set the padding between rectangles
 		void		setPadding( float gap ) { mPadding.set( gap, gap ); }
-		void		clear() { mRectangles.clear(); }
+		//! set the placement mode; rectangles already packed stay put and the new mode packs around them
+		void		setMode( Mode mode );
+		Mode		getMode() const { return mMode; }
+		void		clear();
+		//! number of candidate positions tested by all pushRect calls since the last clear
+		//! (placed rects checked for eScanline, skyline segments visited for eSkyline)
+		uint64_t	getInsertionCost() const { return mInsertionCost; }
+		//! regions freed by removeRect that haven't been reused yet
+		const std::vector<ci::Rectf>& getFreeRects() const { return mFreeRects; }
 		//! iterators for traversal through rectangles
 		std::vector<ci::Rectf>::const_iterator begin() const { return mRectangles.begin(); }
 		std::vector<ci::Rectf>::const_iterator end() const { return mRectangles.end(); }
 	private:
+		//! a horizontal span of the outline; everything below y is considered full
+		struct SkylineSegment
+		{
+			float x;
+			float y;
+			float width;
+		};
 		std::vector<ci::Rectf>	mRectangles;
-		size_t					mLastPackedRect;
+		//! handle of each entry in mRectangles
+		std::vector<Handle>		mHandles;
+		//! handle to index in mRectangles
+		std::map<Handle, size_t>	mSlots;
+		Handle					mNextHandle = 0;
+		std::vector<ci::Rectf>	mFreeRects;
+		std::vector<SkylineSegment>	mSkyline;
 		ci::Vec2f				mConstraints;
 		ci::Vec2f				mPadding;
+		Mode					mMode = eScanline;
+		uint64_t				mInsertionCost = 0;
+		//! set when removals or moves may have left the skyline high or the free rects fragmented
+		bool					mNeedsRebuild = false;
+
+		ci::Vec2f	findScanlineLocation( const ci::Rectf &rect );
+		ci::Vec2f	findSkylineLocation( const ci::Rectf &rect );
+		//! finds the best-fitting free rect for \a rect; returns false if none fit
+		bool		findFreeLocation( const ci::Rectf &rect, ci::Vec2f *loc );
+		//! raise the skyline to cover \a rect (including padding)
+		void		addSkylineSegment( const ci::Rectf &rect );
+		//! recompute the skyline from the packed rectangles, lowering it where possible
+		void		rebuildSkyline();
+		//! recompute the free rects as the maximal empty rects below the skyline
+		void		rebuildFreeRects();
+		//! the space \a rect claims, including padding on its right and bottom
+		ci::Rectf	footprint( const ci::Rectf &rect ) const { return ci::Rectf( rect.getUpperLeft(), rect.getLowerRight() + mPadding ); }
+		//! remove \a area from the free rects, keeping the pieces around it
+		void		claimFreeSpace( const ci::Rectf &area );
+		//! add \a area to the free rects, merging with neighbors that share an edge
+		void		releaseFreeSpace( ci::Rectf area );
+	};
+	/**
+	 MaxRectsPacker:
+
+	 A rectangle packer for a fixed-size bin.
+	 Tracks every maximal free rectangle left in the bin, so each insertion
+	 only considers a handful of candidate spots instead of scanning the area.
+	 After placing, every free rectangle the placement overlaps is split
+	 and any free rectangle contained by another is discarded.
+
+	 See Jukka Jylanki, "A Thousand Ways to Pack the Bin" for the heuristics.
+	 */
+	class MaxRectsPacker
+	{
+	public:
+		enum Heuristic
+		{
+			eBestShortSideFit,	// minimize the shorter leftover side of the free rect
+			eBestAreaFit,		// pick the smallest free rect that fits
+			eBottomLeft,		// Tetris-style, lowest top edge then leftmost
+			eContactPoint		// maximize perimeter touching bin edges and placed rects
+		};
+		MaxRectsPacker( int width, int height );
+		//! places a rectangle of \a size; returns false if it doesn't fit anywhere
+		//! with \a allow_rotation, \a size turned 90 degrees is scored too; \a placed then has the
+		//! chosen orientation (width and height swapped when rotated)
+		bool		insert( const ci::Vec2i &size, Heuristic heuristic, ci::Area *placed, bool allow_rotation = false );
+		//! marks \a area as used without searching for a position
+		void		occupy( const ci::Area &area );
+		//! ratio of placed area to the area between the top of the bin and the lowest placed rect
+		float		getOccupancy() const;
+		//! bottom edge of the lowest placed rectangle
+		int			getUsedHeight() const { return mUsedHeight; }
+		int			getWidth() const { return mWidth; }
+		int			getHeight() const { return mHeight; }
+		const std::vector<ci::Area>& getFreeRects() const { return mFreeRects; }
+	private:
+		int						mWidth;
+		int						mHeight;
+		int						mUsedHeight = 0;
+		int64_t					mUsedArea = 0;
+		std::vector<ci::Area>	mFreeRects;
+		std::vector<ci::Area>	mUsedRects;
+
+		//! returns the best location for \a size, or false if none exists; lower scores are better
+		//! \a best_a and \a best_b hold the scores to beat and are updated when a better spot is found
+		bool		findPosition( const ci::Vec2i &size, Heuristic heuristic, ci::Area *placed, int *best_a, int *best_b ) const;
+		int			contactScore( const ci::Area &area ) const;
+		//! split free rects around \a placed and prune the results
+		void		place( const ci::Area &placed );
+		//! adds the maximal pieces of \a split, dropping any contained by another free rect
+		void		pruneFreeRects( std::vector<ci::Area> *split );
 	};
+
 	//! from a list of rectangles, get a list of located rectangles such that
 	//! all fit in a space \a containerWidth wide
+	//! rectangles are placed edge to edge and returned in the order given
 	std::vector<ci::Rectf> placeRects( const std::vector<ci::Rectf> &rectangles, float containerWidth );
 }
@@ -0,0 +1,754 @@
+/*
+ * Copyright (c) 2013 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "PixelFormat.h"
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <limits>
+#include <unordered_map>
+
+using namespace ci;
+using namespace std;
+using namespace pockets;
+
+namespace
+{
+  //! GL enums written to KTX headers; spelled out so this file doesn't need GL
+  struct KtxFormat
+  {
+    PixelFormat format;
+    uint32_t    type;
+    uint32_t    type_size;
+    uint32_t    gl_format;
+    uint32_t    internal_format;
+    uint32_t    base_internal_format;
+  };
+  const KtxFormat cKtxFormats[] = {
+    { eRGBA8888, 0x1401 /* UNSIGNED_BYTE */, 1, 0x1908 /* RGBA */, 0x8058 /* RGBA8 */, 0x1908 },
+    { eRGBA4444, 0x8033 /* UNSIGNED_SHORT_4_4_4_4 */, 2, 0x1908, 0x8056 /* RGBA4 */, 0x1908 },
+    { eRGB565, 0x8363 /* UNSIGNED_SHORT_5_6_5 */, 2, 0x1907 /* RGB */, 0x8D62 /* RGB565 */, 0x1907 },
+    { eIndexed8, 0, 1, 0, 0x8B96 /* PALETTE8_RGBA8_OES */, 0x1908 },
+    { eBC1, 0, 1, 0, 0x83F1 /* COMPRESSED_RGBA_S3TC_DXT1_EXT */, 0x1908 },
+    { eBC3, 0, 1, 0, 0x83F3 /* COMPRESSED_RGBA_S3TC_DXT5_EXT */, 0x1908 }
+  };
+  const uint8_t cKtxIdentifier[12] = { 0xAB, 0x4B, 0x54, 0x58, 0x20, 0x31, 0x31, 0xBB, 0x0D, 0x0A, 0x1A, 0x0A };
+  const size_t  cPaletteSize = 256;
+
+  struct Rgba
+  {
+    uint8_t r, g, b, a;
+  };
+
+  //! copy of \a surface as tightly-packed RGBA
+  vector<Rgba> readPixels( const Surface &surface )
+  {
+    vector<Rgba> pixels( surface.getWidth() * surface.getHeight() );
+    const SurfaceChannelOrder &order = surface.getChannelOrder();
+    const int inc = surface.getPixelInc();
+    const bool has_alpha = surface.hasAlpha();
+    for( int y = 0; y < surface.getHeight(); ++y )
+    {
+      const uint8_t *in = surface.getData() + y * surface.getRowBytes();
+      Rgba *out = &pixels[y * surface.getWidth()];
+      for( int x = 0; x < surface.getWidth(); ++x, in += inc )
+      {
+        out[x] = Rgba{ in[order.getRedOffset()], in[order.getGreenOffset()], in[order.getBlueOffset()],
+                       has_alpha ? in[order.getAlphaOffset()] : static_cast<uint8_t>( 255 ) };
+      }
+    }
+    return pixels;
+  }
+
+  size_t alignedRowBytes( size_t bytes )
+  {
+    return ( bytes + 3 ) & ~size_t( 3 );
+  }
+
+  size_t imageSize( PixelFormat format, int32_t width, int32_t height )
+  {
+    const size_t blocks = static_cast<size_t>( ( width + 3 ) / 4 ) * ( ( height + 3 ) / 4 );
+    switch( format )
+    {
+      case eRGBA8888: return width * 4 * static_cast<size_t>( height );
+      case eRGBA4444:
+      case eRGB565:   return alignedRowBytes( width * 2 ) * height;
+      case eIndexed8: return cPaletteSize * 4 + static_cast<size_t>( width ) * height;
+      case eBC1:      return blocks * 8;
+      case eBC3:      return blocks * 16;
+    }
+    return 0;
+  }
+
+  //! value of an n-bit channel as an 8-bit one
+  inline uint8_t expand( int value, int bits )
+  {
+    const int max = ( 1 << bits ) - 1;
+    return static_cast<uint8_t>( ( value * 255 + max / 2 ) / max );
+  }
+
+  inline int distance( const Rgba &lhs, const Rgba &rhs )
+  {
+    const int r = lhs.r - rhs.r;
+    const int g = lhs.g - rhs.g;
+    const int b = lhs.b - rhs.b;
+    const int a = lhs.a - rhs.a;
+    return r * r + g * g + b * b + a * a;
+  }
+
+  /**
+   Floyd-Steinberg error diffusion.
+   \a quantize maps a color (channels may be out of range) to the nearest
+   representable one and returns its code; errors spread to unvisited neighbors.
+   */
+  template<typename Quantize>
+  void diffuse( const vector<Rgba> &pixels, int width, int height, bool dither, const Quantize &quantize )
+  {
+    // error for this row and the next, with a guard column on each side
+    vector<float> current( ( width + 2 ) * 4, 0.0f );
+    vector<float> next( ( width + 2 ) * 4, 0.0f );
+    for( int y = 0; y < height; ++y )
+    {
+      fill( next.begin(), next.end(), 0.0f );
+      for( int x = 0; x < width; ++x )
+      {
+        const Rgba &pixel = pixels[y * width + x];
+        float *error = &current[( x + 1 ) * 4];
+        float wanted[4] = { pixel.r + error[0], pixel.g + error[1], pixel.b + error[2], pixel.a + error[3] };
+        if( !dither || pixel.a == 0 )
+        { // transparent pixels keep clear of their neighbors' error
+          wanted[0] = pixel.r; wanted[1] = pixel.g; wanted[2] = pixel.b; wanted[3] = pixel.a;
+        }
+        for( float &channel : wanted )
+        {
+          channel = min( max( channel, 0.0f ), 255.0f );
+        }
+        const Rgba got = quantize( x, y, wanted );
+        if( !dither || pixel.a == 0 )
+        {
+          continue;
+        }
+        const float diff[4] = { wanted[0] - got.r, wanted[1] - got.g, wanted[2] - got.b, wanted[3] - got.a };
+        for( int c = 0; c < 4; ++c )
+        {
+          current[( x + 2 ) * 4 + c] += diff[c] * 7.0f / 16.0f;
+          next[x * 4 + c]            += diff[c] * 3.0f / 16.0f;
+          next[( x + 1 ) * 4 + c]    += diff[c] * 5.0f / 16.0f;
+          next[( x + 2 ) * 4 + c]    += diff[c] * 1.0f / 16.0f;
+        }
+      }
+      current.swap( next );
+    }
+  }
+
+  inline int quantizeChannel( float value, int bits )
+  {
+    return static_cast<int>( value * ( ( 1 << bits ) - 1 ) / 255.0f + 0.5f );
+  }
+
+  void encodePacked16( const vector<Rgba> &pixels, EncodedImage *image, bool dither )
+  {
+    const bool alpha = image->format == eRGBA4444;
+    const size_t row_bytes = alignedRowBytes( image->width * 2 );
+    diffuse( pixels, image->width, image->height, dither, [&]( int x, int y, const float *wanted )
+    {
+      uint16_t code;
+      Rgba got;
+      if( alpha )
+      {
+        const int r = quantizeChannel( wanted[0], 4 ), g = quantizeChannel( wanted[1], 4 ), b = quantizeChannel( wanted[2], 4 ), a = quantizeChannel( wanted[3], 4 );
+        code = static_cast<uint16_t>( ( r << 12 ) | ( g << 8 ) | ( b << 4 ) | a );
+        got = Rgba{ expand( r, 4 ), expand( g, 4 ), expand( b, 4 ), expand( a, 4 ) };
+      }
+      else
+      { // alpha isn't stored, so it carries no error
+        const int r = quantizeChannel( wanted[0], 5 ), g = quantizeChannel( wanted[1], 6 ), b = quantizeChannel( wanted[2], 5 );
+        code = static_cast<uint16_t>( ( r << 11 ) | ( g << 5 ) | b );
+        got = Rgba{ expand( r, 5 ), expand( g, 6 ), expand( b, 5 ), static_cast<uint8_t>( wanted[3] + 0.5f ) };
+      }
+      memcpy( &image->data[y * row_bytes + x * 2], &code, sizeof( code ) );
+      return got;
+    } );
+  }
+
+  //! median cut over the distinct colors of \a pixels
+  //! if any pixel is fully transparent, entry 0 is reserved for clear
+  vector<Rgba> buildPalette( const vector<Rgba> &pixels )
+  {
+    struct Entry
+    {
+      Rgba      color;
+      uint32_t  count;
+    };
+    unordered_map<uint32_t, uint32_t> counts;
+    bool transparent = false;
+    for( const Rgba &pixel : pixels )
+    {
+      if( pixel.a == 0 )
+      {
+        transparent = true;
+        continue;
+      }
+      uint32_t key;
+      memcpy( &key, &pixel, sizeof( key ) );
+      counts[key] += 1;
+    }
+    vector<Entry> entries;
+    entries.reserve( counts.size() );
+    for( const auto &pair : counts )
+    {
+      Rgba color;
+      memcpy( &color, &pair.first, sizeof( color ) );
+      entries.push_back( Entry{ color, pair.second } );
+    }
+
+    vector<Rgba> palette;
+    if( transparent )
+    {
+      palette.push_back( Rgba{ 0, 0, 0, 0 } );
+    }
+    const size_t wanted = cPaletteSize - palette.size();
+    // boxes are [begin, end) ranges of entries
+    vector<pair<size_t, size_t>> boxes;
+    if( !entries.empty() )
+    {
+      boxes.push_back( make_pair( size_t( 0 ), entries.size() ) );
+    }
+    auto channel = []( const Rgba &color, int c ){ return c == 0 ? color.r : c == 1 ? color.g : c == 2 ? color.b : color.a; };
+    auto widest = [&]( const pair<size_t, size_t> &box, int *range )
+    {
+      int best = 0;
+      *range = -1;
+      for( int c = 0; c < 4; ++c )
+      {
+        int lo = 255, hi = 0;
+        for( size_t i = box.first; i < box.second; ++i )
+        {
+          lo = min<int>( lo, channel( entries[i].color, c ) );
+          hi = max<int>( hi, channel( entries[i].color, c ) );
+        }
+        if( hi - lo > *range )
+        {
+          *range = hi - lo;
+          best = c;
+        }
+      }
+      return best;
+    };
+    while( boxes.size() < wanted )
+    { // split the box with the widest spread, at its weighted median
+      size_t split = boxes.size();
+      int split_range = 0;
+      int split_channel = 0;
+      for( size_t i = 0; i < boxes.size(); ++i )
+      {
+        int range;
+        const int c = widest( boxes[i], &range );
+        if( boxes[i].second - boxes[i].first > 1 && range > split_range )
+        {
+          split = i;
+          split_range = range;
+          split_channel = c;
+        }
+      }
+      if( split == boxes.size() )
+      { // every box is a single color
+        break;
+      }
+      const pair<size_t, size_t> box = boxes[split];
+      sort( entries.begin() + box.first, entries.begin() + box.second, [&]( const Entry &lhs, const Entry &rhs )
+      {
+        return channel( lhs.color, split_channel ) < channel( rhs.color, split_channel );
+      } );
+      uint64_t total = 0;
+      for( size_t i = box.first; i < box.second; ++i )
+      {
+        total += entries[i].count;
+      }
+      uint64_t running = 0;
+      size_t middle = box.first + 1;
+      for( size_t i = box.first; i < box.second - 1; ++i )
+      {
+        running += entries[i].count;
+        middle = i + 1;
+        if( running * 2 >= total )
+        {
+          break;
+        }
+      }
+      boxes[split] = make_pair( box.first, middle );
+      boxes.push_back( make_pair( middle, box.second ) );
+    }
+    for( const auto &box : boxes )
+    {
+      uint64_t sum[4] = { 0, 0, 0, 0 };
+      uint64_t total = 0;
+      for( size_t i = box.first; i < box.second; ++i )
+      {
+        const Entry &entry = entries[i];
+        sum[0] += entry.color.r * uint64_t( entry.count );
+        sum[1] += entry.color.g * uint64_t( entry.count );
+        sum[2] += entry.color.b * uint64_t( entry.count );
+        sum[3] += entry.color.a * uint64_t( entry.count );
+        total += entry.count;
+      }
+      palette.push_back( Rgba{ uint8_t( ( sum[0] + total / 2 ) / total ), uint8_t( ( sum[1] + total / 2 ) / total ),
+                               uint8_t( ( sum[2] + total / 2 ) / total ), uint8_t( ( sum[3] + total / 2 ) / total ) } );
+    }
+    palette.resize( cPaletteSize, Rgba{ 0, 0, 0, 0 } );
+    return palette;
+  }
+
+  void encodeIndexed( const vector<Rgba> &pixels, EncodedImage *image, bool dither )
+  {
+    const vector<Rgba> palette = buildPalette( pixels );
+    memcpy( image->data.data(), palette.data(), cPaletteSize * 4 );
+    uint8_t *indices = image->data.data() + cPaletteSize * 4;
+    const bool reserved_clear = palette[0].a == 0;
+    // nearest palette entry for each color at 5 bits per channel, filled in as colors come up
+    vector<uint16_t> nearest( 1 << 20, 0xFFFF );
+    diffuse( pixels, image->width, image->height, dither, [&]( int x, int y, const float *wanted )
+    {
+      const Rgba color{ uint8_t( wanted[0] + 0.5f ), uint8_t( wanted[1] + 0.5f ), uint8_t( wanted[2] + 0.5f ), uint8_t( wanted[3] + 0.5f ) };
+      uint8_t index = 0;
+      if( !( reserved_clear && color.a == 0 ) )
+      {
+        const uint32_t key = ( color.r >> 3 ) << 15 | ( color.g >> 3 ) << 10 | ( color.b >> 3 ) << 5 | ( color.a >> 3 );
+        if( nearest[key] == 0xFFFF )
+        {
+          int best = numeric_limits<int>::max();
+          for( size_t i = reserved_clear ? 1 : 0; i < cPaletteSize; ++i )
+          {
+            const int d = distance( color, palette[i] );
+            if( d < best )
+            {
+              best = d;
+              nearest[key] = static_cast<uint16_t>( i );
+            }
+          }
+        }
+        index = static_cast<uint8_t>( nearest[key] );
+      }
+      indices[y * image->width + x] = index;
+      return palette[index];
+    } );
+  }
+
+  inline uint16_t to565( int r, int g, int b )
+  {
+    return static_cast<uint16_t>( ( ( r * 31 + 127 ) / 255 ) << 11 | ( ( g * 63 + 127 ) / 255 ) << 5 | ( ( b * 31 + 127 ) / 255 ) );
+  }
+
+  inline Rgba from565( uint16_t color )
+  {
+    return Rgba{ expand( color >> 11, 5 ), expand( ( color >> 5 ) & 63, 6 ), expand( color & 31, 5 ), 255 };
+  }
+
+  //! the four (or three plus clear) colors a BC1 block can use
+  void colorPalette( uint16_t c0, uint16_t c1, bool four_color, Rgba *palette )
+  {
+    palette[0] = from565( c0 );
+    palette[1] = from565( c1 );
+    if( four_color )
+    {
+      palette[2] = Rgba{ uint8_t( ( 2 * palette[0].r + palette[1].r ) / 3 ), uint8_t( ( 2 * palette[0].g + palette[1].g ) / 3 ), uint8_t( ( 2 * palette[0].b + palette[1].b ) / 3 ), 255 };
+      palette[3] = Rgba{ uint8_t( ( palette[0].r + 2 * palette[1].r ) / 3 ), uint8_t( ( palette[0].g + 2 * palette[1].g ) / 3 ), uint8_t( ( palette[0].b + 2 * palette[1].b ) / 3 ), 255 };
+    }
+    else
+    {
+      palette[2] = Rgba{ uint8_t( ( palette[0].r + palette[1].r ) / 2 ), uint8_t( ( palette[0].g + palette[1].g ) / 2 ), uint8_t( ( palette[0].b + palette[1].b ) / 2 ), 255 };
+      palette[3] = Rgba{ 0, 0, 0, 0 };
+    }
+  }
+
+  //! encodes the colors of a 4x4 block; with \a punch_through, pixels under half alpha become clear (BC1 only)
+  void encodeColorBlock( const Rgba *block, bool punch_through, uint8_t *out )
+  {
+    bool any_clear = false;
+    int lo[3] = { 255, 255, 255 };
+    int hi[3] = { 0, 0, 0 };
+    int mean[3] = { 0, 0, 0 };
+    int solid = 0;
+    for( int i = 0; i < 16; ++i )
+    {
+      if( punch_through && block[i].a < 128 )
+      {
+        any_clear = true;
+        continue;
+      }
+      const int c[3] = { block[i].r, block[i].g, block[i].b };
+      for( int k = 0; k < 3; ++k )
+      {
+        lo[k] = min( lo[k], c[k] );
+        hi[k] = max( hi[k], c[k] );
+        mean[k] += c[k];
+      }
+      solid += 1;
+    }
+    uint16_t c0 = 0;
+    uint16_t c1 = 0;
+    if( solid > 0 )
+    { // pick the bounding box diagonal that follows how red and blue vary with green
+      int cov_rg = 0, cov_bg = 0;
+      for( int i = 0; i < 16; ++i )
+      {
+        if( punch_through && block[i].a < 128 )
+        {
+          continue;
+        }
+        const int g = block[i].g * solid - mean[1];
+        cov_rg += ( block[i].r * solid - mean[0] ) * g / 256;
+        cov_bg += ( block[i].b * solid - mean[2] ) * g / 256;
+      }
+      if( cov_rg < 0 )
+      {
+        swap( lo[0], hi[0] );
+      }
+      if( cov_bg < 0 )
+      {
+        swap( lo[2], hi[2] );
+      }
+      // inset the box slightly, since the extremes are rarely worth matching exactly
+      for( int k = 0; k < 3; ++k )
+      {
+        const int inset = ( hi[k] - lo[k] ) / 16;
+        hi[k] -= inset;
+        lo[k] += inset;
+      }
+      c0 = to565( hi[0], hi[1], hi[2] );
+      c1 = to565( lo[0], lo[1], lo[2] );
+    }
+    // c0 > c1 selects four colors, otherwise three plus clear
+    const bool four_color = !any_clear;
+    if( ( four_color && c0 < c1 ) || ( !four_color && c0 > c1 ) )
+    {
+      swap( c0, c1 );
+    }
+    Rgba palette[4];
+    colorPalette( c0, c1, four_color || c0 > c1, palette );
+    uint32_t indices = 0;
+    for( int i = 0; i < 16; ++i )
+    {
+      uint32_t index = 3;
+      if( !( any_clear && block[i].a < 128 ) )
+      {
+        const Rgba opaque{ block[i].r, block[i].g, block[i].b, 255 };
+        int best = numeric_limits<int>::max();
+        for( uint32_t p = 0; p < ( four_color ? 4u : 3u ); ++p )
+        {
+          const int d = distance( opaque, palette[p] );
+          if( d < best )
+          {
+            best = d;
+            index = p;
+          }
+        }
+      }
+      indices |= index << ( i * 2 );
+    }
+    memcpy( out, &c0, 2 );
+    memcpy( out + 2, &c1, 2 );
+    memcpy( out + 4, &indices, 4 );
+  }
+
+  void alphaPalette( uint8_t a0, uint8_t a1, uint8_t *palette )
+  {
+    palette[0] = a0;
+    palette[1] = a1;
+    if( a0 > a1 )
+    {
+      for( int i = 1; i < 7; ++i )
+      {
+        palette[i + 1] = static_cast<uint8_t>( ( ( 7 - i ) * a0 + i * a1 ) / 7 );
+      }
+    }
+    else
+    {
+      for( int i = 1; i < 5; ++i )
+      {
+        palette[i + 1] = static_cast<uint8_t>( ( ( 5 - i ) * a0 + i * a1 ) / 5 );
+      }
+      palette[6] = 0;
+      palette[7] = 255;
+    }
+  }
+
+  void encodeAlphaBlock( const Rgba *block, uint8_t *out )
+  {
+    uint8_t lo = 255, hi = 0;
+    for( int i = 0; i < 16; ++i )
+    {
+      lo = min( lo, block[i].a );
+      hi = max( hi, block[i].a );
+    }
+    uint8_t palette[8];
+    alphaPalette( hi, lo, palette );
+    uint64_t indices = 0;
+    for( int i = 0; i < 16; ++i )
+    {
+      uint64_t index = 0;
+      int best = numeric_limits<int>::max();
+      for( uint64_t p = 0; p < 8; ++p )
+      {
+        const int d = abs( block[i].a - palette[p] );
+        if( d < best )
+        {
+          best = d;
+          index = p;
+        }
+      }
+      indices |= index << ( i * 3 );
+    }
+    out[0] = hi;
+    out[1] = lo;
+    for( int i = 0; i < 6; ++i )
+    {
+      out[2 + i] = static_cast<uint8_t>( indices >> ( i * 8 ) );
+    }
+  }
+
+  void encodeBlocks( const vector<Rgba> &pixels, EncodedImage *image )
+  {
+    const int width = image->width;
+    const int height = image->height;
+    const size_t block_size = image->format == eBC1 ? 8 : 16;
+    uint8_t *out = image->data.data();
+    for( int by = 0; by < height; by += 4 )
+    {
+      for( int bx = 0; bx < width; bx += 4, out += block_size )
+      {
+        Rgba block[16];
+        for( int i = 0; i < 16; ++i )
+        { // blocks hanging off the edge repeat the last row and column
+          const int x = min( bx + i % 4, width - 1 );
+          const int y = min( by + i / 4, height - 1 );
+          block[i] = pixels[y * width + x];
+        }
+        if( image->format == eBC1 )
+        {
+          encodeColorBlock( block, true, out );
+        }
+        else
+        {
+          encodeAlphaBlock( block, out );
+          encodeColorBlock( block, false, out + 8 );
+        }
+      }
+    }
+  }
+
+  void decodeBlocks( const EncodedImage &image, Surface *surface )
+  {
+    const size_t block_size = image.format == eBC1 ? 8 : 16;
+    const uint8_t *in = image.data.data();
+    for( int by = 0; by < image.height; by += 4 )
+    {
+      for( int bx = 0; bx < image.width; bx += 4, in += block_size )
+      {
+        const uint8_t *color = image.format == eBC1 ? in : in + 8;
+        uint16_t c0, c1;
+        uint32_t indices;
+        memcpy( &c0, color, 2 );
+        memcpy( &c1, color + 2, 2 );
+        memcpy( &indices, color + 4, 4 );
+        Rgba palette[4];
+        // BC3 color blocks always use four colors
+        colorPalette( c0, c1, image.format == eBC3 || c0 > c1, palette );
+        uint8_t alphas[8];
+        uint64_t alpha_indices = 0;
+        if( image.format == eBC3 )
+        {
+          alphaPalette( in[0], in[1], alphas );
+          for( int i = 0; i < 6; ++i )
+          {
+            alpha_indices |= uint64_t( in[2 + i] ) << ( i * 8 );
+          }
+        }
+        for( int i = 0; i < 16; ++i )
+        {
+          const int x = bx + i % 4;
+          const int y = by + i / 4;
+          if( x >= image.width || y >= image.height )
+          {
+            continue;
+          }
+          Rgba pixel = palette[( indices >> ( i * 2 ) ) & 3];
+          if( image.format == eBC3 )
+          {
+            pixel.a = alphas[( alpha_indices >> ( i * 3 ) ) & 7];
+          }
+          memcpy( surface->getData( Vec2i( x, y ) ), &pixel, 4 );
+        }
+      }
+    }
+  }
+} // anon::
+
+EncodedImage pockets::encodeImage( const Surface &surface, PixelFormat format, bool dither )
+{
+  EncodedImage image;
+  image.format = format;
+  image.width = surface.getWidth();
+  image.height = surface.getHeight();
+  image.data.assign( imageSize( format, image.width, image.height ), 0 );
+  const vector<Rgba> pixels = readPixels( surface );
+  switch( format )
+  {
+    case eRGBA8888:
+      memcpy( image.data.data(), pixels.data(), image.data.size() );
+    break;
+    case eRGBA4444:
+    case eRGB565:
+      encodePacked16( pixels, &image, dither );
+    break;
+    case eIndexed8:
+      encodeIndexed( pixels, &image, dither );
+    break;
+    case eBC1:
+    case eBC3:
+      encodeBlocks( pixels, &image );
+    break;
+  }
+  return image;
+}
+
+Surface pockets::decodeImage( const EncodedImage &image )
+{
+  Surface surface( image.width, image.height, true, SurfaceChannelOrder::RGBA );
+  const size_t row_bytes = alignedRowBytes( image.width * 2 );
+  for( int y = 0; y < image.height && image.format != eBC1 && image.format != eBC3; ++y )
+  {
+    uint8_t *out = surface.getData( Vec2i( 0, y ) );
+    for( int x = 0; x < image.width; ++x, out += 4 )
+    {
+      Rgba pixel;
+      uint16_t code;
+      switch( image.format )
+      {
+        case eRGBA8888:
+          memcpy( &pixel, &image.data[( y * image.width + x ) * 4], 4 );
+        break;
+        case eRGBA4444:
+          memcpy( &code, &image.data[y * row_bytes + x * 2], 2 );
+          pixel = Rgba{ expand( code >> 12, 4 ), expand( ( code >> 8 ) & 15, 4 ), expand( ( code >> 4 ) & 15, 4 ), expand( code & 15, 4 ) };
+        break;
+        case eRGB565:
+          memcpy( &code, &image.data[y * row_bytes + x * 2], 2 );
+          pixel = from565( code );
+        break;
+        case eIndexed8:
+          memcpy( &pixel, &image.data[image.data[cPaletteSize * 4 + y * image.width + x] * 4], 4 );
+        break;
+        default:
+        break;
+      }
+      memcpy( out, &pixel, 4 );
+    }
+  }
+  if( image.format == eBC1 || image.format == eBC3 )
+  {
+    decodeBlocks( image, &surface );
+  }
+  return surface;
+}
+
+double pockets::measurePsnr( const Surface &reference, const Surface &test, const Area &area )
+{
+  const Area bounds = area.getClipBy( reference.getBounds() ).getClipBy( test.getBounds() );
+  double squared_error = 0.0;
+  for( int y = bounds.y1; y < bounds.y2; ++y )
+  {
+    for( int x = bounds.x1; x < bounds.x2; ++x )
+    {
+      const ColorA8u lhs = reference.getPixel( Vec2i( x, y ) );
+      const ColorA8u rhs = test.getPixel( Vec2i( x, y ) );
+      squared_error += distance( Rgba{ lhs.r, lhs.g, lhs.b, lhs.a }, Rgba{ rhs.r, rhs.g, rhs.b, rhs.a } );
+    }
+  }
+  const double samples = 4.0 * bounds.calcArea();
+  if( squared_error == 0.0 || samples == 0.0 )
+  {
+    return numeric_limits<double>::infinity();
+  }
+  return 10.0 * log10( 255.0 * 255.0 * samples / squared_error );
+}
+
+Buffer pockets::writeKtx( const EncodedImage &image )
+{
+  const KtxFormat &format = cKtxFormats[image.format];
+  const uint32_t header[] = {
+    0x04030201,   // endianness
+    format.type,
+    format.type_size,
+    format.gl_format,
+    format.internal_format,
+    format.base_internal_format,
+    static_cast<uint32_t>( image.width ),
+    static_cast<uint32_t>( image.height ),
+    0,            // depth
+    0,            // array elements
+    1,            // faces
+    1,            // mipmap levels
+    0,            // key/value bytes
+    static_cast<uint32_t>( image.data.size() )
+  };
+  Buffer buffer( sizeof( cKtxIdentifier ) + sizeof( header ) + alignedRowBytes( image.data.size() ) );
+  uint8_t *out = static_cast<uint8_t*>( buffer.getData() );
+  memset( out, 0, buffer.getDataSize() );
+  memcpy( out, cKtxIdentifier, sizeof( cKtxIdentifier ) );
+  memcpy( out + sizeof( cKtxIdentifier ), header, sizeof( header ) );
+  memcpy( out + sizeof( cKtxIdentifier ) + sizeof( header ), image.data.data(), image.data.size() );
+  return buffer;
+}
+
+bool pockets::readKtx( const uint8_t *data, size_t size, EncodedImage *image )
+{
+  uint32_t header[14];
+  if( size < sizeof( cKtxIdentifier ) + sizeof( header ) || memcmp( data, cKtxIdentifier, sizeof( cKtxIdentifier ) ) != 0 )
+  {
+    return false;
+  }
+  memcpy( header, data + sizeof( cKtxIdentifier ), sizeof( header ) );
+  const KtxFormat *format = find_if( begin( cKtxFormats ), end( cKtxFormats ), [&]( const KtxFormat &f ){ return f.internal_format == header[4]; } );
+  // only the single-image, native-endian files writeKtx makes
+  if( header[0] != 0x04030201 || format == end( cKtxFormats ) || header[10] != 1 || header[11] > 1 || header[12] != 0 )
+  {
+    return false;
+  }
+  image->format = format->format;
+  image->width = header[6];
+  image->height = header[7];
+  const size_t expected = imageSize( image->format, image->width, image->height );
+  if( header[13] != expected || size < sizeof( cKtxIdentifier ) + sizeof( header ) + expected )
+  {
+    return false;
+  }
+  const uint8_t *pixels = data + sizeof( cKtxIdentifier ) + sizeof( header );
+  image->data.assign( pixels, pixels + expected );
+  return true;
+}
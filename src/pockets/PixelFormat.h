@@ -0,0 +1,80 @@
+/*
+ * Copyright (c) 2013 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+#include "Pockets.h"
+#include "cinder/Surface.h"
+#include "cinder/Buffer.h"
+#include "cinder/Area.h"
+#include <vector>
+
+namespace pockets
+{
+  /**
+   Reduced-footprint pixel formats for atlas pages.
+
+   16-bit formats and the indexed format diffuse quantization error to
+   neighboring pixels (Floyd-Steinberg). Fully transparent pixels neither
+   give nor take error, so padding between sprites stays clear.
+   Block-compressed formats are encoded on the CPU, one 4x4 block at a time,
+   fitting endpoints to the block's color bounding box.
+
+   Encoded images are saved as KTX 1.1, which TextureAtlas uploads directly.
+   */
+  enum PixelFormat
+  {
+    eRGBA8888,  // 32 bits per pixel, lossless
+    eRGBA4444,  // 16 bits per pixel
+    eRGB565,    // 16 bits per pixel, no alpha
+    eIndexed8,  // 8 bits per pixel into a 256-color RGBA palette (GL_PALETTE8_RGBA8_OES layout)
+    eBC1,       // 4 bits per pixel, 1-bit alpha (DXT1)
+    eBC3        // 8 bits per pixel, smooth alpha (DXT5)
+  };
+
+  //! pixel data laid out the way GL expects it for \a format
+  //! uncompressed rows are padded to four bytes (GL_UNPACK_ALIGNMENT 4)
+  struct EncodedImage
+  {
+    PixelFormat           format = eRGBA8888;
+    int32_t               width = 0;
+    int32_t               height = 0;
+    std::vector<uint8_t>  data;
+  };
+
+  //! encodes \a surface, which is read as straight or premultiplied RGBA, into \a format
+  EncodedImage  encodeImage( const ci::Surface &surface, PixelFormat format, bool dither = true );
+  //! expands \a image to RGBA, for measuring quality or for GLs that can't sample its format
+  ci::Surface   decodeImage( const EncodedImage &image );
+  //! peak signal-to-noise ratio of \a test against \a reference over the RGBA channels within \a area, in decibels
+  //! returns infinity where the two are identical
+  double        measurePsnr( const ci::Surface &reference, const ci::Surface &test, const ci::Area &area );
+  //! wraps \a image in a KTX 1.1 file
+  ci::Buffer    writeKtx( const EncodedImage &image );
+  //! reads a KTX file written by writeKtx; returns false if \a data isn't one
+  bool          readKtx( const uint8_t *data, size_t size, EncodedImage *image );
+} // pockets::
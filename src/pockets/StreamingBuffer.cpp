@@ -0,0 +1,246 @@
+/*
+ * Copyright (c) 2013 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "pockets/StreamingBuffer.h"
+#include "cinder/gl/Context.h"
+
+using namespace std;
+using namespace cinder;
+using namespace pockets;
+
+StreamingBufferRef StreamingBuffer::create( size_t stride, size_t capacity, size_t regions )
+{
+  return StreamingBufferRef( new StreamingBuffer( stride, capacity, regions ) );
+}
+
+StreamingBuffer::StreamingBuffer( size_t stride, size_t capacity, size_t regions ):
+mStride( stride ),
+mRegionCount( max<size_t>( regions, 1 ) )
+{
+#if ! defined( CINDER_GL_ES_2 )
+  mFences.assign( mRegionCount, nullptr );
+#endif
+  allocate( max<size_t>( capacity, 1 ) );
+}
+
+StreamingBuffer::~StreamingBuffer()
+{
+  clearFences();
+#if defined( GL_MAP_PERSISTENT_BIT )
+  if( mPersistent )
+  {
+    gl::ScopedBuffer buffer( mVbo );
+    glUnmapBuffer( GL_ARRAY_BUFFER );
+  }
+#endif
+}
+
+void StreamingBuffer::allocate( size_t capacity )
+{
+  clearFences();
+  mCapacity = capacity;
+  mRegion = mRegionCount - 1; // so the next map starts at the first region
+  const size_t size = mCapacity * mStride * mRegionCount;
+#if defined( GL_MAP_PERSISTENT_BIT )
+  static const bool persistent_available = gl::isExtensionAvailable( "GL_ARB_buffer_storage" );
+  if( persistent_available )
+  { // immutable storage can't be resized; replace the whole buffer object
+    if( mPersistent )
+    {
+      gl::ScopedBuffer buffer( mVbo );
+      glUnmapBuffer( GL_ARRAY_BUFFER );
+      mPersistent = nullptr;
+    }
+    mVbo = gl::Vbo::create( GL_ARRAY_BUFFER );
+    mGeneration += 1;
+    gl::ScopedBuffer buffer( mVbo );
+    const GLbitfield flags = GL_MAP_WRITE_BIT | GL_MAP_PERSISTENT_BIT | GL_MAP_COHERENT_BIT;
+    glBufferStorage( GL_ARRAY_BUFFER, size, nullptr, flags );
+    mPersistent = static_cast<uint8_t*>( glMapBufferRange( GL_ARRAY_BUFFER, 0, size, flags ) );
+    if( mPersistent )
+    {
+      return;
+    }
+    // mapping failed; fall back to a mutable buffer below
+    mVbo.reset();
+  }
+#endif
+  if( !mVbo )
+  {
+    mVbo = gl::Vbo::create( GL_ARRAY_BUFFER );
+    mGeneration += 1;
+  }
+  // respecifying the same buffer orphans the old storage, so pending draws keep it
+  mVbo->bufferData( size, nullptr, GL_STREAM_DRAW );
+}
+
+void StreamingBuffer::clearFences()
+{
+#if ! defined( CINDER_GL_ES_2 )
+  for( GLsync &fence : mFences )
+  {
+    if( fence )
+    {
+      glDeleteSync( fence );
+      fence = nullptr;
+    }
+  }
+#endif
+}
+
+void StreamingBuffer::waitFor( size_t region )
+{
+#if ! defined( CINDER_GL_ES_2 )
+  GLsync &fence = mFences[region];
+  if( fence )
+  {
+    GLenum result = glClientWaitSync( fence, 0, 0 );
+    while( result == GL_TIMEOUT_EXPIRED )
+    { // the GPU is still reading this region; make sure the fence gets submitted, then wait
+      result = glClientWaitSync( fence, GL_SYNC_FLUSH_COMMANDS_BIT, 1000000 );
+    }
+    glDeleteSync( fence );
+    fence = nullptr;
+  }
+#endif
+}
+
+void StreamingBuffer::advance( size_t count )
+{
+  if( count > mCapacity )
+  { // grow with headroom so steadily rising counts don't reallocate every frame
+    allocate( max( count, mCapacity * 2 ) );
+  }
+  mRegion = ( mRegion + 1 ) % mRegionCount;
+  mMappedCount = count;
+  waitFor( mRegion );
+}
+
+void* StreamingBuffer::map( size_t count )
+{
+  advance( count );
+  const size_t offset = mRegion * mCapacity * mStride;
+  if( mPersistent )
+  {
+    return mPersistent + offset;
+  }
+#if ! defined( CINDER_GL_ES_2 )
+  if( count > 0 )
+  { // the fence already guarantees the GPU is done with this range
+    gl::ScopedBuffer buffer( mVbo );
+    void *data = mVbo->mapBufferRange( offset, count * mStride, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_RANGE_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+    if( data )
+    {
+      mMapped = true;
+      return data;
+    }
+  }
+#endif
+  mScratch.resize( count * mStride );
+  return mScratch.data();
+}
+
+void* StreamingBuffer::mapRetained( size_t count )
+{
+  advance( count );
+  mRetaining = true;
+  const size_t offset = mRegion * mCapacity * mStride;
+  if( mPersistent )
+  {
+    return mPersistent + offset;
+  }
+#if ! defined( CINDER_GL_ES_2 )
+  if( count > 0 )
+  { // no invalidation, so the region keeps its contents; only flushed ranges are written back
+    gl::ScopedBuffer buffer( mVbo );
+    void *data = mVbo->mapBufferRange( offset, count * mStride, GL_MAP_WRITE_BIT | GL_MAP_FLUSH_EXPLICIT_BIT | GL_MAP_UNSYNCHRONIZED_BIT );
+    if( data )
+    {
+      mMapped = true;
+      return data;
+    }
+  }
+#endif
+  // keep a copy of every region so unflushed elements stay as they were
+  mScratch.resize( mRegionCount * mCapacity * mStride );
+  mFlushed.clear();
+  return mScratch.data() + offset;
+}
+
+void StreamingBuffer::flush( size_t first, size_t count )
+{
+  if( !mRetaining || count == 0 || mPersistent )
+  { // persistent storage is coherent, and plain maps write everything on unmap
+    return;
+  }
+#if ! defined( CINDER_GL_ES_2 )
+  if( mMapped )
+  {
+    gl::ScopedBuffer buffer( mVbo );
+    glFlushMappedBufferRange( GL_ARRAY_BUFFER, first * mStride, count * mStride );
+    return;
+  }
+#endif
+  mFlushed.emplace_back( first, count );
+}
+
+size_t StreamingBuffer::unmap()
+{
+  const size_t offset = mRegion * mCapacity * mStride;
+  if( mMapped )
+  {
+    gl::ScopedBuffer buffer( mVbo );
+    mVbo->unmap();
+    mMapped = false;
+  }
+  else if( mRetaining )
+  {
+    for( const auto &range : mFlushed )
+    {
+      const size_t start = offset + range.first * mStride;
+      mVbo->bufferSubData( start, range.second * mStride, mScratch.data() + start );
+    }
+    mFlushed.clear();
+  }
+  else if( !mPersistent && mMappedCount > 0 )
+  {
+    mVbo->bufferSubData( offset, mMappedCount * mStride, mScratch.data() );
+  }
+  mRetaining = false;
+  return mRegion * mCapacity;
+}
+
+void StreamingBuffer::fence()
+{
+#if ! defined( CINDER_GL_ES_2 )
+  if( mFences[mRegion] )
+  {
+    glDeleteSync( mFences[mRegion] );
+  }
+  mFences[mRegion] = glFenceSync( GL_SYNC_GPU_COMMANDS_COMPLETE, 0 );
+#endif
+}
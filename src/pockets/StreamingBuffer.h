@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2013 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "pockets/Pockets.h"
+#include "cinder/gl/gl.h"
+#include "cinder/gl/Vbo.h"
+
+namespace pockets
+{
+  /**
+   StreamingBuffer:
+   A vertex buffer for geometry that is rewritten every frame.
+
+   The buffer is split into regions that are written in turn, so the CPU
+   fills one while the GPU may still be drawing from the others. A fence
+   placed after the draws that read a region keeps it from being rewritten
+   before they finish. Where GL_ARB_buffer_storage is available the buffer
+   is mapped once, persistently; otherwise each region is mapped
+   unsynchronized as it comes up. Without fences (ES 2) writes go through
+   client memory and bufferSubData.
+
+   Regions grow when asked for more elements than they hold. Growing may
+   replace the buffer object; respecify vertex attributes whenever
+   getGeneration() changes.
+
+   mapRetained() is for geometry that mostly stays the same: each region
+   keeps what was last written to it, so only the elements that changed
+   since then need rewriting. Report each range written with flush().
+   Growing discards every region's contents; watch getCapacity(). Use
+   either map() or mapRetained() with a given buffer, not both.
+
+   Usage, each frame:
+     Vertex *out = static_cast<Vertex*>( buffer->map( count ) );
+     // write exactly count vertices, front to back, without reading them
+     size_t first = buffer->unmap();
+     // ... draw count vertices starting at first ...
+     buffer->fence();
+
+   Or, for retained contents:
+     Vertex *out = static_cast<Vertex*>( buffer->mapRetained( count ) );
+     // write the elements this region is missing, then
+     buffer->flush( first_changed, changed_count );
+     size_t first = buffer->unmap();
+   */
+  typedef std::shared_ptr<class StreamingBuffer> StreamingBufferRef;
+  class StreamingBuffer
+  {
+  public:
+    //! a buffer of \a stride byte elements, rotating through \a regions of \a capacity elements each
+    StreamingBuffer( size_t stride, size_t capacity = 4096, size_t regions = 3 );
+    ~StreamingBuffer();
+    StreamingBuffer( const StreamingBuffer &other ) = delete;
+    StreamingBuffer& operator = ( const StreamingBuffer &other ) = delete;
+
+    //! returns room for \a count elements in the next free region
+    void*             map( size_t count );
+    //! returns the next free region as it was last written, with room for \a count elements
+    void*             mapRetained( size_t count );
+    //! marks \a count elements from \a first, counted from the mapped region, as written
+    void              flush( size_t first, size_t count );
+    //! finishes the writes started by map; returns the index of the first element written
+    size_t            unmap();
+    //! call after issuing the draws that read the last unmapped region
+    void              fence();
+    const ci::gl::VboRef& getVbo() const { return mVbo; }
+    //! elements each region holds
+    size_t            getCapacity() const { return mCapacity; }
+    //! changes whenever the buffer object is replaced
+    size_t            getGeneration() const { return mGeneration; }
+    //! the region last mapped, from zero to getRegionCount()
+    size_t            getRegion() const { return mRegion; }
+    size_t            getRegionCount() const { return mRegionCount; }
+    bool              isPersistent() const { return mPersistent != nullptr; }
+
+    static StreamingBufferRef create( size_t stride, size_t capacity = 4096, size_t regions = 3 );
+  private:
+    //! (re)creates storage for regions of \a capacity elements
+    void              allocate( size_t capacity );
+    //! blocks until the GPU is done with \a region
+    void              waitFor( size_t region );
+    //! grows if needed and moves on to the next region once the GPU is done with it
+    void              advance( size_t count );
+    void              clearFences();
+
+    ci::gl::VboRef      mVbo;
+    size_t              mStride;
+    size_t              mRegionCount;
+    size_t              mCapacity = 0;
+    size_t              mRegion = 0;
+    size_t              mMappedCount = 0;
+    size_t              mGeneration = 0;
+    //! base of the persistently mapped buffer, if there is one
+    uint8_t            *mPersistent = nullptr;
+    //! true if mapped memory came from glMapBufferRange and needs unmapping
+    bool                mMapped = false;
+    //! true while a region from mapRetained is mapped
+    bool                mRetaining = false;
+    //! staging for writes when the buffer can't be mapped; holds every region for mapRetained
+    std::vector<uint8_t> mScratch;
+    //! element ranges flushed to scratch, uploaded on unmap
+    std::vector<std::pair<size_t, size_t>> mFlushed;
+#if ! defined( CINDER_GL_ES_2 )
+    std::vector<GLsync> mFences;
+#endif
+  };
+} // pockets::
@@ -0,0 +1,161 @@
+/*
+ * Copyright (c) 2013 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "pockets/Pockets.h"
+#include "pockets/ThreadPool.h"
+#include "pockets/VertexTransform.h"
+#include <limits>
+
+namespace pockets
+{
+  /**
+   StripAssembler:
+   Joins a list of render items into one triangle strip on the shared
+   ThreadPool, keeping the list's order.
+
+   Items are pointers to anything with mesh->vertices and locus->matrix,
+   like the puptent and treent render data. Shapes are stitched together
+   with a degenerate pair (the previous shape's last vertex and the next
+   shape's first) so the whole list draws as one strip.
+
+   measure() splits the list into chunks, counts each chunk's vertices in
+   parallel, and sums the counts into an offset for each chunk. assemble()
+   then transforms every chunk at its offset in parallel. Each chunk writes
+   its own range front to back and nothing is read back, so the output may
+   be mapped GPU memory.
+   */
+  template<typename DataRef>
+  class StripAssembler
+  {
+  public:
+    //! \a grain is the number of items each task handles
+    explicit StripAssembler( size_t grain = 1024 ):
+    mGrain( std::max<size_t>( grain, 1 ) )
+    {}
+    //! lays out \a geometry and returns the number of vertices assemble() will write
+    size_t  measure( const std::vector<DataRef> &geometry );
+    //! transforms \a geometry, as last measured, into a strip starting at \a out
+    template<typename Vert>
+    void    assemble( const std::vector<DataRef> &geometry, Vert *out ) const;
+    //! vertices in the last measured strip
+    size_t  size() const { return mSize; }
+  private:
+    static const size_t npos = std::numeric_limits<size_t>::max();
+    struct Chunk
+    {
+      size_t  begin = 0;
+      size_t  end = 0;
+      size_t  vertices = 0;       // in this chunk's shapes, not counting joins
+      size_t  shapes = 0;         // shapes with any vertices
+      size_t  last_shape = npos;  // the chunk's last shape with any vertices
+      size_t  offset = 0;         // where the chunk's output starts
+      size_t  join_from = npos;   // shape before the chunk to join to, if any
+    };
+    std::vector<Chunk>  mChunks;
+    size_t              mGrain;
+    size_t              mSize = 0;
+  };
+
+  template<typename DataRef>
+  size_t StripAssembler<DataRef>::measure( const std::vector<DataRef> &geometry )
+  {
+    mChunks.assign( ( geometry.size() + mGrain - 1 ) / mGrain, Chunk() );
+    ThreadPool::shared().parallelFor( 0, mChunks.size(), 1, [&]( size_t first, size_t last )
+    {
+      for( size_t c = first; c < last; ++c )
+      {
+        Chunk &chunk = mChunks[c];
+        chunk.begin = c * mGrain;
+        chunk.end = std::min( chunk.begin + mGrain, geometry.size() );
+        for( size_t i = chunk.begin; i < chunk.end; ++i )
+        {
+          const size_t shape = geometry[i]->mesh->vertices.size();
+          if( shape > 0 )
+          {
+            chunk.vertices += shape;
+            chunk.shapes += 1;
+            chunk.last_shape = i;
+          }
+        }
+      }
+    } );
+    // every shape after the first is preceded by a degenerate pair
+    size_t total = 0;
+    size_t previous = npos;
+    for( Chunk &chunk : mChunks )
+    {
+      chunk.offset = total;
+      chunk.join_from = previous;
+      if( chunk.shapes > 0 )
+      {
+        total += chunk.vertices + chunk.shapes * 2 - ( previous == npos ? 2 : 0 );
+        previous = chunk.last_shape;
+      }
+    }
+    mSize = total;
+    return total;
+  }
+
+  template<typename DataRef>
+  template<typename Vert>
+  void StripAssembler<DataRef>::assemble( const std::vector<DataRef> &geometry, Vert *out ) const
+  {
+    ThreadPool::shared().parallelFor( 0, mChunks.size(), 1, [&]( size_t first, size_t last )
+    {
+      for( size_t c = first; c < last; ++c )
+      {
+        const Chunk &chunk = mChunks[c];
+        Vert *o = out + chunk.offset;
+        Vert previous;
+        bool joined = chunk.join_from != npos;
+        if( joined )
+        { // the join's first vertex ends the last shape of an earlier chunk
+          const auto &data = *geometry[chunk.join_from];
+          previous = VertexTransform( data.locus->matrix ).apply( data.mesh->vertices.back() );
+        }
+        for( size_t i = chunk.begin; i < chunk.end; ++i )
+        {
+          const auto &vertices = geometry[i]->mesh->vertices;
+          if( vertices.empty() )
+          {
+            continue;
+          }
+          const VertexTransform transform( geometry[i]->locus->matrix );
+          if( joined )
+          { // create degenerate triangle between previous and current shape
+            *o++ = previous;
+            *o++ = transform.apply( vertices.front() );
+          }
+          o = transform.apply( vertices.data(), vertices.size(), o );
+          previous = transform.apply( vertices.back() );
+          joined = true;
+        }
+      }
+    } );
+  }
+} // pockets::
@@ -26,35 +26,334 @@
  */
 
 #include "pockets/TextureAtlas.h"
+#include "pockets/AtlasFormat.h"
+#include "pockets/FileUtils.h"
 #include "cinder/Json.h"
 #include "cinder/gl/Texture.h"
+#include "cinder/gl/gl.h"
+#include "cinder/ImageIo.h"
+#include <cstring>
 
 using namespace std;
 using namespace cinder;
 using namespace pockets;
 
-TextureAtlas::TextureAtlas( const Surface &images, const ci::JsonTree &description )
+namespace
+{
+  //! smallest power of two keeping the table at most half full
+  size_t slotCountFor( size_t sprite_count )
+  {
+    size_t slots = 16;
+    while( slots < sprite_count * 2 )
+    {
+      slots *= 2;
+    }
+    return slots;
+  }
+  bool canSample( PixelFormat format )
+  {
+    switch( format )
+    {
+      case eRGBA8888:
+      case eRGBA4444:
+      case eRGB565:
+        return true;
+      case eIndexed8:
+        return gl::isExtensionAvailable( "GL_OES_compressed_paletted_texture" );
+      case eBC1:
+      case eBC3:
+        return gl::isExtensionAvailable( "GL_EXT_texture_compression_s3tc" );
+    }
+    return false;
+  }
+} // anon::
+
+gl::TextureRef pockets::createTexture( const EncodedImage &image )
+{
+  if( !canSample( image.format ) )
+  {
+    return gl::Texture::create( decodeImage( image ) );
+  }
+  // spelled out, since not every GL header declares the compressed formats
+  const GLenum cPalette8Rgba8 = 0x8B96;
+  const GLenum cDxt1Rgba = 0x83F1;
+  const GLenum cDxt5Rgba = 0x83F3;
+
+  GLuint id = 0;
+  glGenTextures( 1, &id );
+  glBindTexture( GL_TEXTURE_2D, id );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE );
+  glTexParameteri( GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE );
+  glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+  const GLsizei size = static_cast<GLsizei>( image.data.size() );
+  switch( image.format )
+  {
+    case eRGBA8888:
+      glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_BYTE, image.data.data() );
+    break;
+    case eRGBA4444:
+      glTexImage2D( GL_TEXTURE_2D, 0, GL_RGBA, image.width, image.height, 0, GL_RGBA, GL_UNSIGNED_SHORT_4_4_4_4, image.data.data() );
+    break;
+    case eRGB565:
+      glTexImage2D( GL_TEXTURE_2D, 0, GL_RGB, image.width, image.height, 0, GL_RGB, GL_UNSIGNED_SHORT_5_6_5, image.data.data() );
+    break;
+    case eIndexed8:
+      glCompressedTexImage2D( GL_TEXTURE_2D, 0, cPalette8Rgba8, image.width, image.height, 0, size, image.data.data() );
+    break;
+    case eBC1:
+      glCompressedTexImage2D( GL_TEXTURE_2D, 0, cDxt1Rgba, image.width, image.height, 0, size, image.data.data() );
+    break;
+    case eBC3:
+      glCompressedTexImage2D( GL_TEXTURE_2D, 0, cDxt5Rgba, image.width, image.height, 0, size, image.data.data() );
+    break;
+  }
+  glBindTexture( GL_TEXTURE_2D, 0 );
+  // the texture object owns the id from here on
+  return gl::Texture::create( GL_TEXTURE_2D, id, image.width, image.height, false );
+}
+
+TextureAtlas::TextureAtlas( const Surface &images, const ci::JsonTree &description ):
+TextureAtlas( vector<Surface>{ images }, description )
+{}
+
+TextureAtlas::TextureAtlas( const vector<Surface> &pages, const ci::JsonTree &description )
+{
+  createTextures( pages );
+  loadDescription( description );
+}
+
+TextureAtlas::TextureAtlas( const Surface &images, const fs::path &description ):
+TextureAtlas( vector<Surface>{ images }, description )
+{}
+
+TextureAtlas::TextureAtlas( const vector<Surface> &pages, const fs::path &description )
+{
+  createTextures( pages );
+  loadDescription( description );
+}
+
+TextureAtlas::TextureAtlas( const vector<fs::path> &pages, const fs::path &description )
+{
+  for( const fs::path &page : pages )
+  {
+    EncodedImage image;
+    MappedFile file( page );
+    if( file && readKtx( file.getData(), file.getSize(), &image ) )
+    {
+      mTextures.push_back( createTexture( image ) );
+    }
+    else
+    {
+      mTextures.push_back( gl::Texture::create( loadImage( page ) ) );
+    }
+  }
+  loadDescription( description );
+}
+
+void TextureAtlas::createTextures( const vector<Surface> &pages )
 {
   gl::Texture::Format format;
-  
-  mTexture = gl::Texture::create( images, format );
 
+  for( const Surface &page : pages )
+  {
+    mTextures.push_back( gl::Texture::create( page, format ) );
+  }
+}
+
+void TextureAtlas::loadDescription( const fs::path &description )
+{
+  MappedFile file( description );
+  if( !file || !loadDescription( file.getData(), file.getSize() ) )
+  { // not a binary description
+    loadDescription( JsonTree( loadFile( description ) ) );
+  }
+}
+
+void TextureAtlas::loadDescription( const ci::JsonTree &description )
+{
   JsonTree sprites = description["sprites"];
   JsonTree meta = description["meta"];
-  Vec2i bitmap_size( meta["width"].getValue<int>(), meta["height"].getValue<int>() );
+  // descriptions from before multi-page output only list a single size
+  vector<Vec2f> page_sizes{ Vec2f( meta["width"].getValue<int>(), meta["height"].getValue<int>() ) };
+  if( meta.hasChild( "pages" ) )
+  {
+    for( const auto &page : meta["pages"] )
+    {
+      size_t id = page["id"].getValue<int>();
+      if( id >= page_sizes.size() )
+      {
+        page_sizes.resize( id + 1 );
+      }
+      page_sizes[id] = Vec2f( page["width"].getValue<int>(), page["height"].getValue<int>() );
+    }
+  }
   for( const auto &child : sprites )
   {
     Rectf bounds( child["x1"].getValue<int>(), child["y1"].getValue<int>()
                  , child["x2"].getValue<int>(), child["y2"].getValue<int>() );
     Vec2i registration_point( child["rx"].getValue<float>(), child["ry"].getValue<float>() );
-    string id = child["id"].getValue();
-    mData[ id ] = SpriteData{ { bounds.getUpperLeft() / bitmap_size, bounds.getLowerRight() / bitmap_size },
-                              bounds.getSize(),
-                              registration_point };
+    size_t page = child.hasChild( "page" ) ? child["page"].getValue<int>() : 0;
+    Vec2f bitmap_size = page_sizes.at( page );
+    bool rotated = child.hasChild( "rotated" ) && child["rotated"].getValue<bool>();
+    // rotated sprites occupy their size turned on its side
+    Vec2f size = rotated ? Vec2f( bounds.getHeight(), bounds.getWidth() ) : bounds.getSize();
+    SpriteData data{ { bounds.getUpperLeft() / bitmap_size, bounds.getLowerRight() / bitmap_size },
+                     size,
+                     registration_point,
+                     page,
+                     rotated };
+    if( child.hasChild( "outline" ) )
+    {
+      for( const auto &point : child["outline"] )
+      {
+        data.outline.push_back( Vec2f( point["x"].getValue<float>(), point["y"].getValue<float>() ) );
+      }
+    }
+    addSprite( child["id"].getValue(), data );
   }
 }
 
+bool TextureAtlas::loadDescription( const uint8_t *data, size_t size )
+{
+  atlas::Header header;
+  if( size < sizeof( header ) )
+  {
+    return false;
+  }
+  memcpy( &header, data, sizeof( header ) );
+  atlas::toFileOrder( header );
+  const size_t pages_size = header.page_count * sizeof( atlas::Page );
+  const size_t sprites_size = header.sprite_count * sizeof( atlas::Sprite );
+  const size_t outlines_size = header.outline_size * sizeof( atlas::Point );
+  if( header.magic != atlas::cMagic || header.version != atlas::cVersion
+     || size < sizeof( header ) + pages_size + sprites_size + outlines_size + header.strings_size )
+  {
+    return false;
+  }
+  // texture bounds are already normalized, so page sizes aren't needed here
+  const uint8_t *records = data + sizeof( header ) + pages_size;
+  const uint8_t *outlines = records + sprites_size;
+  const char *strings = reinterpret_cast<const char*>( outlines + outlines_size );
+  // size everything once for the whole table
+  rehash( slotCountFor( mSprites.size() + header.sprite_count ) );
+  mSprites.reserve( mSprites.size() + header.sprite_count );
+  mNames.reserve( mNames.size() + header.sprite_count );
+  mHashes.reserve( mHashes.size() + header.sprite_count );
+  for( uint32_t i = 0; i < header.sprite_count; ++i )
+  {
+    atlas::Sprite sprite;
+    memcpy( &sprite, records + i * sizeof( sprite ), sizeof( sprite ) );
+    atlas::toFileOrder( sprite );
+    if( sprite.name_offset + static_cast<uint64_t>( sprite.name_length ) > header.strings_size
+       || sprite.outline_offset + static_cast<uint64_t>( sprite.outline_length ) > header.outline_size )
+    { // truncated or corrupt; leave nothing half-loaded
+      mSprites.clear();
+      mNames.clear();
+      mHashes.clear();
+      mSlots.clear();
+      return false;
+    }
+    SpriteData sprite_data{ { sprite.x1, sprite.y1, sprite.x2, sprite.y2 },
+                            { sprite.width, sprite.height },
+                            { sprite.rx, sprite.ry },
+                            sprite.page,
+                            ( sprite.flags & atlas::eRotated ) != 0 };
+    sprite_data.outline.resize( sprite.outline_length );
+    for( uint32_t p = 0; p < sprite.outline_length; ++p )
+    {
+      atlas::Point point;
+      memcpy( &point, outlines + ( sprite.outline_offset + p ) * sizeof( point ), sizeof( point ) );
+      atlas::toFileOrder( point );
+      sprite_data.outline[p] = Vec2f( point.x, point.y );
+    }
+    addSprite( string( strings + sprite.name_offset, sprite.name_length ), sprite_data );
+  }
+  return true;
+}
+
+SpriteId TextureAtlas::getId( const SpriteName &sprite_name ) const
+{
+  if( mSlots.empty() )
+  {
+    return cInvalidSpriteId;
+  }
+  const uint32_t slot = mSlots[findSlot( sprite_name )];
+  return slot == 0 ? cInvalidSpriteId : slot - 1;
+}
+
+size_t TextureAtlas::findSlot( const SpriteName &name ) const
+{
+  const size_t mask = mSlots.size() - 1;
+  size_t index = name.hash & mask;
+  while( mSlots[index] != 0 )
+  {
+    const SpriteId id = mSlots[index] - 1;
+    if( mHashes[id] == name.hash && mNames[id].size() == name.length && mNames[id].compare( 0, name.length, name.name, name.length ) == 0 )
+    {
+      break;
+    }
+    index = ( index + 1 ) & mask;
+  }
+  return index;
+}
+
+void TextureAtlas::addSprite( const string &name, const SpriteData &data )
+{
+  if( slotCountFor( mSprites.size() + 1 ) > mSlots.size() )
+  {
+    rehash( slotCountFor( mSprites.size() + 1 ) );
+  }
+  const SpriteName key( name );
+  const size_t slot = findSlot( key );
+  if( mSlots[slot] != 0 )
+  { // a later sprite with the same name replaces the earlier one
+    mSprites[mSlots[slot] - 1] = data;
+    return;
+  }
+  mSlots[slot] = static_cast<uint32_t>( mSprites.size() + 1 );
+  mSprites.push_back( data );
+  mNames.push_back( name );
+  mHashes.push_back( key.hash );
+}
+
+void TextureAtlas::rehash( size_t slot_count )
+{
+  mSlots.assign( slot_count, 0 );
+  const size_t mask = slot_count - 1;
+  for( size_t id = 0; id < mSprites.size(); ++id )
+  {
+    size_t index = mHashes[id] & mask;
+    while( mSlots[index] != 0 )
+    {
+      index = ( index + 1 ) & mask;
+    }
+    mSlots[index] = static_cast<uint32_t>( id + 1 );
+  }
+}
+
+TextureAtlasUniqueRef TextureAtlas::create( const vector<fs::path> &pages, const fs::path &description )
+{
+  return TextureAtlasUniqueRef{ new TextureAtlas{ pages, description } };
+}
+
 TextureAtlasUniqueRef TextureAtlas::create(const ci::Surface &images, const ci::JsonTree &description)
 {
   return TextureAtlasUniqueRef{ new TextureAtlas{ images, description } };
 }
+
+TextureAtlasUniqueRef TextureAtlas::create( const vector<Surface> &pages, const ci::JsonTree &description )
+{
+  return TextureAtlasUniqueRef{ new TextureAtlas{ pages, description } };
+}
+
+TextureAtlasUniqueRef TextureAtlas::create( const Surface &images, const fs::path &description )
+{
+  return TextureAtlasUniqueRef{ new TextureAtlas{ images, description } };
+}
+
+TextureAtlasUniqueRef TextureAtlas::create( const vector<Surface> &pages, const fs::path &description )
+{
+  return TextureAtlasUniqueRef{ new TextureAtlas{ pages, description } };
+}
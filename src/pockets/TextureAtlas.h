@@ -27,7 +27,9 @@
 
 #pragma once
 #include "pockets/puptent/PupTent.h"
+#include "pockets/PixelFormat.h"
 #include "cinder/Surface.h"
+#include "cinder/Filesystem.h"
 #include "cinder/gl/Texture.h"
 
 namespace cinder
@@ -39,24 +41,94 @@ namespace pockets
 {
   /**
    Sprite location within a TextureAtlas
+   Rotated sprites are stored turned 90 degrees clockwise; the corner
+   accessors return texture coordinates that draw them upright.
   */
   struct SpriteData
   { // build from texture bounds, screen size, and local registration point
     SpriteData( const ci::Rectf &bounds = ci::Rectf{ 0.0f, 0.0f, 1.0f, 1.0f },
                const ci::Vec2i &size = ci::Vec2i{ 96, 96 },
-               const ci::Vec2f &registration = ci::Vec2f::zero() ):
+               const ci::Vec2f &registration = ci::Vec2f::zero(),
+               size_t page = 0,
+               bool rotated = false ):
     texture_bounds( bounds ),
     size( size ),
-    registration_point( registration )
+    registration_point( registration ),
+    page( page ),
+    rotated( rotated )
     {}
+    //! texture coordinate for \a point, in upright pixels from the sprite's upper-left
+    ci::Vec2f       getTexCoord( const ci::Vec2f &point ) const
+    {
+      const ci::Vec2f ul = getUpperLeftTexCoord();
+      return ul + ( getUpperRightTexCoord() - ul ) * ( point.x / size.x ) + ( getLowerLeftTexCoord() - ul ) * ( point.y / size.y );
+    }
+    //! texture coordinates for the corners of the upright sprite
+    ci::Vec2f       getUpperLeftTexCoord() const { return rotated ? texture_bounds.getUpperRight() : texture_bounds.getUpperLeft(); }
+    ci::Vec2f       getUpperRightTexCoord() const { return rotated ? texture_bounds.getLowerRight() : texture_bounds.getUpperRight(); }
+    ci::Vec2f       getLowerRightTexCoord() const { return rotated ? texture_bounds.getLowerLeft() : texture_bounds.getLowerRight(); }
+    ci::Vec2f       getLowerLeftTexCoord() const { return rotated ? texture_bounds.getUpperLeft() : texture_bounds.getLowerLeft(); }
     ci::Rectf       texture_bounds;
-    ci::Vec2i       size;
+    ci::Vec2i       size;     // screen size, upright
     ci::Vec2f       registration_point;
+    size_t          page;     // index of the atlas texture holding this sprite
+    bool            rotated;  // stored turned 90 degrees clockwise
+    //! convex outline of the visible pixels, in upright pixels from the upper-left; empty to draw a quad
+    std::vector<ci::Vec2f> outline;
+  };
+  //! uploads \a image without expanding it when the GL can sample its format
+  //! formats the GL can't sample are decoded to RGBA8 first
+  ci::gl::TextureRef createTexture( const EncodedImage &image );
+
+  //! index of a sprite within its TextureAtlas, handed out in load order
+  typedef uint32_t SpriteId;
+  const SpriteId cInvalidSpriteId = 0xFFFFFFFF;
+
+  /**
+   SpriteName:
+   A sprite name and its hash, for looking up a SpriteId.
+   Built from a string literal, the hash is computed at compile time, so
+   hot code can resolve names without hashing strings:
+     constexpr SpriteName cHero( "hero" );
+     SpriteId hero = atlas.getId( cHero );
+   Only refers to the characters; the string must outlive the SpriteName.
+   */
+  struct SpriteName
+  {
+    template<size_t N>
+    constexpr SpriteName( const char (&literal)[N] ):
+    name( literal ),
+    length( N - 1 ),
+    hash( hashName( literal, N - 1 ) )
+    {}
+    SpriteName( const std::string &str ):
+    name( str.data() ),
+    length( str.size() ),
+    hash( 2166136261u )
+    { // same FNV-1a as hashName, without recursion
+      for( char c : str )
+      {
+        hash = ( hash ^ static_cast<uint8_t>( c ) ) * 16777619u;
+      }
+    }
+    //! 32-bit FNV-1a
+    static constexpr uint32_t hashName( const char *str, size_t length, uint32_t hash = 2166136261u )
+    {
+      return length == 0 ? hash : hashName( str + 1, length - 1, ( hash ^ static_cast<uint8_t>( *str ) ) * 16777619u );
+    }
+    const char  *name;
+    size_t      length;
+    uint32_t    hash;
   };
+
   /**
    TextureAtlas:
    A texture and lookup information for named sprites on that texture.
    Not a component, but used by the SpriteAnimationSystem
+
+   Sprites live in a flat array indexed by SpriteId. Names resolve to ids
+   through an open-addressing hash table, so resolve names once (or at
+   compile time with SpriteName) and use ids in per-frame code.
   */
   typedef std::unique_ptr<class TextureAtlas> TextureAtlasUniqueRef;
   class TextureAtlas
@@ -64,29 +136,80 @@ namespace pockets
   public:
     TextureAtlas() = default;
     TextureAtlas( const ci::Surface &images, const ci::JsonTree &description );
+    //! build from every page written by ImagePacker, in page order
+    TextureAtlas( const std::vector<ci::Surface> &pages, const ci::JsonTree &description );
+    //! build from a description file, either ImagePacker::binaryDescription() or JSON
+    //! binary descriptions are memory-mapped and each record copied into the sprite table, skipping JSON parsing
+    TextureAtlas( const ci::Surface &images, const ci::fs::path &description );
+    TextureAtlas( const std::vector<ci::Surface> &pages, const ci::fs::path &description );
+    //! build from page image files; KTX pages (see PixelFormat.h) are uploaded in their stored format
+    TextureAtlas( const std::vector<ci::fs::path> &pages, const ci::fs::path &description );
+    //! returns the id of the sprite named \a sprite_name, or cInvalidSpriteId if none exists
+    SpriteId            getId( const SpriteName &sprite_name ) const;
+    //! returns SpriteData for \a id or default sprite if none exists
+    inline const SpriteData& get( SpriteId id ) const
+    {
+      return id < mSprites.size() ? mSprites[id] : mErrorData;
+    }
     //! returns SpriteData with string id \a sprite_name or default sprite if none exists
-    inline const SpriteData& get( const std::string &sprite_name ) const
+    inline const SpriteData& get( const SpriteName &sprite_name ) const
     {
-      auto iter = mData.find(sprite_name);
-      if( iter != mData.end() )
-      {
-        return iter->second;
-      }
-      return mErrorData;
+      return get( getId( sprite_name ) );
+    }
+    //! returns SpriteData for \a id or default sprite if none exists
+    inline const SpriteData&  operator [] ( SpriteId id ) const
+    {
+      return get( id );
     }
     //! returns SpriteData with string id \a sprite_name or default sprite if none exists
-    inline const SpriteData&  operator [] ( const std::string &sprite_name ) const
+    inline const SpriteData&  operator [] ( const SpriteName &sprite_name ) const
     {
       return get( sprite_name );
     }
-    //! returns the texture where sprites are stored on GPU
-    ci::gl::TextureRef  getTexture() const { return mTexture; }
+    //! returns the name of the sprite with \a id
+    const std::string&  getName( SpriteId id ) const { return mNames.at( id ); }
+    //! returns the number of sprites in the atlas; ids run from zero to one less than this
+    size_t              getSpriteCount() const { return mSprites.size(); }
+    //! returns the texture where sprites on \a page are stored on GPU
+    ci::gl::TextureRef  getTexture( size_t page=0 ) const { return page < mTextures.size() ? mTextures[page] : nullptr; }
+    //! returns the number of textures in the atlas
+    size_t              getPageCount() const { return mTextures.size(); }
+    //! false while a TextureAtlasLoader is still loading this atlas; until then it has no sprites or textures
+    bool                isReady() const { return mReady; }
     //! create a new texture atlas from a surface and json description
     static TextureAtlasUniqueRef create( const ci::Surface &images, const ci::JsonTree &description );
+    //! create a new texture atlas from a set of page surfaces and json description
+    static TextureAtlasUniqueRef create( const std::vector<ci::Surface> &pages, const ci::JsonTree &description );
+    //! create a new texture atlas from a surface and a binary or json description file
+    static TextureAtlasUniqueRef create( const ci::Surface &images, const ci::fs::path &description );
+    //! create a new texture atlas from a set of page surfaces and a binary or json description file
+    static TextureAtlasUniqueRef create( const std::vector<ci::Surface> &pages, const ci::fs::path &description );
+    //! create a new texture atlas from page image or KTX files and a binary or json description file
+    static TextureAtlasUniqueRef create( const std::vector<ci::fs::path> &pages, const ci::fs::path &description );
   private:
-    std::map<std::string, SpriteData>   mData;
-    ci::gl::TextureRef                  mTexture;
+    friend class TextureAtlasLoader;
+    void                                createTextures( const std::vector<ci::Surface> &pages );
+    //! reads a binary description file, falling back to JSON
+    void                                loadDescription( const ci::fs::path &description );
+    void                                loadDescription( const ci::JsonTree &description );
+    //! returns false if \a data isn't a complete binary description
+    bool                                loadDescription( const uint8_t *data, size_t size );
+    //! adds a sprite, or replaces the data of an existing sprite with the same name
+    void                                addSprite( const std::string &name, const SpriteData &data );
+    //! returns the slot holding \a name, or the empty slot where it would go
+    size_t                              findSlot( const SpriteName &name ) const;
+    //! resizes the table to \a slot_count (a power of two) and reinserts every sprite
+    void                                rehash( size_t slot_count );
+
+    //! indexed by SpriteId
+    std::vector<SpriteData>             mSprites;
+    std::vector<std::string>            mNames;
+    std::vector<uint32_t>               mHashes;
+    //! open-addressing table of SpriteId + 1, zero marking an empty slot; probed linearly
+    std::vector<uint32_t>               mSlots;
+    std::vector<ci::gl::TextureRef>     mTextures;
     SpriteData                          mErrorData;
+    bool                                mReady = true;
   };
 
 } // pockets::
@@ -0,0 +1,205 @@
+/*
+ * Copyright (c) 2013 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#include "pockets/TextureAtlasLoader.h"
+#include "pockets/ThreadPool.h"
+#include "pockets/FileUtils.h"
+#include "cinder/ImageIo.h"
+#include <cstring>
+
+using namespace std;
+using namespace cinder;
+using namespace pockets;
+
+TextureAtlasLoader::TextureAtlasLoader( size_t bytes_per_frame ):
+mBytesPerFrame( bytes_per_frame )
+{}
+
+TextureAtlasLoader::~TextureAtlasLoader()
+{
+#if ! defined( CINDER_GL_ES_2 )
+  if( mPixelBuffer )
+  {
+    glDeleteBuffers( 1, &mPixelBuffer );
+  }
+#endif
+}
+
+TextureAtlasRef TextureAtlasLoader::load( const vector<fs::path> &pages, const fs::path &description )
+{
+  unique_ptr<Job> job( new Job );
+  job->atlas = make_shared<TextureAtlas>();
+  job->atlas->mReady = false;
+  job->decoding = ThreadPool::shared().enqueue( [pages, description]()
+  {
+    unique_ptr<Decoded> decoded( new Decoded );
+    for( const fs::path &path : pages )
+    {
+      decoded->encoded.push_back( EncodedImage() );
+      MappedFile file( path );
+      if( file && readKtx( file.getData(), file.getSize(), &decoded->encoded.back() ) )
+      {
+        decoded->pages.push_back( Surface() );
+        continue;
+      }
+      // uploads copy rows straight out of the surfaces, so make sure they're RGBA
+      Surface page( loadImage( path ), SurfaceConstraintsDefault(), true );
+      if( page.getChannelOrder().getCode() != SurfaceChannelOrder::RGBA )
+      {
+        Surface rgba( page.getWidth(), page.getHeight(), true, SurfaceChannelOrder::RGBA );
+        rgba.copyFrom( page, page.getBounds() );
+        page = rgba;
+      }
+      decoded->pages.push_back( page );
+    }
+    decoded->sprites.loadDescription( description );
+    return decoded;
+  } );
+  mJobs.push_back( move( job ) );
+  return mJobs.back()->atlas;
+}
+
+void TextureAtlasLoader::update()
+{
+  size_t budget = mBytesPerFrame;
+  auto iter = mJobs.begin();
+  while( iter != mJobs.end() && budget > 0 )
+  {
+    Job &job = **iter;
+    if( !job.decoded )
+    {
+      if( job.decoding.wait_for( chrono::seconds( 0 ) ) != future_status::ready )
+      { // later atlases may have finished decoding already
+        ++iter;
+        continue;
+      }
+      try
+      {
+        job.decoded = job.decoding.get();
+      }
+      catch( std::exception &exc )
+      {
+        std::cout << "TextureAtlasLoader: unable to load atlas: " << exc.what() << std::endl;
+        job.atlas->mReady = true;
+        iter = mJobs.erase( iter );
+        continue;
+      }
+    }
+
+    const vector<Surface> &pages = job.decoded->pages;
+    while( job.page < pages.size() && budget > 0 )
+    {
+      const EncodedImage &encoded = job.decoded->encoded[job.page];
+      if( !encoded.data.empty() )
+      {
+        job.textures.push_back( createTexture( encoded ) );
+        budget -= math<size_t>::min( budget, encoded.data.size() );
+        job.page += 1;
+        continue;
+      }
+      const Surface &page = pages[job.page];
+      if( job.row == 0 )
+      { // allocate storage now, fill it over the next few frames
+        job.textures.push_back( gl::Texture::create( page.getWidth(), page.getHeight() ) );
+      }
+      const size_t row_size = page.getWidth() * 4;
+      const int rows = math<int>::clamp( static_cast<int>( budget / row_size ), 1, page.getHeight() - job.row );
+      uploadRows( job.textures.back(), page, job.row, rows );
+      budget -= math<size_t>::min( budget, rows * row_size );
+      job.row += rows;
+      if( job.row == page.getHeight() )
+      {
+        job.page += 1;
+        job.row = 0;
+      }
+    }
+
+    if( job.page == pages.size() )
+    {
+      finish( job );
+      iter = mJobs.erase( iter );
+    }
+    else
+    {
+      ++iter;
+    }
+  }
+}
+
+void TextureAtlasLoader::uploadRows( const gl::TextureRef &texture, const Surface &surface, int first_row, int rows )
+{
+  const size_t row_size = surface.getWidth() * 4;
+  const size_t size = row_size * rows;
+  const uint8_t *source = surface.getData( Vec2i( 0, first_row ) );
+  texture->bind();
+  glPixelStorei( GL_UNPACK_ALIGNMENT, 4 );
+#if ! defined( CINDER_GL_ES_2 )
+  if( !mPixelBuffer )
+  {
+    glGenBuffers( 1, &mPixelBuffer );
+  }
+  glBindBuffer( GL_PIXEL_UNPACK_BUFFER, mPixelBuffer );
+  // orphan last frame's storage so mapping doesn't wait for its upload to finish
+  glBufferData( GL_PIXEL_UNPACK_BUFFER, size, nullptr, GL_STREAM_DRAW );
+  // glMapBuffer and GL_WRITE_ONLY don't exist on ES 3, but mapping a range works everywhere we get here
+  uint8_t *staging = static_cast<uint8_t*>( glMapBufferRange( GL_PIXEL_UNPACK_BUFFER, 0, size, GL_MAP_WRITE_BIT | GL_MAP_INVALIDATE_BUFFER_BIT ) );
+  if( staging )
+  {
+    for( int y = 0; y < rows; ++y )
+    {
+      memcpy( staging + y * row_size, source + y * surface.getRowBytes(), row_size );
+    }
+    glUnmapBuffer( GL_PIXEL_UNPACK_BUFFER );
+    glTexSubImage2D( GL_TEXTURE_2D, 0, 0, first_row, surface.getWidth(), rows, GL_RGBA, GL_UNSIGNED_BYTE, nullptr );
+    glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+    texture->unbind();
+    return;
+  }
+  // couldn't map the buffer; upload from client memory below
+  glBindBuffer( GL_PIXEL_UNPACK_BUFFER, 0 );
+#endif
+  if( surface.getRowBytes() != static_cast<int32_t>( row_size ) )
+  { // gather the rows into a contiguous buffer
+    mScratch.resize( size );
+    for( int y = 0; y < rows; ++y )
+    {
+      memcpy( &mScratch[y * row_size], source + y * surface.getRowBytes(), row_size );
+    }
+    source = mScratch.data();
+  }
+  glTexSubImage2D( GL_TEXTURE_2D, 0, 0, first_row, surface.getWidth(), rows, GL_RGBA, GL_UNSIGNED_BYTE, source );
+  texture->unbind();
+}
+
+void TextureAtlasLoader::finish( Job &job )
+{
+  TextureAtlas &atlas = *job.atlas;
+  atlas = move( job.decoded->sprites );
+  atlas.mTextures = job.textures;
+  atlas.mReady = true;
+}
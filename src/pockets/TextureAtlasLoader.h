@@ -0,0 +1,96 @@
+/*
+ * Copyright (c) 2013 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+
+#pragma once
+#include "pockets/TextureAtlas.h"
+#include "cinder/gl/gl.h"
+#include <deque>
+#include <future>
+
+namespace pockets
+{
+  /**
+   TextureAtlasLoader:
+   Loads TextureAtlases without stalling the frame.
+   Page images are decoded and descriptions parsed on the shared ThreadPool.
+   update() then uploads the decoded pages a band of rows at a time, within
+   a per-frame byte budget, staging through a pixel buffer where GL has them.
+   KTX pages are read as-is and uploaded whole, since they are already small.
+
+   The atlas returned by load() is a handle to poll: until isReady(), every
+   lookup gives the error sprite and getTexture() gives null. Decoded
+   atlases upload in the order they were requested.
+   */
+  class TextureAtlasLoader
+  {
+  public:
+    explicit TextureAtlasLoader( size_t bytes_per_frame = 4 * 1024 * 1024 );
+    ~TextureAtlasLoader();
+    TextureAtlasLoader( const TextureAtlasLoader &other ) = delete;
+    TextureAtlasLoader& operator = ( const TextureAtlasLoader &other ) = delete;
+
+    //! start loading an atlas from its page images, in page order, and a binary or json description
+    //! if anything fails to load, the atlas becomes ready with no sprites
+    TextureAtlasRef load( const std::vector<ci::fs::path> &pages, const ci::fs::path &description );
+    //! upload the next rows of decoded pages, at most the per-frame budget (but always at least one row)
+    //! call once a frame from the thread that owns the GL context
+    void            update();
+    //! number of atlases that aren't ready yet
+    size_t          getPendingCount() const { return mJobs.size(); }
+    void            setBytesPerFrame( size_t bytes ) { mBytesPerFrame = bytes; }
+    size_t          getBytesPerFrame() const { return mBytesPerFrame; }
+  private:
+    //! everything produced off the GL thread
+    struct Decoded
+    {
+      std::vector<ci::Surface>  pages;
+      //! KTX pages, by page index; empty data where the page is in pages instead
+      std::vector<EncodedImage> encoded;
+      TextureAtlas              sprites;
+    };
+    struct Job
+    {
+      TextureAtlasRef                         atlas;
+      std::future<std::unique_ptr<Decoded>>   decoding;
+      std::unique_ptr<Decoded>                decoded;
+      std::vector<ci::gl::TextureRef>         textures;
+      size_t                                  page = 0;
+      int                                     row = 0;
+    };
+    //! copy \a rows rows of \a surface, starting at \a first_row, into \a texture
+    void            uploadRows( const ci::gl::TextureRef &texture, const ci::Surface &surface, int first_row, int rows );
+    //! hand the loaded sprites and textures to the waiting atlas
+    void            finish( Job &job );
+
+    std::deque<std::unique_ptr<Job>>  mJobs;
+    size_t                            mBytesPerFrame;
+    GLuint                            mPixelBuffer = 0;
+    //! tightly-packed rows, for GL versions without pixel buffers
+    std::vector<uint8_t>              mScratch;
+  };
+} // pockets::
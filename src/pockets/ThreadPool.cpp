@@ -0,0 +1,142 @@
+/*
+ * Copyright (c) 2014 David Wicks
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#include "ThreadPool.h"
+#include <atomic>
+
+using namespace std;
+using namespace pockets;
+
+ThreadPool::ThreadPool( size_t thread_count )
+{
+  // hardware_concurrency() is allowed to report zero
+  thread_count = max<size_t>( thread_count, 1 );
+  for( size_t i = 0; i < thread_count; ++i )
+  {
+    mWorkers.emplace_back( [this](){ work(); } );
+  }
+}
+
+ThreadPool::~ThreadPool()
+{
+  {
+    lock_guard<mutex> lock( mMutex );
+    mStopping = true;
+  }
+  mCondition.notify_all();
+  for( thread &worker : mWorkers )
+  {
+    worker.join();
+  }
+}
+
+ThreadPool& ThreadPool::shared()
+{
+  static ThreadPool pool;
+  return pool;
+}
+
+void ThreadPool::work()
+{
+  while( true )
+  {
+    function<void ()> task;
+    {
+      unique_lock<mutex> lock( mMutex );
+      mCondition.wait( lock, [this](){ return mStopping || !mTasks.empty(); } );
+      if( mTasks.empty() )
+      { // only reached when stopping
+        return;
+      }
+      task = std::move( mTasks.front() );
+      mTasks.pop_front();
+    }
+    task();
+  }
+}
+
+void ThreadPool::parallelFor( size_t begin, size_t end, size_t grain, const function<void (size_t, size_t)> &fn )
+{
+  if( end <= begin )
+  {
+    return;
+  }
+  grain = max<size_t>( grain, 1 );
+  const size_t chunks = ( end - begin + grain - 1 ) / grain;
+  if( chunks == 1 )
+  {
+    fn( begin, end );
+    return;
+  }
+  // Chunks are claimed from a shared counter by the caller and any helpers that get a
+  // chance to run. Helpers may start after the caller returns, so the state they touch
+  // is kept alive by shared ownership and \a fn is only called for unclaimed chunks.
+  struct Progress
+  {
+    atomic<size_t>      next;
+    size_t              finished = 0;
+    mutex               guard;
+    condition_variable  done;
+  };
+  auto progress = make_shared<Progress>();
+  progress->next = 0;
+  const function<void (size_t, size_t)> *body = &fn;
+  auto run_chunks = [progress, body, begin, end, grain, chunks]()
+  {
+    size_t completed = 0;
+    size_t chunk;
+    while( ( chunk = progress->next++ ) < chunks )
+    {
+      const size_t first = begin + chunk * grain;
+      (*body)( first, min( first + grain, end ) );
+      completed += 1;
+    }
+    if( completed > 0 )
+    {
+      lock_guard<mutex> lock( progress->guard );
+      progress->finished += completed;
+      if( progress->finished == chunks )
+      {
+        progress->done.notify_all();
+      }
+    }
+  };
+
+  const size_t helpers = min( chunks - 1, mWorkers.size() );
+  {
+    lock_guard<mutex> lock( mMutex );
+    for( size_t i = 0; i < helpers; ++i )
+    {
+      mTasks.push_back( run_chunks );
+    }
+  }
+  mCondition.notify_all();
+  run_chunks();
+
+  unique_lock<mutex> lock( progress->guard );
+  progress->done.wait( lock, [&](){ return progress->finished == chunks; } );
+}
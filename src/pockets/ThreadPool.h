@@ -0,0 +1,92 @@
+/*
+ * Copyright (c) 2014 David Wicks
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "Pockets.h"
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace pockets
+{
+  /**
+   ThreadPool:
+   A fixed set of worker threads pulling tasks from a shared queue.
+   enqueue() returns a future for the task's result.
+   parallelFor() splits an index range into chunks and blocks until all
+   of them have run. The calling thread works on chunks too, so it is safe
+   to call parallelFor from inside another task.
+   */
+  class ThreadPool
+  {
+  public:
+    //! creates \a thread_count workers; defaults to one per hardware thread
+    explicit ThreadPool( size_t thread_count = std::thread::hardware_concurrency() );
+    //! finishes queued tasks, then joins all workers
+    ~ThreadPool();
+    ThreadPool( const ThreadPool &other ) = delete;
+    ThreadPool& operator=( const ThreadPool &other ) = delete;
+
+    //! schedule \a fn to run on a worker thread
+    template<typename Fn>
+    std::future<typename std::result_of<Fn()>::type> enqueue( Fn &&fn );
+    //! call \a fn( chunk_begin, chunk_end ) over [begin, end) in chunks of at most \a grain indices
+    void    parallelFor( size_t begin, size_t end, size_t grain, const std::function<void (size_t, size_t)> &fn );
+    //! number of worker threads
+    size_t  size() const { return mWorkers.size(); }
+
+    //! process-wide pool for library code that wants to go wide
+    static ThreadPool& shared();
+  private:
+    void    work();
+
+    std::vector<std::thread>          mWorkers;
+    std::deque<std::function<void ()>> mTasks;
+    std::mutex                        mMutex;
+    std::condition_variable           mCondition;
+    bool                              mStopping = false;
+  };
+
+  template<typename Fn>
+  std::future<typename std::result_of<Fn()>::type> ThreadPool::enqueue( Fn &&fn )
+  {
+    typedef typename std::result_of<Fn()>::type Result;
+    // packaged_task isn't copyable, so share it with the type-erased queue entry
+    auto task = std::make_shared<std::packaged_task<Result ()>>( std::forward<Fn>( fn ) );
+    std::future<Result> result = task->get_future();
+    {
+      std::lock_guard<std::mutex> lock( mMutex );
+      mTasks.push_back( [task](){ (*task)(); } );
+    }
+    mCondition.notify_one();
+    return result;
+  }
+} // pockets::
@@ -0,0 +1,213 @@
+/*
+ * Copyright (c) 2013 David Wicks, sansumbrella.com
+ * All rights reserved.
+ *
+ * Redistribution and use in source and binary forms, with or
+ * without modification, are permitted provided that the following
+ * conditions are met:
+ *
+ * Redistributions of source code must retain the above copyright
+ * notice, this list of conditions and the following disclaimer.
+ * Redistributions in binary form must reproduce the above copyright
+ * notice, this list of conditions and the following disclaimer in the
+ * documentation and/or other materials provided with the distribution.
+ *
+ * THIS SOFTWARE IS PROVIDED BY THE COPYRIGHT HOLDERS AND CONTRIBUTORS
+ * "AS IS" AND ANY EXPRESS OR IMPLIED WARRANTIES, INCLUDING, BUT NOT
+ * LIMITED TO, THE IMPLIED WARRANTIES OF MERCHANTABILITY AND FITNESS FOR
+ * A PARTICULAR PURPOSE ARE DISCLAIMED. IN NO EVENT SHALL THE COPYRIGHT
+ * HOLDER OR CONTRIBUTORS BE LIABLE FOR ANY DIRECT, INDIRECT, INCIDENTAL,
+ * SPECIAL, EXEMPLARY, OR CONSEQUENTIAL DAMAGES (INCLUDING, BUT NOT
+ * LIMITED TO, PROCUREMENT OF SUBSTITUTE GOODS OR SERVICES; LOSS OF USE,
+ * DATA, OR PROFITS; OR BUSINESS INTERRUPTION) HOWEVER CAUSED AND ON ANY
+ * THEORY OF LIABILITY, WHETHER IN CONTRACT, STRICT LIABILITY, OR TORT
+ * (INCLUDING NEGLIGENCE OR OTHERWISE) ARISING IN ANY WAY OUT OF THE USE
+ * OF THIS SOFTWARE, EVEN IF ADVISED OF THE POSSIBILITY OF SUCH DAMAGE.
+ */
+
+#pragma once
+#include "pockets/Pockets.h"
+#include "cinder/MatrixAffine2.h"
+#include <cstddef>
+#include <cstring>
+#include <type_traits>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+  #define POCKETS_VERTEX_SSE2 1
+  #if defined( __AVX2__ ) && defined( __FMA__ )
+    #define POCKETS_VERTEX_AVX2 1
+    #include <immintrin.h>
+  #else
+    #include <emmintrin.h>
+  #endif
+#elif defined( __ARM_NEON ) || defined( __ARM_NEON__ )
+  #define POCKETS_VERTEX_NEON 1
+  #include <arm_neon.h>
+#endif
+
+namespace pockets
+{
+  /**
+   VertexTransform:
+   Transforms spans of interleaved vertices by an affine matrix.
+
+   Works with any vertex type whose first member is a ci::Vec2f position,
+   like puptent::Vertex and treent::Vertex2D. Everything after the position
+   (color, texture coordinates) is copied unchanged. Output is only written,
+   so it may be mapped GPU memory.
+
+   Positions are transformed two at a time with SSE2, or one at a time with
+   NEON, where the compiler targets them. AVX2 builds run the SSE2 loop with
+   fused multiply-adds; 256-bit registers don't pay off here, since getting
+   interleaved positions in and out of them costs more shuffles than the
+   wider math saves. Spans too short to repay setting up the vector
+   registers, like sprite quads, use plain arithmetic, as do layouts that
+   specialize VectorizeTransform to false. See
+   development/benchmarks/VertexTransformBenchmarks.cpp.
+
+   Reads the matrix in place, so the matrix must outlive the transform.
+
+   Usage:
+     VertexTransform xf( locus->matrix );
+     out = xf.apply( mesh->vertices.data(), mesh->vertices.size(), out );
+   */
+  //! whether VertexTransform runs its SIMD loop over spans of \a Vert
+  //! specialize to false for layouts the benchmarks show it doesn't speed up
+  template<typename Vert>
+  struct VectorizeTransform : std::true_type {};
+
+  class VertexTransform
+  {
+  public:
+    //! shortest span worth vectorizing
+    static const size_t vector_span = 8;
+
+    //! pass \a translate false to transform positions as vectors, like MatrixAffine2f::transformVec
+    explicit VertexTransform( const ci::MatrixAffine2f &mat, bool translate = true ):
+    mColumns( mat.m ),
+    mTranslate( translate )
+    {}
+    //! transforms \a count vertices from \a in to \a out, returning the end of the output
+    //! \a in and \a out may be the same span, but must not otherwise overlap
+    template<typename Vert>
+    Vert*     apply( const Vert *in, size_t count, Vert *out ) const
+    {
+      return vectorizes<Vert>( count ) ? applyVectorized( in, count, out ) : applyScalar( in, count, out );
+    }
+    //! transforms a single vertex
+    template<typename Vert>
+    Vert      apply( const Vert &in ) const
+    {
+      Vert out;
+      applyScalar( &in, 1, &out );
+      return out;
+    }
+    //! true if apply() takes the SIMD loop for \a count vertices of type \a Vert
+    template<typename Vert>
+    static bool vectorizes( size_t count ) { return VectorizeTransform<Vert>::value && count >= vector_span; }
+    //! the instruction set apply() was compiled for: "AVX2", "SSE2", "NEON" or "scalar"
+    static const char* getInstructionSet();
+  private:
+    //! MatrixAffine2f's storage: where the x axis goes, where the y axis goes, then the translation
+    const float *mColumns;
+    bool        mTranslate;
+
+    template<typename Vert>
+    Vert*     applyVectorized( const Vert *in, size_t count, Vert *out ) const;
+    template<typename Vert>
+    Vert*     applyScalar( const Vert *in, size_t count, Vert *out ) const
+    { // copy the coefficients out first, since writing positions could alias the matrix
+      const float xx = mColumns[0], xy = mColumns[1];
+      const float yx = mColumns[2], yy = mColumns[3];
+      const float tx = mTranslate ? mColumns[4] : 0.0f;
+      const float ty = mTranslate ? mColumns[5] : 0.0f;
+      const bool copy = in != out;
+      for( size_t i = 0; i < count; ++i )
+      {
+        const float x = in[i].position.x;
+        const float y = in[i].position.y;
+        out[i].position.x = xx * x + yx * y + tx;
+        out[i].position.y = xy * x + yy * y + ty;
+        if( copy )
+        {
+          copyAttributes( in[i], out[i] );
+        }
+      }
+      return out + count;
+    }
+    //! copies the members after the position
+    template<typename Vert>
+    static void copyAttributes( const Vert &in, Vert &out )
+    {
+      std::memcpy( reinterpret_cast<char*>( &out ) + sizeof( ci::Vec2f ), reinterpret_cast<const char*>( &in ) + sizeof( ci::Vec2f ), sizeof( Vert ) - sizeof( ci::Vec2f ) );
+    }
+  };
+
+  inline const char* VertexTransform::getInstructionSet()
+  {
+#if defined( POCKETS_VERTEX_AVX2 )
+    return "AVX2";
+#elif defined( POCKETS_VERTEX_SSE2 )
+    return "SSE2";
+#elif defined( POCKETS_VERTEX_NEON )
+    return "NEON";
+#else
+    return "scalar";
+#endif
+  }
+
+  template<typename Vert>
+  Vert* VertexTransform::applyVectorized( const Vert *in, size_t count, Vert *out ) const
+  {
+    static_assert( offsetof( Vert, position ) == 0, "VertexTransform needs the position first in the vertex" );
+    static_assert( sizeof( ci::Vec2f ) == 2 * sizeof( float ), "VertexTransform needs tightly packed positions" );
+    size_t i = 0;
+#if defined( POCKETS_VERTEX_SSE2 )
+    { // (x0 y0 x1 y1), splat x and y within each pair
+      const bool copy = in != out;
+      const __m128 axes = _mm_loadu_ps( mColumns );
+      const __m128 cx = _mm_movelh_ps( axes, axes );
+      const __m128 cy = _mm_movehl_ps( axes, axes );
+      const __m128 ct = mTranslate ? _mm_castpd_ps( _mm_load1_pd( reinterpret_cast<const double*>( mColumns + 4 ) ) ) : _mm_setzero_ps();
+      for( ; i + 2 <= count; i += 2 )
+      {
+        __m128 p = _mm_loadl_pi( _mm_setzero_ps(), reinterpret_cast<const __m64*>( &in[i].position ) );
+        p = _mm_loadh_pi( p, reinterpret_cast<const __m64*>( &in[i + 1].position ) );
+        const __m128 px = _mm_shuffle_ps( p, p, _MM_SHUFFLE( 2, 2, 0, 0 ) );
+        const __m128 py = _mm_shuffle_ps( p, p, _MM_SHUFFLE( 3, 3, 1, 1 ) );
+  #if defined( POCKETS_VERTEX_AVX2 )
+        const __m128 r = _mm_fmadd_ps( cy, py, _mm_fmadd_ps( cx, px, ct ) );
+  #else
+        const __m128 r = _mm_add_ps( _mm_add_ps( _mm_mul_ps( cx, px ), _mm_mul_ps( cy, py ) ), ct );
+  #endif
+        _mm_storel_pi( reinterpret_cast<__m64*>( &out[i].position ), r );
+        _mm_storeh_pi( reinterpret_cast<__m64*>( &out[i + 1].position ), r );
+        if( copy )
+        {
+          copyAttributes( in[i], out[i] );
+          copyAttributes( in[i + 1], out[i + 1] );
+        }
+      }
+    }
+#elif defined( POCKETS_VERTEX_NEON )
+    { // one position per 64-bit register, multiplied by each lane in turn
+      const bool copy = in != out;
+      const float zero[2] = { 0.0f, 0.0f };
+      const float32x2_t cx = vld1_f32( mColumns );
+      const float32x2_t cy = vld1_f32( mColumns + 2 );
+      const float32x2_t ct = vld1_f32( mTranslate ? mColumns + 4 : zero );
+      for( ; i < count; ++i )
+      {
+        const float32x2_t p = vld1_f32( &in[i].position.x );
+        vst1_f32( &out[i].position.x, vmla_lane_f32( vmla_lane_f32( ct, cx, p, 0 ), cy, p, 1 ) );
+        if( copy )
+        {
+          copyAttributes( in[i], out[i] );
+        }
+      }
+    }
+#endif
+    applyScalar( in + i, count - i, out + i );
+    return out + count;
+  }
+} // pockets::
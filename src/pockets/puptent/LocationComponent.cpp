@@ -47,7 +47,11 @@ void Locus::updateMatrix( ci::MatrixAffine2f parentMatrix )
   parentMatrix.rotate( rotation );
   parentMatrix.scale( scale );
   parentMatrix.translate( -registration_point );
-  matrix = parentMatrix;
+  if( parentMatrix != matrix )
+  {
+    matrix = parentMatrix;
+    markDirty();
+  }
 }
 
 /*
@@ -38,6 +38,8 @@ namespace pockets
    Scales and rotates around the Registration Point when using toMatrix()
 
    Used by RenderSystem to transform RenderMesh component vertices
+   updateMatrix() bumps version when the matrix changes, letting RenderSystem
+   reuse vertices it already transformed; call markDirty() if you set matrix directly
    Updated by movement systems (Physics, Custom Motion)
    No assumption is made about the units used
   */
@@ -55,8 +57,12 @@ namespace pockets
     float               rotation = 0.0f;
     ci::Vec2f           scale = ci::Vec2f::one();
     ci::MatrixAffine2f  matrix = ci::MatrixAffine2f::identity();
+    //! incremented whenever matrix changes
+    uint32_t            version = 0;
 
     void updateMatrix( ci::MatrixAffine2f parentMatrix );
+    //! note that matrix was set directly
+    void markDirty() { ++version; }
     //! returns a matrix that will transform points based on Locus properties
     ci::MatrixAffine2f  calcLocalMatrix() const;
   };
@@ -27,16 +27,15 @@
 
 #include "pockets/puptent/RenderMeshComponent.h"
 #include "pockets/TextureAtlas.h"
+#include "pockets/VertexTransform.h"
 
 using namespace pockets::puptent;
 using namespace cinder;
 
 void RenderMesh::transform(const ci::MatrixAffine2f &mat)
 {
-  for( Vertex &v : vertices )
-  {
-    v.position = mat.transformVec( v.position );
-  }
+  VertexTransform( mat, false ).apply( vertices.data(), vertices.size(), vertices.data() );
+  markDirty();
 }
 
 void RenderMesh::setAsCircle(const ci::Vec2f &radius, float start_radians, float end_radians, size_t segments )
@@ -64,6 +63,7 @@ void RenderMesh::setAsCircle(const ci::Vec2f &radius, float start_radians, float
     vertices.at(i * 5 + 3).position = c;
     vertices.at(i * 5 + 4).position = a;
   }
+  markDirty();
 }
 
 void RenderMesh::setAsBox( const Rectf &bounds )
@@ -73,14 +73,16 @@ void RenderMesh::setAsBox( const Rectf &bounds )
   vertices[1].position = bounds.getUpperLeft();
   vertices[2].position = bounds.getLowerRight();
   vertices[3].position = bounds.getLowerLeft();
+  markDirty();
 }
 
 void RenderMesh::setBoxTextureCoords( const SpriteData &sprite_data )
 {
-  vertices[0].tex_coord = sprite_data.texture_bounds.getUpperRight();
-  vertices[1].tex_coord = sprite_data.texture_bounds.getUpperLeft();
-  vertices[2].tex_coord = sprite_data.texture_bounds.getLowerRight();
-  vertices[3].tex_coord = sprite_data.texture_bounds.getLowerLeft();
+  vertices[0].tex_coord = sprite_data.getUpperRightTexCoord();
+  vertices[1].tex_coord = sprite_data.getUpperLeftTexCoord();
+  vertices[2].tex_coord = sprite_data.getLowerRightTexCoord();
+  vertices[3].tex_coord = sprite_data.getLowerLeftTexCoord();
+  markDirty();
 }
 
 void RenderMesh::matchTexture(const SpriteData &sprite_data)
@@ -92,10 +94,32 @@ void RenderMesh::matchTexture(const SpriteData &sprite_data)
   vertices[1].position = screen_bounds.getUpperLeft();
   vertices[2].position = screen_bounds.getLowerRight();
   vertices[3].position = screen_bounds.getLowerLeft();
-  vertices[0].tex_coord = sprite_data.texture_bounds.getUpperRight();
-  vertices[1].tex_coord = sprite_data.texture_bounds.getUpperLeft();
-  vertices[2].tex_coord = sprite_data.texture_bounds.getLowerRight();
-  vertices[3].tex_coord = sprite_data.texture_bounds.getLowerLeft();
+  vertices[0].tex_coord = sprite_data.getUpperRightTexCoord();
+  vertices[1].tex_coord = sprite_data.getUpperLeftTexCoord();
+  vertices[2].tex_coord = sprite_data.getLowerRightTexCoord();
+  vertices[3].tex_coord = sprite_data.getLowerLeftTexCoord();
+  markDirty();
+}
+
+void RenderMesh::matchTextureTight( const SpriteData &sprite_data )
+{
+  const std::vector<Vec2f> &outline = sprite_data.outline;
+  if( outline.size() < 3 )
+  {
+    matchTexture( sprite_data );
+    return;
+  }
+  if( vertices.size() != outline.size() ){ vertices.assign( outline.size(), Vertex{} ); }
+  // zig-zag across the convex outline: 0, 1, n-1, 2, n-2, ...
+  size_t front = 0;
+  size_t back = outline.size();
+  for( size_t i = 0; i < outline.size(); ++i )
+  {
+    const Vec2f &point = ( i == 0 ) ? outline[front] : ( i % 2 ) ? outline[++front] : outline[--back];
+    vertices[i].position = point - sprite_data.registration_point;
+    vertices[i].tex_coord = sprite_data.getTexCoord( point );
+  }
+  markDirty();
 }
 
 void RenderMesh::setAsTriangle(const ci::Vec2f &a, const ci::Vec2f &b, const ci::Vec2f &c)
@@ -104,6 +128,7 @@ void RenderMesh::setAsTriangle(const ci::Vec2f &a, const ci::Vec2f &b, const ci:
   vertices[0].position = a;
   vertices[1].position = b;
   vertices[2].position = c;
+  markDirty();
 }
 
 void RenderMesh::setAsLine( const Vec2f &begin, const Vec2f &end, float width )
@@ -119,6 +144,7 @@ void RenderMesh::setAsLine( const Vec2f &begin, const Vec2f &end, float width )
   vertices.at(1).position = begin + N;
   vertices.at(2).position = end + S;
   vertices.at(3).position = end + N;
+  markDirty();
 }
 
 void RenderMesh::setAsCappedLine( const ci::Vec2f &begin, const ci::Vec2f &end, float width )
@@ -142,6 +168,7 @@ void RenderMesh::setAsCappedLine( const ci::Vec2f &begin, const ci::Vec2f &end,
   vertices.at(5).position = end + N;
   vertices.at(6).position = end + SE;
   vertices.at(7).position = end + NE;
+  markDirty();
 }
 
 void RenderMesh::setColor( const ColorA8u &color )
@@ -150,4 +177,5 @@ void RenderMesh::setColor( const ColorA8u &color )
   {
     vert.color = color;
   }
+  markDirty();
 }
@@ -60,7 +60,10 @@ namespace puptent
      - Ribbon
      - Line
      - Texture billboard (special case of Box)
+     - Tight texture billboard (sprite outline)
      Additional methods ease the texturing of those shapes.
+     The member functions bump version so RenderSystem knows to re-transform
+     the mesh; call markDirty() after editing vertices directly.
      */
     typedef std::shared_ptr<struct RenderMesh> RenderMeshRef;
     struct RenderMesh : Component<RenderMesh>
@@ -71,6 +74,10 @@ namespace puptent
       }
       //! vertices in triangle_strip order
       std::vector<Vertex> vertices;
+      //! incremented whenever the vertices change
+      uint32_t            version = 0;
+      //! note that vertices were changed outside the member functions
+      void markDirty() { ++version; }
       //! Convenience method for making circular shapes
       //! If you aren't dynamically changing the circle, consider using a Sprite
       void setAsCircle( const ci::Vec2f &radius, float start_radians=0, float end_radians=M_PI * 2, size_t segments=0 );
@@ -81,6 +88,9 @@ namespace puptent
       void setBoxTextureCoords( const SpriteData &sprite_data );
       //! Set the mesh as a box of sprite's size with correct texture coordinates
       void matchTexture( const SpriteData &sprite_data );
+      //! Set the mesh to the sprite's outline, skipping transparent corners the quad would fill
+      //! Falls back to matchTexture for sprites without an outline
+      void matchTextureTight( const SpriteData &sprite_data );
       //! Transform all vertices by \a mat
       void transform( const ci::MatrixAffine2f &mat );
       //! Make an expanded ribbon from a ci::Vec2f skeleton
@@ -131,6 +141,7 @@ namespace puptent
       size_t end = skeleton.size() - 1;
       vertices.at( end * 2 ).position = c + north;
       vertices.at( end * 2 + 1 ).position = c - north;
+      markDirty();
     }
   } // puptent::
 } // pockets::
@@ -27,6 +27,9 @@
 
 #include "pockets/puptent/RenderSystem.h"
 #include "pockets/CollectionUtilities.hpp"
+#include "pockets/ThreadPool.h"
+#include "pockets/VertexTransform.h"
+#include <atomic>
 #include "cinder/gl/Texture.h"
 #include "cinder/gl/Context.h"
 #include "cinder/app/App.h"
@@ -42,16 +45,27 @@ void RenderSystem::configure( EventManagerRef event_manager )
   event_manager->subscribe<ComponentAddedEvent<RenderData>>( *this );
   event_manager->subscribe<ComponentRemovedEvent<RenderData>>( *this );
 
-  // make buffer large enough to hold all the vertices you will ever need
-  mVbo = gl::Vbo::create( GL_ARRAY_BUFFER, 1.0e5 * sizeof( Vertex ), nullptr, GL_STREAM_DRAW );
+  // grows as needed, so start with room for a modest scene
+  mBuffer = StreamingBuffer::create( sizeof( Vertex ), 16384 );
+  mRetained = StreamingBuffer::create( sizeof( Vertex ), 16384 );
+  // resized whenever the layout changes
+  mRetainedIndices = gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, 0, nullptr, GL_DYNAMIC_DRAW );
   mAttributes = gl::Vao::create();
-  gl::ScopedVao attr( mAttributes );
-  mVbo->bind();
   mRenderProg = gl::GlslProg::create( gl::GlslProg::Format().vertex( app::loadAsset( "renderer.vs" ) )
                                      .fragment( app::loadAsset( "renderer.fs" ) )
                                      .attribLocation( "iPosition", 0 )
                                      .attribLocation( "iColor", 1 )
                                      .attribLocation( "iTexCoord", 2 ) );
+}
+
+void RenderSystem::bindAttributes( const gl::VboRef &vbo )
+{
+  if( vbo == mBoundVbo )
+  {
+    return;
+  }
+  gl::ScopedVao attr( mAttributes );
+  gl::ScopedBuffer buffer( vbo );
   gl::enableVertexAttribArray( 0 );
   gl::enableVertexAttribArray( 1 );
   gl::enableVertexAttribArray( 2 );
@@ -59,13 +73,14 @@ void RenderSystem::configure( EventManagerRef event_manager )
   gl::vertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, position) );
   gl::vertexAttribPointer( 1, 4, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex, color));
   gl::vertexAttribPointer( 2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex), (const GLvoid*)offsetof(Vertex,tex_coord) );
-  mVbo->unbind();
+  mBoundVbo = vbo;
 }
 
 void RenderSystem::receive(const ComponentAddedEvent<RenderData> &event)
 {
   auto data = event.component;
   const RenderPass pass = data->pass;
+  mLayoutChanged = true;
   if( pass == PREMULTIPLIED )
   { // put element in correct sorted position
     int target_layer = data->render_layer;
@@ -111,6 +126,7 @@ void RenderSystem::receive(const ComponentRemovedEvent<RenderData> &event)
 {
   auto render_data = event.component;
   vector_remove( &mGeometry[render_data->pass], render_data );
+  mLayoutChanged = true;
 }
 
 void RenderSystem::receive(const EntityDestroyedEvent &event)
@@ -120,44 +136,328 @@ void RenderSystem::receive(const EntityDestroyedEvent &event)
   if( render_data )
   { // remove render component from our list
     vector_remove( &mGeometry[render_data->pass], render_data );
+    mLayoutChanged = true;
   }
 }
 
 namespace {
   const array<RenderPass, NUM_RENDER_PASSES> passes = { PREMULTIPLIED, ADD, MULTIPLY };
+
+  //! transforms one mesh's vertices by its locus, without joins
+  Vertex* transformShape( const RenderData &data, Vertex *out )
+  {
+    const auto &vertices = data.mesh->vertices;
+    return VertexTransform( data.locus->matrix ).apply( vertices.data(), vertices.size(), out );
+  }
+
+  //! items each task transforms
+  const size_t assembly_grain = 1024;
+
+  //! adds [first, end) to \a patches, which are in ascending order
+  void addPatch( vector<pair<size_t, size_t>> *patches, size_t first, size_t end )
+  {
+    if( !patches->empty() && first == patches->back().second )
+    { // continues the previous patch; gaps stay out, since flushing unwritten vertices leaves them undefined
+      patches->back().second = end;
+    }
+    else
+    {
+      patches->emplace_back( first, end );
+    }
+  }
+
+  //! triangle indices for each mesh's strip, numbered from the pass's first retained vertex
+  GLuint* generateIndices( const vector<RenderDataRef> &geometry, GLuint *out )
+  {
+    GLuint base = 0;
+    for( const auto &data : geometry )
+    {
+      const GLuint shape = static_cast<GLuint>( data->mesh->vertices.size() );
+      if( shape < 3 )
+      {
+        continue;
+      }
+      for( GLuint i = 0; i + 2 < shape; ++i )
+      { // flip every other triangle so the whole strip keeps its winding
+        const GLuint v = base + i;
+        *out++ = ( i & 1 ) ? v + 1 : v;
+        *out++ = ( i & 1 ) ? v : v + 1;
+        *out++ = v + 2;
+      }
+      base += shape;
+    }
+    return out;
+  }
 } // anon::
 
 void RenderSystem::update( EntityManagerRef es, EventManagerRef events, double dt )
-{ // assemble vertices for each pass
+{
+#if defined( CINDER_GL_ES )
+  updateStrips();
+#else
+  if( mBatchMode == INDEXED )
+  {
+    updateIndexed();
+  }
+  else
+  {
+    updateStrips();
+  }
+#endif
+}
+
+void RenderSystem::updateStrips()
+{ // size each pass, then assemble vertices straight into the buffer
+  mStats = RenderStats();
+  size_t total = 0;
+  for( const auto &pass : passes )
+  {
+    Batch &batch = mBatches[pass];
+    batch = Batch();
+    batch.first_vertex = total;
+    batch.vertex_count = mStrips[pass].measure( mGeometry[pass] );
+    total += batch.vertex_count;
+    mStats.shapes += mGeometry[pass].size();
+  }
+
+  Vertex *out = static_cast<Vertex*>( mBuffer->map( total ) );
+  for( const auto &pass : passes )
+  {
+    mStrips[pass].assemble( mGeometry[pass], out + mBatches[pass].first_vertex );
+  }
+  mBaseVertex = mBuffer->unmap();
+  mWritten = mBuffer;
+  mStats.vertices = total;
+  mStats.strip_vertices = total;
+  mStats.shapes_transformed = mStats.shapes;
+  mStats.vertices_uploaded = total;
+  // the buffer is replaced when it grows
+  bindAttributes( mBuffer->getVbo() );
+}
+
+void RenderSystem::updateIndexed()
+{ // note what changed, falling back to a full layout when anything moved in the buffer
+  mUpdate += 1;
+  if( mLayoutChanged || ! patchIndexed() )
+  {
+    rebuildIndexed();
+  }
+  writeIndexed();
+  mWritten = mRetained;
+  // the buffer is replaced when it grows
+  bindAttributes( mRetained->getVbo() );
+}
+
+void RenderSystem::rebuildIndexed()
+{ // size each pass; quads-only passes can use the shared index buffer
+  mStats = RenderStats();
+  size_t total_vertices = 0;
+  size_t total_indices = 0;
+  size_t most_quads = 0;
+  for( const auto &pass : passes )
+  {
+    Batch &batch = mBatches[pass];
+    batch = Batch();
+    batch.first_vertex = total_vertices;
+    batch.indexed = true;
+    batch.quads = true;
+    for( const auto &data : mGeometry[pass] )
+    {
+      const size_t shape = data->mesh->vertices.size();
+      if( shape >= 3 )
+      {
+        batch.vertex_count += shape;
+        batch.index_count += ( shape - 2 ) * 3;
+        batch.quads = batch.quads && shape == 4;
+      }
+    }
+    if( batch.quads )
+    {
+      most_quads = max( most_quads, batch.vertex_count / 4 );
+    }
+    else
+    {
+      batch.first_index = total_indices;
+      total_indices += batch.index_count;
+    }
+    total_vertices += batch.vertex_count;
+    mStats.shapes += mGeometry[pass].size();
+    mStats.indices += batch.index_count;
+    mStats.strip_vertices += mStrips[pass].measure( mGeometry[pass] );
+  }
+  mStats.vertices = total_vertices;
+
+  if( most_quads > mQuadCapacity )
+  { // grow the shared quad indices, leaving room for more
+    mQuadCapacity = max<size_t>( most_quads, mQuadCapacity * 2 );
+    vector<GLuint> indices;
+    indices.reserve( mQuadCapacity * 6 );
+    for( GLuint q = 0; q < mQuadCapacity; ++q )
+    {
+      const GLuint v = q * 4;
+      indices.insert( indices.end(), { v, v + 1, v + 2, v + 2, v + 1, v + 3 } );
+    }
+    mQuadIndices = gl::Vbo::create( GL_ELEMENT_ARRAY_BUFFER, indices.size() * sizeof( GLuint ), indices.data(), GL_STATIC_DRAW );
+  }
+
+  // remember where each item goes and what it was made from; every region's copy is now stale
+  size_t offset = 0;
   for( const auto &pass : passes )
   {
-    auto &v = mVertices[pass];
-    v.clear();
-    for( const auto &pair : mGeometry[pass] )
-    {
-      auto mesh = pair->mesh;
-      auto loc = pair->locus;
-      auto mat = loc->matrix;
-      if( !v.empty() ) {
-        // create degenerate triangle between previous and current shape
-        v.push_back( v.back() );
-        auto vert = mesh->vertices.front();
-        v.emplace_back( Vertex{ mat.transformPoint( vert.position ), vert.color, vert.tex_coord } );
+    const auto &geometry = mGeometry[pass];
+    auto &cached = mCached[pass];
+    cached.resize( geometry.size() );
+    for( size_t i = 0; i < geometry.size(); ++i )
+    {
+      const RenderData &data = *geometry[i];
+      Cached &entry = cached[i];
+      entry.mesh = data.mesh.get();
+      entry.locus = data.locus.get();
+      entry.mesh_version = data.mesh->version;
+      entry.locus_version = data.locus->version;
+      entry.changed = mUpdate;
+      entry.first_vertex = offset;
+      entry.vertex_count = data.mesh->vertices.size();
+      if( entry.vertex_count >= 3 )
+      {
+        offset += entry.vertex_count;
       }
-      for( auto &vert : mesh->vertices ) {
-        v.emplace_back( Vertex{ mat.transformPoint( vert.position ), vert.color, vert.tex_coord } );
+    }
+  }
+
+  if( total_indices > 0 )
+  { // indices only change with the layout, so they are kept alongside the vertices
+    vector<GLuint> indices( total_indices );
+    GLuint *index = indices.data();
+    for( const auto &pass : passes )
+    {
+      if( !mBatches[pass].quads )
+      {
+        index = generateIndices( mGeometry[pass], index );
       }
     }
+    mRetainedIndices->bufferData( indices.size() * sizeof( GLuint ), indices.data(), GL_DYNAMIC_DRAW );
   }
+  mLayoutChanged = false;
+}
 
-  GLintptr  offset = 0;
+bool RenderSystem::patchIndexed()
+{ // stamp items whose locus or mesh changed with this update
   for( const auto &pass : passes )
   {
-    if( !mVertices[pass].empty() ) {
-      mVbo->bufferSubData( offset, mVertices[pass].size() * sizeof( Vertex ), mVertices[pass].data() );
-      offset += mVertices[pass].size() * sizeof( Vertex );
+    const auto &geometry = mGeometry[pass];
+    auto &cached = mCached[pass];
+    if( cached.size() != geometry.size() )
+    {
+      return false;
+    }
+    atomic<bool> moved( false );
+    ThreadPool::shared().parallelFor( 0, geometry.size(), assembly_grain, [&]( size_t first, size_t last )
+    {
+      for( size_t i = first; i < last; ++i )
+      {
+        const RenderData &data = *geometry[i];
+        Cached &entry = cached[i];
+        if( data.mesh.get() != entry.mesh || data.locus.get() != entry.locus || data.mesh->vertices.size() != entry.vertex_count )
+        { // everything after this item would move
+          moved = true;
+          return;
+        }
+        if( data.mesh->version != entry.mesh_version || data.locus->version != entry.locus_version )
+        {
+          entry.mesh_version = data.mesh->version;
+          entry.locus_version = data.locus->version;
+          entry.changed = mUpdate;
+        }
+      }
+    } );
+    if( moved )
+    {
+      return false;
     }
   }
+  return true;
+}
+
+void RenderSystem::writeIndexed()
+{ // transform what the next region's copy is missing straight into mapped memory
+  mStats.shapes_transformed = 0;
+  mStats.vertices_uploaded = 0;
+  Vertex *out = static_cast<Vertex*>( mRetained->mapRetained( mStats.vertices ) );
+  if( mRetained->getCapacity() != mRetainedCapacity )
+  { // growing discarded every region's copy
+    mRetainedCapacity = mRetained->getCapacity();
+    mRegionUpdates.assign( mRetained->getRegionCount(), 0 );
+  }
+  const uint64_t written = mRegionUpdates[mRetained->getRegion()];
+  mPatches.clear();
+  for( const auto &pass : passes )
+  {
+    const auto &geometry = mGeometry[pass];
+    const auto &cached = mCached[pass];
+    // each chunk collects its own patches, which are joined in order afterward
+    const size_t chunks = ( geometry.size() + assembly_grain - 1 ) / assembly_grain;
+    if( mChunkPatches.size() < chunks )
+    {
+      mChunkPatches.resize( chunks );
+    }
+    atomic<size_t> transformed( 0 );
+    ThreadPool::shared().parallelFor( 0, chunks, 1, [&]( size_t first, size_t last )
+    {
+      for( size_t c = first; c < last; ++c )
+      {
+        auto &patches = mChunkPatches[c];
+        patches.clear();
+        size_t count = 0;
+        const size_t end = min( ( c + 1 ) * assembly_grain, geometry.size() );
+        for( size_t i = c * assembly_grain; i < end; ++i )
+        {
+          const Cached &entry = cached[i];
+          if( entry.changed <= written || entry.vertex_count < 3 )
+          {
+            continue;
+          }
+          transformShape( *geometry[i], out + entry.first_vertex );
+          count += 1;
+          addPatch( &patches, entry.first_vertex, entry.first_vertex + entry.vertex_count );
+        }
+        transformed += count;
+      }
+    } );
+    mStats.shapes_transformed += transformed;
+    for( size_t c = 0; c < chunks; ++c )
+    {
+      for( const auto &patch : mChunkPatches[c] )
+      {
+        addPatch( &mPatches, patch.first, patch.second );
+      }
+    }
+  }
+
+  for( const auto &patch : mPatches )
+  {
+    mRetained->flush( patch.first, patch.second - patch.first );
+    mStats.vertices_uploaded += patch.second - patch.first;
+  }
+  mBaseVertex = mRetained->unmap();
+  mRegionUpdates[mRetained->getRegion()] = mUpdate;
+}
+
+void RenderSystem::drawBatch( const Batch &batch ) const
+{
+#if ! defined( CINDER_GL_ES )
+  if( batch.indexed )
+  {
+    if( batch.index_count > 0 )
+    { // indices count from the batch's first vertex
+      gl::ScopedBuffer indices( batch.quads ? mQuadIndices : mRetainedIndices );
+      const GLvoid *offset = reinterpret_cast<const GLvoid*>( batch.first_index * sizeof( GLuint ) );
+      glDrawElementsBaseVertex( GL_TRIANGLES, static_cast<GLsizei>( batch.index_count ), GL_UNSIGNED_INT, offset, static_cast<GLint>( mBaseVertex + batch.first_vertex ) );
+    }
+    return;
+  }
+#endif
+  gl::drawArrays( GL_TRIANGLE_STRIP, mBaseVertex + batch.first_vertex, batch.vertex_count );
 }
 
 void RenderSystem::draw() const
@@ -173,26 +473,23 @@ void RenderSystem::draw() const
 
   // premultiplied alpha blending for normal pass
   gl::ScopedBlend premultBlend( GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
-
-  size_t begin = 0;
-  size_t count = mVertices[PREMULTIPLIED].size();
-  gl::drawArrays( GL_TRIANGLE_STRIP, begin, count );
+  drawBatch( mBatches[PREMULTIPLIED] );
 
   // additive blending
-  begin += count;
-  count = mVertices[ADD].size();
   gl::ScopedBlend addBlend( GL_SRC_ALPHA, GL_ONE );
-  gl::drawArrays( GL_TRIANGLE_STRIP, begin, count );
+  drawBatch( mBatches[ADD] );
 
   // multiply blending
-  begin += count;
-  count = mVertices[MULTIPLY].size();
   gl::ScopedBlend multBlend( GL_DST_COLOR,  GL_ONE_MINUS_SRC_ALPHA );
-  gl::drawArrays( GL_TRIANGLE_STRIP, begin, count );
+  drawBatch( mBatches[MULTIPLY] );
   gl::disableAlphaBlending();
 
   if( mTexture ) {
     mTexture->unbind();
   }
-
+  // keep this frame's region from being rewritten until these draws are done
+  if( mWritten )
+  {
+    mWritten->fence();
+  }
 }
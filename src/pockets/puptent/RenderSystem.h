@@ -30,6 +30,8 @@
 #include "pockets/puptent/PupTent.h"
 #include "pockets/puptent/LocationComponent.h"
 #include "pockets/puptent/RenderMeshComponent.h"
+#include "pockets/StreamingBuffer.h"
+#include "pockets/StripAssembler.h"
 #include "cinder/gl/VboMesh.h"
 #include "cinder/gl/Vbo.h"
 
@@ -51,6 +53,40 @@ namespace pockets
       NUM_RENDER_PASSES
     };
 
+    /**
+     BatchMode:
+     How RenderSystem joins the meshes of a pass into a single draw.
+     STRIPS makes one triangle strip, stitching meshes together with a
+     degenerate triangle (two repeated vertices) between each.
+     INDEXED writes each mesh's vertices once and draws indexed triangles.
+     Passes made entirely of quads share a static index buffer; other passes
+     get indices generated from their strips whenever the layout changes.
+     INDEXED vertices are retained between frames: only meshes whose Locus or
+     RenderMesh version changed are re-transformed. Each region of the vertex
+     buffer keeps its own copy, so a change is written into mapped memory
+     once for every region as that region comes up; with the usual three
+     regions a mesh that changes every frame is transformed once per frame,
+     and one that stops changing is written twice more, then left alone.
+     */
+    enum BatchMode
+    {
+      STRIPS,
+      INDEXED
+    };
+
+    //! what RenderSystem submitted in its last update
+    struct RenderStats
+    {
+      size_t  shapes = 0;
+      size_t  vertices = 0;         // vertices written to the buffer
+      size_t  indices = 0;          // indices drawn; zero for STRIPS
+      size_t  strip_vertices = 0;   // vertices that joined strips need for the same shapes
+      size_t  shapes_transformed = 0; // shapes transformed this update; the rest were reused
+      size_t  vertices_uploaded = 0;  // vertices written to the buffer this update
+      //! vertices not submitted thanks to indexing
+      size_t  getVerticesSaved() const { return strip_vertices - vertices; }
+    };
+
     /**
      RenderData:
      Composite component.
@@ -102,19 +138,35 @@ namespace pockets
      The same texture will remain bound through all render passes.
      For "untextured" geometry, we leave a white pixel in the top-left corner
      of our sprite sheets and set all vertex tex coords to their default 0,0.
+
+     Batches are INDEXED by default; see BatchMode.
+     Both modes write vertices straight into a StreamingBuffer, which grows
+     to fit and rotates through fenced regions so writing never waits on the
+     GPU. STRIPS rewrites every vertex each frame. INDEXED keeps a transformed
+     copy in each region and rewrites only the items that changed since that
+     region was last written. Adding, removing, or sorting RenderData, or
+     changing a mesh's vertex count, lays the whole buffer out again.
+     Either way, each pass is split into chunks of items that are transformed
+     on the shared ThreadPool, each writing to its own range of the output.
      */
     class RenderSystem : public System<RenderSystem>, public Receiver<RenderSystem>
     {
     public:
       //! listen for events
       void        configure( EventManagerRef event_manager ) override;
-      //! generate vertex list by transforming meshes by locii
+      //! generate vertex list by transforming meshes by locii, in parallel on the shared ThreadPool
       void        update( EntityManagerRef es, EventManagerRef events, double dt ) override;
       //! batch render scene to screen
       void        draw() const;
       //! set a texture to be bound for all rendering
       inline void setTexture( ci::gl::TextureRef texture )
       { mTexture = texture; }
+      //! choose how meshes are joined; takes effect on the next update
+      //! INDEXED needs base vertex draws, so OpenGL ES always uses STRIPS
+      void        setBatchMode( BatchMode mode ) { mBatchMode = mode; mLayoutChanged = true; }
+      BatchMode   getBatchMode() const { return mBatchMode; }
+      //! counts from the last update
+      const RenderStats& getStats() const { return mStats; }
       void        receive( const EntityDestroyedEvent &event );
       void        receive( const ComponentAddedEvent<RenderData> &event );
       void        receive( const ComponentRemovedEvent<RenderData> &event );
@@ -122,14 +174,79 @@ namespace pockets
       //! sort the render data in the normal pass by render layer
       //! needed iff you are dynamically changing Locus render_layers
       inline void sort()
-      { stable_sort( mGeometry[PREMULTIPLIED].begin(), mGeometry[PREMULTIPLIED].end(), &RenderSystem::layerSort ); }
+      {
+        stable_sort( mGeometry[PREMULTIPLIED].begin(), mGeometry[PREMULTIPLIED].end(), &RenderSystem::layerSort );
+        mLayoutChanged = true;
+      }
     private:
       std::array<std::vector<RenderDataRef>, NUM_RENDER_PASSES> mGeometry;
-      std::array<std::vector<Vertex>, NUM_RENDER_PASSES>        mVertices;
-      ci::gl::VboRef                            mVbo;
+      //! where each pass's geometry ended up in the buffers
+      struct Batch
+      {
+        size_t  first_vertex = 0;
+        size_t  vertex_count = 0;
+        size_t  first_index = 0;
+        size_t  index_count = 0;
+        bool    indexed = false;    // drawn as indexed triangles rather than a strip
+        bool    quads = false;      // drawn with the static quad indices
+      };
+      std::array<Batch, NUM_RENDER_PASSES>      mBatches;
+      BatchMode                                 mBatchMode = INDEXED;
+      RenderStats                               mStats;
+      //! what an item's retained vertices were transformed from, parallel to mGeometry
+      struct Cached
+      {
+        const RenderMesh  *mesh = nullptr;
+        const Locus       *locus = nullptr;
+        uint32_t          mesh_version = 0;
+        uint32_t          locus_version = 0;
+        //! the update in which the versions last changed
+        uint64_t          changed = 0;
+        size_t            first_vertex = 0;
+        size_t            vertex_count = 0;
+      };
+      std::array<std::vector<Cached>, NUM_RENDER_PASSES> mCached;
+      //! INDEXED vertices, with a retained copy in each region
+      StreamingBufferRef                        mRetained;
+      //! the update in which each region's copy was last brought up to date
+      std::vector<uint64_t>                     mRegionUpdates;
+      //! mRetained's capacity when mRegionUpdates was last reset; growing discards every copy
+      size_t                                    mRetainedCapacity = 0;
+      //! counts INDEXED updates
+      uint64_t                                  mUpdate = 0;
+      //! indices for passes that aren't all quads, rebuilt with the layout
+      ci::gl::VboRef                            mRetainedIndices;
+      //! vertex ranges [first, end) written this update
+      std::vector<std::pair<size_t, size_t>>    mPatches;
+      //! patches found by each task, before they are joined into mPatches
+      std::vector<std::vector<std::pair<size_t, size_t>>> mChunkPatches;
+      bool                                      mLayoutChanged = true;
+      //! STRIPS vertices, rewritten every frame
+      StreamingBufferRef                        mBuffer;
+      //! the buffer written by the last update, fenced once it has been drawn
+      StreamingBufferRef                        mWritten;
+      //! first vertex of the region the batches were written to
+      size_t                                    mBaseVertex = 0;
+      std::array<StripAssembler<RenderDataRef>, NUM_RENDER_PASSES> mStrips;
+      //! the buffer mAttributes currently reads from
+      ci::gl::VboRef                            mBoundVbo;
+      //! indices for mQuadCapacity quads, 0 1 2 2 1 3 offset by four for each
+      ci::gl::VboRef                            mQuadIndices;
+      size_t                                    mQuadCapacity = 0;
       ci::gl::VaoRef                            mAttributes;
       ci::gl::TextureRef                        mTexture;
       ci::gl::GlslProgRef                       mRenderProg;
+      //! point the vertex attributes at \a vbo if they aren't already
+      void                        bindAttributes( const ci::gl::VboRef &vbo );
+      void                        updateStrips();
+      void                        updateIndexed();
+      //! lay out every item and mark it changed
+      void                        rebuildIndexed();
+      //! mark items whose versions changed; false if the layout no longer matches
+      bool                        patchIndexed();
+      //! transform the items the next region's copy is missing into it
+      void                        writeIndexed();
+      void                        drawBatch( const Batch &batch ) const;
       static bool                 layerSort( const RenderDataRef &lhs, const RenderDataRef &rhs )
       { return lhs->render_layer < rhs->render_layer; }
       // maybe add a CameraRef for positioning the scene
@@ -28,6 +28,7 @@
 #include "pockets/puptent/SpriteSystem.h"
 #include "pockets/puptent/RenderMeshComponent.h"
 #include "cinder/Json.h"
+#include <algorithm>
 
 using namespace std;
 using namespace cinder;
@@ -54,8 +55,7 @@ _atlas( atlas )
       { // stored in json as [ "id", duration ]
         drawings.emplace_back( _atlas->get(child[0].getValue()), child[1].getValue<float>() );
       }
-      _animations.emplace_back( Animation{ key, drawings, frame_duration } );
-      _animation_ids[key] = _animations.size() - 1;
+      addAnimation( key, Animation{ key, drawings, frame_duration } );
     }
   }
   catch( JsonTree::Exception &exc )
@@ -67,12 +67,25 @@ _atlas( atlas )
 void SpriteAnimationSystem::configure( EventManagerRef events )
 {
   events->subscribe<ComponentAddedEvent<SpriteAnimation>>( *this );
+  events->subscribe<ComponentRemovedEvent<SpriteAnimation>>( *this );
+  events->subscribe<ComponentAddedEvent<RenderMesh>>( *this );
+  events->subscribe<ComponentRemovedEvent<RenderMesh>>( *this );
+  events->subscribe<EntityDestroyedEvent>( *this );
 }
 
 void SpriteAnimationSystem::addAnimation(const string &name, const Animation &animation)
 {
   _animations.emplace_back( animation );
   _animation_ids[name] = _animations.size() - 1;
+  // compile to a timeline: frame i shows from the end of frame i - 1 until _frame_ends[first_frame + i]
+  Timeline timeline{ _frame_ends.size(), static_cast<int>( animation.drawings.size() ), 0.0f };
+  for( const Drawing &drawing : animation.drawings )
+  {
+    timeline.duration += math<float>::max( drawing.hold, 0.0f ) * animation.frame_duration;
+    _frame_ends.push_back( timeline.duration );
+    _frame_drawings.push_back( drawing.drawing );
+  }
+  _timelines.push_back( timeline );
 }
 
 AnimationId SpriteAnimationSystem::getAnimationId( const string &name ) const
@@ -96,58 +109,289 @@ SpriteAnimationRef SpriteAnimationSystem::createSpriteAnimation(AnimationId anim
   return SpriteAnimationRef{ new SpriteAnimation{ animation_id } };
 }
 
+void SpriteAnimationSystem::setRate( const SpriteAnimationRef &sprite, float rate )
+{
+  sprite->rate = rate;
+  if( !sprite->clock && isTracked( sprite ) )
+  {
+    _playback[sprite->playback].rate = rate;
+  }
+}
+
+void SpriteAnimationSystem::setLooping( const SpriteAnimationRef &sprite, bool looping )
+{
+  sprite->looping = looping;
+  if( !sprite->clock && isTracked( sprite ) )
+  {
+    _playback[sprite->playback].looping = looping;
+  }
+}
+
+ClockId SpriteAnimationSystem::createClock( AnimationId animation_id, float rate, bool looping )
+{
+  _timelines.at( animation_id ); // check the id here; members index timelines unchecked
+  _clocks.push_back( Clock{ Playback{ 0.0f, rate, animation_id, 0, looping }, {}, {} } );
+  return _clocks.size();
+}
+
+SpriteAnimationRef SpriteAnimationSystem::createClockedAnimation( ClockId clock ) const
+{
+  auto sprite = createSpriteAnimation( _clocks.at( clock - 1 ).playback.animation );
+  sprite->clock = clock;
+  return sprite;
+}
+
+void SpriteAnimationSystem::setClockRate( ClockId clock, float rate )
+{
+  _clocks.at( clock - 1 ).playback.rate = rate;
+}
+
+void SpriteAnimationSystem::setClockLooping( ClockId clock, bool looping )
+{
+  _clocks.at( clock - 1 ).playback.looping = looping;
+}
+
+vector<SpriteAnimationRef>& SpriteAnimationSystem::spritesFor( const SpriteAnimationRef &sprite )
+{
+  return sprite->clock ? _clocks.at( sprite->clock - 1 ).sprites : _sprites;
+}
+
+vector<RenderMeshRef>& SpriteAnimationSystem::meshesFor( const SpriteAnimationRef &sprite )
+{
+  return sprite->clock ? _clocks.at( sprite->clock - 1 ).meshes : _meshes;
+}
+
+bool SpriteAnimationSystem::isTracked( const SpriteAnimationRef &sprite ) const
+{
+  const auto &sprites = sprite->clock ? _clocks.at( sprite->clock - 1 ).sprites : _sprites;
+  return sprite->playback < sprites.size() && sprites[sprite->playback] == sprite;
+}
+
+void SpriteAnimationSystem::track( Entity entity, const SpriteAnimationRef &sprite )
+{
+  if( isTracked( sprite ) )
+  {
+    return;
+  }
+  if( sprite->clock )
+  { // joins the clock's members; its frame comes from the clock
+    Clock &clock = _clocks.at( sprite->clock - 1 );
+    sprite->animation = clock.playback.animation;
+    sprite->playback = clock.sprites.size();
+    clock.sprites.push_back( sprite );
+    clock.meshes.push_back( entity.component<RenderMesh>() );
+    showClockFrame( clock, sprite->playback );
+    return;
+  }
+  const Timeline &timeline = _timelines.at( sprite->animation );
+  const float *ends = _frame_ends.data() + timeline.first_frame;
+  // start from the component's frame and the time already spent on it
+  const int frame = math<int>::clamp( sprite->current_index, 0, math<int>::max( timeline.frame_count - 1, 0 ) );
+  const float start = frame > 0 ? ends[frame - 1] : 0.0f;
+  const float time = math<float>::clamp( start + sprite->hold, 0.0f, timeline.duration );
+
+  sprite->playback = _playback.size();
+  _playback.push_back( Playback{ time, sprite->rate, sprite->animation, frame, sprite->looping } );
+  _sprites.push_back( sprite );
+  _meshes.push_back( entity.component<RenderMesh>() );
+  showFrame( sprite->playback );
+}
+
+void SpriteAnimationSystem::untrack( const SpriteAnimationRef &sprite )
+{
+  if( !isTracked( sprite ) )
+  {
+    return;
+  }
+  // move the last sprite into the vacated slot to keep the arrays packed
+  const size_t slot = sprite->playback;
+  auto &sprites = spritesFor( sprite );
+  auto &meshes = meshesFor( sprite );
+  if( !sprite->clock )
+  {
+    _playback[slot] = _playback.back();
+    _playback.pop_back();
+  }
+  sprites[slot] = sprites.back();
+  meshes[slot] = meshes.back();
+  sprites[slot]->playback = slot;
+  sprites.pop_back();
+  meshes.pop_back();
+  sprite->playback = numeric_limits<size_t>::max();
+}
+
+void SpriteAnimationSystem::showFrame( size_t slot )
+{
+  const Playback &play = _playback[slot];
+  const Timeline &timeline = _timelines[play.animation];
+  _sprites[slot]->current_index = play.frame;
+  if( _meshes[slot] && timeline.frame_count > 0 )
+  {
+    _meshes[slot]->matchTexture( _frame_drawings[timeline.first_frame + play.frame] );
+  }
+}
+
+void SpriteAnimationSystem::showClockFrame( Clock &clock, size_t slot )
+{
+  const Timeline &timeline = _timelines[clock.playback.animation];
+  if( timeline.frame_count == 0 )
+  {
+    return;
+  }
+  // build the frame once, then copy its shape and texture coordinates, leaving member colors alone
+  _clock_mesh.matchTexture( _frame_drawings[timeline.first_frame + clock.playback.frame] );
+  const auto &source = _clock_mesh.vertices;
+  const size_t begin = slot < clock.sprites.size() ? slot : 0;
+  const size_t end = slot < clock.sprites.size() ? slot + 1 : clock.sprites.size();
+  for( size_t i = begin; i < end; ++i )
+  {
+    clock.sprites[i]->current_index = clock.playback.frame;
+    RenderMesh *mesh = clock.meshes[i].get();
+    if( !mesh )
+    {
+      continue;
+    }
+    if( mesh->vertices.size() != source.size() )
+    {
+      mesh->vertices.resize( source.size() );
+    }
+    Vertex *target = mesh->vertices.data();
+    for( size_t v = 0; v < source.size(); ++v )
+    {
+      target[v].position = source[v].position;
+      target[v].tex_coord = source[v].tex_coord;
+    }
+    mesh->markDirty();
+  }
+}
+
 void SpriteAnimationSystem::receive(const ComponentAddedEvent<SpriteAnimation> &event)
 { // track the sprite
+  track( event.entity, event.component );
+}
+
+void SpriteAnimationSystem::receive(const ComponentRemovedEvent<SpriteAnimation> &event)
+{
+  untrack( event.component );
+}
+
+void SpriteAnimationSystem::receive(const ComponentAddedEvent<RenderMesh> &event)
+{ // meshes may arrive after the animation
   auto entity = event.entity;
-  auto mesh = entity.component<RenderMesh>();
-  if( mesh )
+  auto sprite = entity.component<SpriteAnimation>();
+  if( sprite && isTracked( sprite ) )
   {
-    auto sprite = event.component;
-    auto drawings = _animations.at( sprite->animation ).drawings;
-    sprite->current_index = math<int>::clamp( sprite->current_index, 0, drawings.size() - 1 );
-    mesh->matchTexture( drawings.at( sprite->current_index ).drawing );
+    meshesFor( sprite )[sprite->playback] = event.component;
+    if( sprite->clock )
+    {
+      showClockFrame( _clocks[sprite->clock - 1], sprite->playback );
+    }
+    else
+    {
+      showFrame( sprite->playback );
+    }
   }
 }
 
-void SpriteAnimationSystem::update( EntityManagerRef es, EventManagerRef events, double dt )
+void SpriteAnimationSystem::receive(const ComponentRemovedEvent<RenderMesh> &event)
 {
-  for( auto entity : es->entities_with_components<SpriteAnimation, RenderMesh>() )
+  auto entity = event.entity;
+  auto sprite = entity.component<SpriteAnimation>();
+  if( sprite && isTracked( sprite ) )
   {
-    auto sprite = entity.component<SpriteAnimation>();
-    auto mesh = entity.component<RenderMesh>();
+    meshesFor( sprite )[sprite->playback] = nullptr;
+  }
+}
 
-    const auto &anim = _animations.at( sprite->animation );
-    const auto &current_drawing = anim.drawings.at( sprite->current_index );
-    sprite->hold += dt * sprite->rate;
-    int next_index = sprite->current_index;
-    // check timing
-    if( sprite->hold > anim.frame_duration * current_drawing.hold )
-    { // move to next frame
-      next_index += 1;
-      sprite->hold = 0.0f;
-    }
-    else if ( sprite->hold < -anim.frame_duration * current_drawing.hold )
-    { // step back a frame
-      next_index -= 1;
-      sprite->hold = 0.0f;
+void SpriteAnimationSystem::receive(const EntityDestroyedEvent &event)
+{
+  auto entity = event.entity;
+  auto sprite = entity.component<SpriteAnimation>();
+  if( sprite )
+  {
+    untrack( sprite );
+  }
+}
+
+bool SpriteAnimationSystem::advance( Playback &play, float step, bool &finished ) const
+{
+  const Timeline &timeline = _timelines[play.animation];
+  if( timeline.duration <= 0.0f )
+  { // nothing to advance through
+    return false;
+  }
+  float time = play.time + step * play.rate;
+  if( time >= timeline.duration || time < 0.0f )
+  { // ran off an end
+    if( play.looping )
+    { // wrap, however many times around dt took us
+      time -= timeline.duration * math<float>::floor( time / timeline.duration );
+      if( time >= timeline.duration )
+      { // rounding
+        time = 0.0f;
+      }
+      finished = true;
     }
-    // handle wrapping around beginning and end
-    if( next_index >= static_cast<int>( anim.drawings.size() ) )
-    { // handle wraparound at end
-      next_index = sprite->looping ? 0 : anim.drawings.size() - 1;
-      if( sprite->finish_fn ){ sprite->finish_fn( sprite ); }
+    else
+    { // stop at the end, finishing once on arrival
+      const bool forward = time >= timeline.duration;
+      finished = forward ? play.time < timeline.duration : play.time > 0.0f;
+      time = forward ? timeline.duration : 0.0f;
     }
-    else if( next_index < 0 )
-    { // handle wraparound at beginning
-      next_index = sprite->looping ? anim.drawings.size() - 1 : 0;
-      if( sprite->finish_fn ){ sprite->finish_fn( sprite ); }
+  }
+  play.time = time;
+
+  // most updates stay on the current frame; only search when we've left it
+  const float *ends = _frame_ends.data() + timeline.first_frame;
+  const float start = play.frame > 0 ? ends[play.frame - 1] : 0.0f;
+  if( time < start || ( time >= ends[play.frame] && play.frame + 1 < timeline.frame_count ) )
+  {
+    const int frame = math<int>::min( static_cast<int>( upper_bound( ends, ends + timeline.frame_count, time ) - ends ), timeline.frame_count - 1 );
+    if( frame != play.frame )
+    {
+      play.frame = frame;
+      return true;
     }
-    // actually change the drawing
-    if( next_index != sprite->current_index )
+  }
+  return false;
+}
+
+void SpriteAnimationSystem::update( EntityManagerRef es, EventManagerRef events, double dt )
+{
+  const float step = static_cast<float>( dt );
+  for( size_t i = 0; i < _playback.size(); ++i )
+  {
+    bool finished = false;
+    if( advance( _playback[i], step, finished ) )
     { // the frame index has changed, update display
-      sprite->current_index = next_index;
-      const auto &next_drawing = anim.drawings.at( sprite->current_index ).drawing;
-      if( mesh ){ mesh->matchTexture( next_drawing ); }
+      showFrame( i );
+    }
+    if( finished && _sprites[i]->finish_fn )
+    {
+      _finished.push_back( _sprites[i] );
+    }
+  }
+
+  for( Clock &clock : _clocks )
+  { // evaluated once, then fanned out to members
+    bool finished = false;
+    if( advance( clock.playback, step, finished ) )
+    {
+      showClockFrame( clock );
     }
+    if( finished )
+    {
+      for( auto &sprite : clock.sprites )
+      {
+        if( sprite->finish_fn ){ _finished.push_back( sprite ); }
+      }
+    }
+  }
+
+  // callbacks run after the pass, since they may add or remove sprites
+  for( auto &sprite : _finished )
+  {
+    sprite->finish_fn( sprite );
   }
+  _finished.clear();
 }
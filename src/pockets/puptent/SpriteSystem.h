@@ -29,6 +29,8 @@
 #include "pockets/puptent/PupTent.h"
 #include "pockets/TextureAtlas.h"
 #include "pockets/CollectionUtilities.hpp"
+#include "pockets/puptent/RenderMeshComponent.h"
+#include <limits>
 
 namespace cinder
 {
@@ -41,8 +43,16 @@ namespace pockets
   /**
    SpriteAnimation:
    A playing animation
+   Once added to an entity, its playback is run by SpriteAnimationSystem.
+   looping, rate, hold, and current_index set where playback starts;
+   change rate and looping later through the system's setRate and setLooping.
+   current_index follows the frame on display.
+   Sprites given a clock play in lockstep with it instead of keeping their own
+   time; see SpriteAnimationSystem::createClock.
   */
   typedef size_t AnimationId;
+  //! a playback clock shared by sprites; 0 is no clock
+  typedef size_t ClockId;
   typedef std::shared_ptr<class SpriteAnimation>  SpriteAnimationRef;
   typedef std::function<void (SpriteAnimationRef)> SpriteAnimationCallback;
   struct SpriteAnimation : Component<SpriteAnimation>
@@ -58,6 +68,10 @@ namespace pockets
     int                       current_index = 0;
     // called when animation is completed (at the end of every loop if looping)
     SpriteAnimationCallback   finish_fn = nullptr;
+    // shared clock driving this sprite; when set, the clock's animation, rate, and time are used
+    ClockId                   clock = 0;
+    // slot in SpriteAnimationSystem's playback arrays; managed by the system
+    size_t                    playback = std::numeric_limits<size_t>::max();
   };
 
   typedef std::shared_ptr<class SpriteAnimationSystem> SpriteAnimationSystemRef;
@@ -66,6 +80,15 @@ namespace pockets
    Plays back SpriteAnimations
    Updates a RenderMesh component with the current animation frame
    Assumes that whatever renderer will bind the correct texture for display
+
+   Animations are compiled to tables of cumulative frame end times, so any
+   dt lands on the right frame with a binary search. Playback state for
+   every tracked sprite is packed into one array and meshes are only
+   rewritten when their frame changes.
+
+   Sprites that share a clock (crowds, tiles, decorations) are evaluated
+   once per clock; on a frame change the clock's mesh is built once and its
+   positions and texture coordinates are copied to every member.
    */
   class SpriteAnimationSystem : public System<SpriteAnimationSystem>, public Receiver<SpriteAnimationSystem>
   {
@@ -90,8 +113,12 @@ namespace pockets
     static SpriteAnimationSystemRef create( TextureAtlasRef atlas, const ci::JsonTree &animations );
     //! called by SystemManager to register event handlers
     void configure( EventManagerRef events ) override;
-    //! update mesh on sprite creation
+    //! start tracking sprites and update their mesh
     void receive( const ComponentAddedEvent<SpriteAnimation> &event );
+    void receive( const ComponentRemovedEvent<SpriteAnimation> &event );
+    void receive( const ComponentAddedEvent<RenderMesh> &event );
+    void receive( const ComponentRemovedEvent<RenderMesh> &event );
+    void receive( const EntityDestroyedEvent &event );
     void update( EntityManagerRef es, EventManagerRef events, double dt ) override;
     //! Create a component to play \a animation_name
     //! To display the animation properly, you will need to assign new component's mesh
@@ -103,11 +130,70 @@ namespace pockets
     //! Add a new animation to the system's list of animations
     //! You can then create components that reference your animation
     void addAnimation( const std::string &name, const Animation &animation );
+    //! change the playback rate of a tracked \a sprite; negative rates play backward
+    void setRate( const SpriteAnimationRef &sprite, float rate );
+    //! change whether a tracked \a sprite wraps around or stops at the end
+    void setLooping( const SpriteAnimationRef &sprite, bool looping );
+    //! Create a clock playing \a animation_id that sprites can share
+    ClockId            createClock( AnimationId animation_id, float rate=1.0f, bool looping=true );
+    //! Create a component that plays in lockstep with \a clock
+    SpriteAnimationRef createClockedAnimation( ClockId clock ) const;
+    void setClockRate( ClockId clock, float rate );
+    void setClockLooping( ClockId clock, bool looping );
   private:
+    //! an animation's frames, as a range of _frame_ends and _frame_drawings
+    struct Timeline
+    {
+      size_t  first_frame;
+      int     frame_count;
+      float   duration;   // seconds
+    };
+    //! per-sprite playback state, packed for update
+    struct Playback
+    {
+      float       time;   // seconds into the animation
+      float       rate;
+      AnimationId animation;
+      int         frame;
+      bool        looping;
+    };
+    //! shared playback and the sprites following it
+    struct Clock
+    {
+      Playback                          playback;
+      std::vector<SpriteAnimationRef>   sprites;
+      std::vector<RenderMeshRef>        meshes;
+    };
     TextureAtlasRef                     _atlas;
     // name : index into mAnimations
     std::map<std::string, AnimationId>  _animation_ids;
     std::vector<Animation>              _animations;
+    std::vector<Timeline>               _timelines;
+    // end time of each frame within its animation, every animation end to end
+    std::vector<float>                  _frame_ends;
+    std::vector<SpriteData>             _frame_drawings;
+    // tracked sprites; _sprites and _meshes parallel _playback and are only touched on frame changes
+    std::vector<Playback>               _playback;
+    std::vector<SpriteAnimationRef>     _sprites;
+    std::vector<RenderMeshRef>          _meshes;
+    std::vector<Clock>                  _clocks;
+    std::vector<SpriteAnimationRef>     _finished;
+    // scratch mesh a clock's frame is built in before copying to its members
+    RenderMesh                          _clock_mesh;
+    void  track( Entity entity, const SpriteAnimationRef &sprite );
+    void  untrack( const SpriteAnimationRef &sprite );
+    //! true if \a sprite is in the playback arrays or its clock's members
+    bool  isTracked( const SpriteAnimationRef &sprite ) const;
+    //! the sprite and mesh arrays \a sprite is (or would be) stored in
+    std::vector<SpriteAnimationRef>&  spritesFor( const SpriteAnimationRef &sprite );
+    std::vector<RenderMeshRef>&       meshesFor( const SpriteAnimationRef &sprite );
+    //! advance \a play by \a step seconds; returns true if its frame changed
+    //! \a finished is set if playback reached an end
+    bool  advance( Playback &play, float step, bool &finished ) const;
+    //! update the sprite in \a slot's mesh and index for its current frame
+    void  showFrame( size_t slot );
+    //! update a member of \a clock, or all of them if \a slot is npos
+    void  showClockFrame( Clock &clock, size_t slot=std::numeric_limits<size_t>::max() );
   };
 
 } // puptent::
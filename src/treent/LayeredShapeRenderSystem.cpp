@@ -84,16 +84,21 @@ void LayeredShapeRenderSystem::configure( EventManagerRef event_manager )
   event_manager->subscribe<ComponentAddedEvent<LayeredShapeRenderData>>( *this );
   event_manager->subscribe<ComponentRemovedEvent<LayeredShapeRenderData>>( *this );
 
-  // make buffer large enough to hold all the vertices you will ever need
-  mVbo = gl::Vbo::create( GL_ARRAY_BUFFER, 1.0e6 * sizeof( Vertex2D ), nullptr, GL_STREAM_DRAW );
+  // grows as needed, so start with room for a modest scene
+  mBuffer = StreamingBuffer::create( sizeof( Vertex2D ), 16384 );
   mAttributes = gl::Vao::create();
-  gl::ScopedVao attr( mAttributes );
-  mVbo->bind();
   mRenderProg = gl::GlslProg::create( gl::GlslProg::Format().vertex( defaultVertex().c_str() )
                                      .fragment( defaultFragment().c_str() )
                                      .attribLocation( "iPosition", 0 )
                                      .attribLocation( "iColor", 1 )
                                      .attribLocation( "iTexCoord", 2 ) );
+  bindAttributes();
+}
+
+void LayeredShapeRenderSystem::bindAttributes()
+{
+  gl::ScopedVao attr( mAttributes );
+  gl::ScopedBuffer buffer( mBuffer->getVbo() );
   gl::enableVertexAttribArray( 0 );
   gl::enableVertexAttribArray( 1 );
   gl::enableVertexAttribArray( 2 );
@@ -101,7 +106,7 @@ void LayeredShapeRenderSystem::configure( EventManagerRef event_manager )
   gl::vertexAttribPointer( 0, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex2D), (const GLvoid*)offsetof(Vertex2D, position) );
   gl::vertexAttribPointer( 1, 4, GL_UNSIGNED_BYTE, GL_TRUE, sizeof(Vertex2D), (const GLvoid*)offsetof(Vertex2D, color));
   gl::vertexAttribPointer( 2, 2, GL_FLOAT, GL_FALSE, sizeof(Vertex2D), (const GLvoid*)offsetof(Vertex2D,tex_coord) );
-  mVbo->unbind();
+  mBufferGeneration = mBuffer->getGeneration();
 }
 
 void LayeredShapeRenderSystem::receive(const ComponentAddedEvent<LayeredShapeRenderData> &event)
@@ -160,26 +165,15 @@ void LayeredShapeRenderSystem::receive(const EntityDestroyedEvent &event)
 }
 
 void LayeredShapeRenderSystem::update( EntityManagerRef es, EventManagerRef events, double dt )
-{ // assemble vertices for each pass
-  auto &v = mVertices;
-  v.clear();
-  for( const auto &pair : mGeometry )
-  {
-    auto mesh = pair->mesh;
-    auto loc = pair->locus;
-    auto mat = loc->matrix;
-    if( !v.empty() ) {
-      // create degenerate triangle between previous and current shape
-      v.push_back( v.back() );
-      auto vert = mesh->vertices.front();
-      v.emplace_back( Vertex2D{ mat.transformPoint( vert.position ), vert.color, vert.tex_coord } );
-    }
-    for( auto &vert : mesh->vertices ) {
-      v.emplace_back( Vertex2D{ mat.transformPoint( vert.position ), vert.color, vert.tex_coord } );
-    }
+{ // size the strip, then assemble vertices straight into the buffer
+  mVertexCount = mStrip.measure( mGeometry );
+  Vertex2D *out = static_cast<Vertex2D*>( mBuffer->map( mVertexCount ) );
+  mStrip.assemble( mGeometry, out );
+  mFirstVertex = mBuffer->unmap();
+  if( mBuffer->getGeneration() != mBufferGeneration )
+  { // the buffer was replaced to grow
+    bindAttributes();
   }
-
-  mVbo->bufferSubData( 0, mVertices.size() * sizeof( Vertex2D ), mVertices.data() );
 }
 
 void LayeredShapeRenderSystem::draw() const
@@ -192,8 +186,9 @@ void LayeredShapeRenderSystem::draw() const
   // premultiplied alpha blending for normal pass
   gl::ScopedBlend premultBlend( GL_ONE, GL_ONE_MINUS_SRC_ALPHA );
 
-  gl::drawArrays( GL_TRIANGLE_STRIP, 0, mVertices.size() );
-
+  gl::drawArrays( GL_TRIANGLE_STRIP, mFirstVertex, mVertexCount );
+  // keep this frame's region from being rewritten until these draws are done
+  mBuffer->fence();
 }
 
 }
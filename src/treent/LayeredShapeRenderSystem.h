@@ -31,6 +31,8 @@
 #include "treent/ShapeComponent.h"
 #include "cinder/gl/VboMesh.h"
 #include "cinder/gl/Vbo.h"
+#include "pockets/StreamingBuffer.h"
+#include "pockets/StripAssembler.h"
 
 namespace treent
 {
@@ -82,6 +84,10 @@ struct LayeredShapeRenderData : Component<LayeredShapeRenderData>
  The same texture will remain bound through all render passes.
  For "untextured" geometry, we leave a white pixel in the top-left corner
  of our sprite sheets and set all vertex tex coords to their default 0,0.
+
+ Vertices are written straight into a pockets::StreamingBuffer, which grows
+ to fit and rotates through fenced regions so writing never waits on the GPU.
+ A pockets::StripAssembler transforms chunks of the list in parallel.
  */
 class LayeredShapeRenderSystem : public System<LayeredShapeRenderSystem>, public Receiver<LayeredShapeRenderSystem>
 {
@@ -105,11 +111,17 @@ public:
   { stable_sort( mGeometry.begin(), mGeometry.end(), &LayeredShapeRenderSystem::layerSort ); }
 private:
   std::vector<LayeredShapeRenderDataRef>    mGeometry;
-  std::vector<Vertex2D>         mVertices;
-  ci::gl::VboRef                mVbo;
+  size_t                        mVertexCount = 0;
+  //! index of the first vertex written by the last update
+  size_t                        mFirstVertex = 0;
+  pockets::StreamingBufferRef   mBuffer;
+  pockets::StripAssembler<LayeredShapeRenderDataRef> mStrip;
+  size_t                        mBufferGeneration = 0;
   ci::gl::VaoRef                mAttributes;
   ci::gl::TextureRef            mTexture;
   ci::gl::GlslProgRef           mRenderProg;
+  //! point the vertex attributes at the current buffer object
+  void                        bindAttributes();
   static bool                 layerSort( const LayeredShapeRenderDataRef &lhs, const LayeredShapeRenderDataRef &rhs )
   { return lhs->render_layer < rhs->render_layer; }
   // maybe add a CameraRef for positioning the scene
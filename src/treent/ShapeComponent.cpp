@@ -80,10 +80,10 @@ void ShapeComponent::setAsBox( const Rectf &bounds )
 
 void ShapeComponent::setBoxTextureCoords( const SpriteData &sprite_data )
 {
-  vertices[0].tex_coord = sprite_data.texture_bounds.getUpperRight();
-  vertices[1].tex_coord = sprite_data.texture_bounds.getUpperLeft();
-  vertices[2].tex_coord = sprite_data.texture_bounds.getLowerRight();
-  vertices[3].tex_coord = sprite_data.texture_bounds.getLowerLeft();
+  vertices[0].tex_coord = sprite_data.getUpperRightTexCoord();
+  vertices[1].tex_coord = sprite_data.getUpperLeftTexCoord();
+  vertices[2].tex_coord = sprite_data.getLowerRightTexCoord();
+  vertices[3].tex_coord = sprite_data.getLowerLeftTexCoord();
 }
 
 void ShapeComponent::matchTexture(const SpriteData &sprite_data)
@@ -95,10 +95,10 @@ void ShapeComponent::matchTexture(const SpriteData &sprite_data)
   vertices[1].position = screen_bounds.getUpperLeft();
   vertices[2].position = screen_bounds.getLowerRight();
   vertices[3].position = screen_bounds.getLowerLeft();
-  vertices[0].tex_coord = sprite_data.texture_bounds.getUpperRight();
-  vertices[1].tex_coord = sprite_data.texture_bounds.getUpperLeft();
-  vertices[2].tex_coord = sprite_data.texture_bounds.getLowerRight();
-  vertices[3].tex_coord = sprite_data.texture_bounds.getLowerLeft();
+  vertices[0].tex_coord = sprite_data.getUpperRightTexCoord();
+  vertices[1].tex_coord = sprite_data.getUpperLeftTexCoord();
+  vertices[2].tex_coord = sprite_data.getLowerRightTexCoord();
+  vertices[3].tex_coord = sprite_data.getLowerLeftTexCoord();
 }
 
 void ShapeComponent::setAsTriangle(const ci::Vec2f &a, const ci::Vec2f &b, const ci::Vec2f &c)
@@ -27,6 +27,7 @@
 
 #pragma once
 #include "treent/Treent.h"
+#include "pockets/VertexTransform.h"
 #include "cinder/Color.h"
 #include "cinder/Rect.h"
 #include "cinder/Matrix.h"
@@ -50,6 +51,17 @@ struct Vertex2D
   ci::ColorA8u  color       = ci::ColorA8u::white();
   ci::Vec2f     tex_coord   = ci::Vec2f::zero();
 };
+} // treent::
+
+namespace pockets
+{
+  //! the SIMD loop shows no consistent gain on this 20-byte layout, so shapes are transformed one vertex at a time
+  template<>
+  struct VectorizeTransform<treent::Vertex2D> : std::false_type {};
+}
+
+namespace treent
+{
 /**
  ShapeComponent:
  Collection of vertices suitable for rendering as a triangle strip.